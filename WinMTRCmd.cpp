@@ -6,8 +6,47 @@
 
 #include "WinMTRCmd.h"
 #include "WinMTRGlobal.h"
+#include "WinMTREngine.h"
+#include "WinMTRFleet.h"
+#include "WinMTRMatrix.h"
+#include "WinMTRMetrics.h"
 #include "WinMTRNet.h"
 #include "WinMTRParams.h"
+#include "WinMTRSeries.h"
+#include "WinMTRStats.h"
+#include "WinMTRTrace.h"
+
+void JobThread(void *p);
+void FleetThread(void *p);
+void EventCallback(const wmtr_event *event, void *context);
+void ProbeCallback(const wmtr_probe_result *result, void *context);
+
+//*****************************************************************************
+// job_stream
+//
+// The probe and event lines of a running server job, added by the engine
+// workers and written by its JobThread, so a slow stdout never holds up a
+// worker.
+//*****************************************************************************
+struct job_stream {
+	const char			*id;
+	WinMTRNet			*net;
+	CRITICAL_SECTION	lock;		// guards pending
+	std::string			pending;
+};
+
+//*****************************************************************************
+// event_sink
+//
+// Where EventCallback sends the events of one trace.
+//*****************************************************************************
+struct event_sink {
+	WinMTRCmd		*cmd;
+	WinMTRNet		*net;
+	job_stream		*stream;	// of the job in server mode
+	bool			log;		// keep for the interactive display
+	bool			stop;		// stop the trace on the first event
+};
 
 //*****************************************************************************
 // _tmain
@@ -17,8 +56,7 @@
 int _tmain(int, _TCHAR** argv)
 {
 	WinMTRCmd cmd(argv[0]);
-	cmd.Run();
-	return 0;
+	return cmd.Run();
 }
 
 //*****************************************************************************
@@ -27,12 +65,32 @@ int _tmain(int, _TCHAR** argv)
 // 
 //*****************************************************************************
 WinMTRCmd::WinMTRCmd(_TCHAR *name)
-	: programName(name)
+	: programName(name), writer(NULL), snapshotTick(0), snapshotCycle(0), jobSeq(0), runningJobs(0)
 {
+	localHostname[0] = 0;
 	for (int i = 0; i < 256; i++)
 		indexMapping[i] = -1;
 	for (int i = 0; dataFields[i].key != 0; i++)
 		indexMapping[dataFields[i].key] = i;
+
+	InitializeCriticalSection(&outputLock);
+	InitializeCriticalSection(&cacheLock);
+	hJobsDone = CreateEvent(NULL, TRUE, TRUE, NULL);
+}
+
+//*****************************************************************************
+// WinMTRCmd::~WinMTRCmd
+//
+// 
+//*****************************************************************************
+WinMTRCmd::~WinMTRCmd()
+{
+	for (size_t i = 0; i < results.size(); i++)
+		delete results[i];
+	WinMTRTrace::Stop();
+	CloseHandle(hJobsDone);
+	DeleteCriticalSection(&cacheLock);
+	DeleteCriticalSection(&outputLock);
 }
 
 //*****************************************************************************
@@ -50,13 +108,18 @@ void ExitThread(void *p)
 	exit(0);
 }
 
-void WinMTRCmd::Run()
+int WinMTRCmd::Run()
 {
 	WinMTRParams params;
 	LPTSTR cmdLine			= GetCommandLineParams();
+	WinMTREngine* engine;
 	WinMTRNet* net;
+	event_sink sink;
 	int addr;
+	int ret;
 	FILE *file;
+	unsigned __int64 start;
+	WSADATA wsaData;
 
 	// initialize default parameters
 	params.SetHostName("");
@@ -68,44 +131,117 @@ void WinMTRCmd::Run()
 	params.SetPingSize(DEFAULT_PING_SIZE);
 	params.SetTimeout(DEFAULT_TIMEOUT);
 	params.SetFields(DEFAULT_FIELDS);
+	params.SetWorkers(DEFAULT_WORKERS);
 
 	// parse and validate command-line params
-	if (!ParseCommandLineParams(cmdLine, &params)) return;
-	if (!ValidateParams(&params)) return;
+	if (!ParseCommandLineParams(cmdLine, &params)) return 0;
+	if (!ValidateParams(&params)) return 1;
+	if (!WinMTRTrace::Start(params.traceLevel, params.traceFile)) return 1;
+
+	// once, before any job thread can render a report header. The engine
+	// starts Winsock only later and --merge has none, so gethostname needs
+	// its own WSAStartup.
+	if (WSAStartup(MAKEWORD(2, 2), &wsaData) == 0) {
+		if (gethostname(localHostname, 256) != 0)
+			localHostname[0] = 0;
+		WSACleanup();
+	}
+
+	if (params.merge[0])
+		return RunMerge(&params);
+
+	WinMTRMetrics::Enable(params.metrics);
+	engine = new WinMTREngine(params.workers, params.simfile);
+	if (!engine->IsInitialized())
+	{
+		delete engine;
+		return 1;
+	}
+	// a train or the TOS classes of a hop go out in one burst
+	engine->SetRate(params.rate, params.train ? params.train : params.tosCount);
+
+	if (params.server) {
+		RunServer(&params, engine);
+		delete engine;
+		return 0;
+	}
 
-	net = new WinMTRNet(&params);
+	net = new WinMTRNet(&params, engine);
+	if (params.detect) {
+		sink.cmd = this;
+		sink.net = net;
+		sink.stream = NULL;
+		sink.log = !params.report;
+		sink.stop = params.detectStop;
+		net->SetEventCallback(EventCallback, &sink);
+	}
 
 	// resolve the hostname
 	addr = GetAddr(params.hostname);
 	if (addr == INADDR_NONE)
 	{
 		delete net;
+		delete engine;
 		fprintf(stderr, "error: could not resolve hostname\n");
-		return;
+		return 1;
 	}
 
-	// get the name of the local host for later use
-	gethostname(localHostname, 256);
+	start = WinMTRStats::Now();
+	ret = 0;
+
+	if (params.snapshotSeconds > 0 || params.snapshotCycles > 0) {
+		writer = new WinMTRWriter(params.filename, params.rotateKB, params.rotateSeconds);
+		snapshotTick = GetTickCount();
+	}
 
-	if (params.report) {
+	if (params.report && writer) {
+		// the trace runs async so snapshots can be taken, the report is the last one
+		net->DoTrace(addr, true);
+		while (net->IsTracing()) {
+			Sleep(SNAPSHOT_POLL);
+			Snapshot(net, &params, false);
+		}
+		Snapshot(net, &params, true);
+		if (params.metrics)
+			PrintMetrics(stdout, engine, net);
+	} else if (params.report) {
 		// perform the trace sync
 		net->DoTrace(addr, false);
 
 		// print the trace report
+		file = stdout;
 		if (params.reportToFile)
 		{
 			file = fopen(params.filename, "w");
 			if (file == NULL) {
 				fprintf(stderr, "error: could not redirect report to '%s': %s\n",
 					params.filename, strerror(errno));
-				PrintReport(stdout, net, UnsafeGet, params.fields, params.wide);
-			} else {
-				PrintReport(file, net, UnsafeGet, params.fields, params.wide);
-				fclose(file);
+				file = stdout;
 			}
 		}
-		else
-			PrintReport(stdout, net, UnsafeGet, params.fields, params.wide);
+		PrintReport(file, net, UnsafeGet, params.fields, params.wide);
+		if (params.multipath)
+			PrintMultipath(file, net, params.confidence);
+		if (params.pmtu)
+			PrintMtu(file, net);
+		if (params.capacity)
+			PrintCapacity(file, net);
+		if (params.train)
+			PrintTrains(file, net, &params);
+		if (params.adaptive)
+			PrintPrecision(file, net, &params);
+		if (params.police)
+			PrintPolice(file, net, &params);
+		if (params.tosCount > 1)
+			PrintTos(file, net, &params);
+		if (params.lockstep)
+			PrintLockstep(file, net);
+		if (params.range)
+			PrintRange(file, net, &params);
+		if (params.metrics)
+			PrintMetrics(file, engine, net);
+		if (file != stdout)
+			fclose(file);
 	} else {
 		// start the thread listening for the exit command
 		_beginthread(ExitThread, 0, 0);
@@ -119,10 +255,49 @@ void WinMTRCmd::Run()
 			CLS();
 			printf("(X) Exit\n");
 			PrintReport(stdout, net, SafeGet, params.fields, params.wide);
+			if (params.multipath)
+				PrintMultipath(stdout, net, params.confidence);
+			if (params.pmtu)
+				PrintMtu(stdout, net);
+			if (params.capacity)
+				PrintCapacity(stdout, net);
+			if (params.train)
+				PrintTrains(stdout, net, &params);
+			if (params.adaptive)
+				PrintPrecision(stdout, net, &params);
+			if (params.police)
+				PrintPolice(stdout, net, &params);
+			if (params.tosCount > 1)
+				PrintTos(stdout, net, &params);
+			if (params.lockstep)
+				PrintLockstep(stdout, net);
+			if (params.metrics)
+				PrintMetrics(stdout, engine, net);
+			if (params.detect) {
+				EnterCriticalSection(&outputLock);
+				for (size_t i = 0; i < eventLog.size(); i++)
+					printf("EVENT %s\n", eventLog[i].c_str());
+				LeaveCriticalSection(&outputLock);
+			}
+			if (writer)
+				Snapshot(net, &params, false);
 		}
+		if (writer)
+			Snapshot(net, &params, true);
 	}
 
+	if (params.range && !params.report)
+		PrintRange(stdout, net, &params);
+
+	if (params.statsfile[0] && !WriteStats(net, params.hostname, params.statsfile, start))
+		ret = 1;
+	else if (params.detect && net->GetEvents() > 0)
+		ret = EXIT_EVENTS;
+	delete writer;
+	writer = NULL;
 	delete net;
+	delete engine;
+	return ret;
 }
 
 //*****************************************************************************
@@ -150,7 +325,21 @@ bool WinMTRCmd::ParseCommandLineParams(LPTSTR cmd, WinMTRParams *wmtrparams)
 			   "\t\t [--cycles=COUNT|-c=COUNT] [--interval=SECONDS|-i=SECONDS]\n"
 			   "\t\t [--size=BYTES|-s=BYTES] [--timeout=SECONDS|-t=SECONDS]\n"
 			   "\t\t [--file=PATH|-f=PATH] [--order=FIELDS ORDER|-o=FIELDS ORDER]\n"
-			   "\t\t HOSTNAME\n", programName);
+			   "\t\t [--workers=COUNT|-j=COUNT] [--simulate=PATH|-S=PATH]\n"
+			   "\t\t [--metrics|-m] [--server|-d] [--detect|-a] [--detect-stop|-A]\n"
+			   "\t\t [--multipath|-M] [--confidence=PERCENT|-C=PERCENT]\n"
+			   "\t\t [--stats=PATH|-x=PATH] [--record=KB|-R=KB]\n"
+			   "\t\t [--range=FROM:TO|-T=FROM:TO] [--snapshot=SECONDS|-P=SECONDS]\n"
+			   "\t\t [--snapshot=CYCLESc|-P=CYCLESc] [--rotate=KB[:SECONDS]|-O=KB[:SECONDS]]\n"
+			   "\t\t [--trace=LEVEL|-D=LEVEL] [--trace-file=PATH|-E=PATH] [--fast|-F]\n"
+			   "\t\t [--pmtu|-U] [--capacity|-K] [--train=COUNT|-B=COUNT]\n"
+			   "\t\t [--rate=PPS|-Q=PPS] [--precision=LOSS[:RTT]|-Y=LOSS[:RTT]]\n"
+			   "\t\t [--rto|-W] [--late=SECONDS|-Z=SECONDS] [--police|-L]\n"
+			   "\t\t [--tos=TOS[,TOS...]|-q=TOS[,TOS...]] [--lockstep|-k]\n"
+			   "\t\t HOSTNAME\n"
+			   "       %s [--merge=PATTERN|-g=PATTERN] [--stats=PATH|-x=PATH]\n"
+			   "\t\t [--file=PATH|-f=PATH] [--order=FIELDS ORDER|-o=FIELDS ORDER]\n"
+			   "\t\t [--wide|-w]\n", programName, programName);
 		return false;
 	}
 
@@ -163,6 +352,24 @@ bool WinMTRCmd::ParseCommandLineParams(LPTSTR cmd, WinMTRParams *wmtrparams)
 		return false;
 	}
 
+	// first, so the options below override its defaults
+	if(GetParamValue(cmd, "fast",'F', value, true)) {
+		wmtrparams->SetFast(true);
+		wmtrparams->SetInterval((float)FAST_INTERVAL);
+		wmtrparams->SetTimeout((float)FAST_TIMEOUT);
+		wmtrparams->SetWorkers(FAST_WORKERS);
+	}
+	if(GetParamValue(cmd, "capacity",'K', value, true)) {
+		wmtrparams->SetCapacity(true);
+		wmtrparams->SetCycles(CAPACITY_CYCLES);
+		wmtrparams->SetInterval((float)CAPACITY_INTERVAL);
+	}
+	if(GetParamValue(cmd, "precision",'Y', value, false)) {
+		float loss = 0, rtt = 0;
+		sscanf(value, "%f:%f", &loss, &rtt);
+		wmtrparams->SetPrecision(loss, rtt);
+		wmtrparams->SetCycles(ADAPTIVE_CYCLES);
+	}
 	if (GetParamValue(cmd, "report", 'r', value, true)) {
 		wmtrparams->SetReport(true);
 	}
@@ -184,12 +391,109 @@ bool WinMTRCmd::ParseCommandLineParams(LPTSTR cmd, WinMTRParams *wmtrparams)
 	if(GetParamValue(cmd, "timeout",'t', value, false)) {
 		wmtrparams->SetTimeout((float)atof(value));
 	}
+	if(GetParamValue(cmd, "late",'Z', value, false)) {
+		wmtrparams->SetLate((float)atof(value));
+	}
 	if(GetParamValue(cmd, "file",'f', value, false)) {
 		wmtrparams->SetFilename(value);
 	}
 	if(GetParamValue(cmd, "order",'o', value, false)) {
 		wmtrparams->SetFields(value);
 	}
+	if(GetParamValue(cmd, "workers",'j', value, false)) {
+		wmtrparams->SetWorkers(atoi(value));
+	}
+	if(GetParamValue(cmd, "simulate",'S', value, false)) {
+		wmtrparams->SetSimFile(value);
+	}
+	if(GetParamValue(cmd, "metrics",'m', value, true)) {
+		wmtrparams->SetMetrics(true);
+	}
+	if(GetParamValue(cmd, "server",'d', value, true)) {
+		wmtrparams->SetServer(true);
+	}
+	if(GetParamValue(cmd, "detect",'a', value, true)) {
+		wmtrparams->SetDetect(true);
+	}
+	if(GetParamValue(cmd, "detect-stop",'A', value, true)) {
+		wmtrparams->SetDetect(true);
+		wmtrparams->SetDetectStop(true);
+	}
+	if(GetParamValue(cmd, "multipath",'M', value, true)) {
+		wmtrparams->SetMultipath(true);
+	}
+	if(GetParamValue(cmd, "confidence",'C', value, false)) {
+		wmtrparams->SetConfidence((float)atof(value));
+	}
+	if(GetParamValue(cmd, "stats",'x', value, false)) {
+		wmtrparams->SetStatsFile(value);
+	}
+	if(GetParamValue(cmd, "merge",'g', value, false)) {
+		wmtrparams->SetMerge(value);
+	}
+	if(GetParamValue(cmd, "record",'R', value, false)) {
+		wmtrparams->SetRecord(atoi(value));
+	}
+	if(GetParamValue(cmd, "range",'T', value, false)) {
+		float from = -1, to = -1;
+		sscanf(value, "%f:%f", &from, &to);
+		wmtrparams->SetRange(from, to);
+	}
+	if(GetParamValue(cmd, "snapshot",'P', value, false)) {
+		size_t len = strlen(value);
+		if (len > 0 && value[len - 1] == 'c')
+			wmtrparams->SetSnapshot(0, atoi(value));
+		else
+			wmtrparams->SetSnapshot((float)atof(value), 0);
+	}
+	if(GetParamValue(cmd, "trace",'D', value, false)) {
+		const char *levels[] = { "none", "error", "info", "debug" };
+		int level = -1;
+		for (int i = 0; i < sizeof(levels) / sizeof(levels[0]); i++)
+			if (_stricmp(value, levels[i]) == 0)
+				level = i;
+		wmtrparams->SetTrace(level);
+	}
+	if(GetParamValue(cmd, "trace-file",'E', value, false)) {
+		wmtrparams->SetTraceFile(value);
+	}
+	if(GetParamValue(cmd, "pmtu",'U', value, true)) {
+		wmtrparams->SetPmtu(true);
+	}
+	if(GetParamValue(cmd, "train",'B', value, false)) {
+		wmtrparams->SetTrain(atoi(value));
+	}
+	if(GetParamValue(cmd, "rate",'Q', value, false)) {
+		wmtrparams->SetRate((float)atof(value));
+	}
+	if(GetParamValue(cmd, "rto",'W', value, true)) {
+		wmtrparams->SetRto(true);
+	}
+	if(GetParamValue(cmd, "police",'L', value, true)) {
+		wmtrparams->SetPolice(true);
+	}
+	if(GetParamValue(cmd, "lockstep",'k', value, true)) {
+		wmtrparams->SetLockstep(true);
+	}
+	if(GetParamValue(cmd, "tos",'q', value, false)) {
+		// one more than allowed, so that ValidateParams sees too many
+		int tos[MAX_TOS + 1], count = 0;
+		char *p = value, *end;
+		while (count <= MAX_TOS) {
+			tos[count++] = strtol(p, &end, 0);
+			if (end == p)
+				tos[count - 1] = -1;
+			if (*end != ',')
+				break;
+			p = end + 1;
+		}
+		wmtrparams->SetTos(count, tos);
+	}
+	if(GetParamValue(cmd, "rotate",'O', value, false)) {
+		int kb = 0, seconds = 0;
+		sscanf(value, "%d:%d", &kb, &seconds);
+		wmtrparams->SetRotate(kb, seconds);
+	}
 	if(GetHostNameParamValue(cmd, host_name)) {
 		wmtrparams->SetHostName(host_name.c_str());
 	}
@@ -203,7 +507,7 @@ bool WinMTRCmd::ParseCommandLineParams(LPTSTR cmd, WinMTRParams *wmtrparams)
 //*****************************************************************************
 bool WinMTRCmd::ValidateParams(WinMTRParams *wmtrparams)
 {
-	if (strlen(wmtrparams->hostname) == 0) {
+	if (strlen(wmtrparams->hostname) == 0 && !wmtrparams->server && !wmtrparams->merge[0]) {
 		printf("error: no hostname specified\n");
 		return false;
 	}
@@ -213,6 +517,186 @@ bool WinMTRCmd::ValidateParams(WinMTRParams *wmtrparams)
 		return false;
 	}
 
+	if (wmtrparams->cycles < 1) {
+		printf("error: cycles has to be positive\n");
+		return false;
+	}
+
+	// also false for NaN
+	if (!(wmtrparams->interval >= 0 && wmtrparams->interval <= MAX_SECONDS)) {
+		printf("error: interval has to be in the range [0, %d]\n", MAX_SECONDS);
+		return false;
+	}
+
+	if (!(wmtrparams->timeout > 0 && wmtrparams->timeout <= MAX_SECONDS)) {
+		printf("error: timeout has to be in the range (0, %d]\n", MAX_SECONDS);
+		return false;
+	}
+
+	if (wmtrparams->workers < 0 || wmtrparams->workers > MAX_WORKERS) {
+		printf("error: workers has to be in the range [0, %d]\n", MAX_WORKERS);
+		return false;
+	}
+
+	if (wmtrparams->confidence < 50.0f || wmtrparams->confidence > 99.9f) {
+		printf("error: confidence has to be in the range [50, 99.9]\n");
+		return false;
+	}
+
+	if (wmtrparams->record < 0 || wmtrparams->record > MAX_RECORD) {
+		printf("error: record has to be in the range [0, %d]\n", MAX_RECORD);
+		return false;
+	}
+
+	if (wmtrparams->range) {
+		if (wmtrparams->rangeFrom < 0 || wmtrparams->rangeTo < wmtrparams->rangeFrom) {
+			printf("error: range has to be FROM:TO seconds with 0 <= FROM <= TO\n");
+			return false;
+		}
+		if (wmtrparams->record == 0)
+			wmtrparams->SetRecord(DEFAULT_RECORD);
+	}
+
+	if (wmtrparams->snapshotSeconds < 0 || wmtrparams->snapshotCycles < 0) {
+		printf("error: snapshot has to be SECONDS or CYCLESc\n");
+		return false;
+	}
+
+	bool snapshots = wmtrparams->snapshotSeconds > 0 || wmtrparams->snapshotCycles > 0;
+	if (snapshots && !wmtrparams->reportToFile) {
+		printf("error: snapshots need a file\n");
+		return false;
+	}
+
+	if (wmtrparams->rotateKB < 0 || wmtrparams->rotateSeconds < 0) {
+		printf("error: rotate has to be KB or KB:SECONDS\n");
+		return false;
+	}
+
+	if (wmtrparams->traceLevel < 0) {
+		printf("error: trace has to be none, error, info or debug\n");
+		return false;
+	}
+
+	if (wmtrparams->traceLevel > WMTR_TRACE_LEVEL) {
+		printf("error: this build only traces up to level %d, see WMTR_TRACE_LEVEL\n",
+			WMTR_TRACE_LEVEL);
+		return false;
+	}
+
+	if (wmtrparams->pmtu) {
+		if (wmtrparams->multipath) {
+			printf("error: pmtu and multipath cannot be combined\n");
+			return false;
+		}
+		// the MTU column comes with the search
+		size_t len = strlen(wmtrparams->fields);
+		if (!strchr(wmtrparams->fields, 'U') && len + 1 < SIZE_FIELDS) {
+			wmtrparams->fields[len] = 'U';
+			wmtrparams->fields[len + 1] = 0;
+		}
+	}
+
+	if (wmtrparams->capacity) {
+		if (wmtrparams->multipath || wmtrparams->pmtu || wmtrparams->fast) {
+			printf("error: capacity cannot be combined with multipath, pmtu or fast\n");
+			return false;
+		}
+		size_t len = strlen(wmtrparams->fields);
+		if (!strchr(wmtrparams->fields, 'K') && len + 1 < SIZE_FIELDS) {
+			wmtrparams->fields[len] = 'K';
+			wmtrparams->fields[len + 1] = 0;
+		}
+	}
+
+	if (wmtrparams->train < 0 || wmtrparams->train > TRAIN_MAX) {
+		printf("error: train has to be in the range [0, %d]\n", TRAIN_MAX);
+		return false;
+	}
+
+	if (wmtrparams->train && (wmtrparams->multipath || wmtrparams->pmtu || wmtrparams->capacity)) {
+		printf("error: train cannot be combined with multipath, pmtu or capacity\n");
+		return false;
+	}
+
+	if (wmtrparams->adaptive) {
+		if (wmtrparams->precisionLoss <= 0 || wmtrparams->precisionRtt < 0) {
+			printf("error: precision has to be LOSS or LOSS:RTT, both positive\n");
+			return false;
+		}
+		if (wmtrparams->multipath || wmtrparams->pmtu || wmtrparams->capacity || wmtrparams->fast) {
+			printf("error: precision cannot be combined with multipath, pmtu, capacity or fast\n");
+			return false;
+		}
+	}
+
+	if (wmtrparams->rto) {
+		// the timeouts and late replies come with it
+		size_t len = strlen(wmtrparams->fields);
+		if (!strchr(wmtrparams->fields, 'T') && len + 2 < SIZE_FIELDS) {
+			wmtrparams->fields[len] = 'T';
+			wmtrparams->fields[len + 1] = 'E';
+			wmtrparams->fields[len + 2] = 0;
+		}
+	}
+
+	if (wmtrparams->police) {
+		if (wmtrparams->multipath || wmtrparams->pmtu || wmtrparams->capacity || wmtrparams->train) {
+			printf("error: police cannot be combined with multipath, pmtu, capacity or train\n");
+			return false;
+		}
+		// forwarding and policed loss come with it
+		size_t len = strlen(wmtrparams->fields);
+		if (!strchr(wmtrparams->fields, 'F') && len + 2 < SIZE_FIELDS) {
+			wmtrparams->fields[len] = 'F';
+			wmtrparams->fields[len + 1] = 'Q';
+			wmtrparams->fields[len + 2] = 0;
+		}
+	}
+
+	if (wmtrparams->tosCount > 0) {
+		if (wmtrparams->tosCount > MAX_TOS) {
+			printf("error: tos takes up to %d classes\n", MAX_TOS);
+			return false;
+		}
+		for (int i = 0; i < wmtrparams->tosCount; i++) {
+			if (wmtrparams->tos[i] < 0 || wmtrparams->tos[i] > 255) {
+				printf("error: tos has to be a list of TOS bytes in the range [0, 255]\n");
+				return false;
+			}
+		}
+		if (wmtrparams->tosCount > 1 && (wmtrparams->multipath || wmtrparams->pmtu ||
+				wmtrparams->capacity || wmtrparams->train || wmtrparams->police)) {
+			printf("error: tos classes cannot be combined with multipath, pmtu, capacity, train or police\n");
+			return false;
+		}
+	}
+
+	if (wmtrparams->lockstep) {
+		if (wmtrparams->multipath || wmtrparams->pmtu || wmtrparams->capacity || wmtrparams->train ||
+				wmtrparams->adaptive || wmtrparams->police || wmtrparams->tosCount > 1) {
+			printf("error: lockstep cannot be combined with multipath, pmtu, capacity, train, precision, police or tos classes\n");
+			return false;
+		}
+		if (wmtrparams->interval <= 0) {
+			printf("error: lockstep needs a positive interval\n");
+			return false;
+		}
+		// a cycle is over before the next starts, later replies still count within --late
+		if (wmtrparams->timeout > wmtrparams->interval)
+			wmtrparams->SetTimeout(wmtrparams->interval);
+	}
+
+	if (wmtrparams->late < 0) {
+		printf("error: late has to be positive\n");
+		return false;
+	}
+
+	if (wmtrparams->rate < 0) {
+		printf("error: rate has to be positive\n");
+		return false;
+	}
+
 	return true;
 }
 
@@ -337,7 +821,18 @@ bool WinMTRCmd::GetHostNameParamValue(LPTSTR cmd, std::string& host_name)
 
 	if(possible_argument.length() && (possible_argument[0] != '-' || possible_argument == "-n"
 		|| possible_argument == "-w" || possible_argument == "-r" || possible_argument == "--numeric"
-		|| possible_argument == "--wide" ||  possible_argument == "--report")) {
+		|| possible_argument == "--wide" ||  possible_argument == "--report"
+		|| possible_argument == "-m" || possible_argument == "--metrics"
+		|| possible_argument == "-d" || possible_argument == "--server"
+		|| possible_argument == "-a" || possible_argument == "--detect"
+		|| possible_argument == "-A" || possible_argument == "--detect-stop"
+		|| possible_argument == "-M" || possible_argument == "--multipath"
+		|| possible_argument == "-F" || possible_argument == "--fast"
+		|| possible_argument == "-U" || possible_argument == "--pmtu"
+		|| possible_argument == "-K" || possible_argument == "--capacity"
+		|| possible_argument == "-W" || possible_argument == "--rto"
+		|| possible_argument == "-L" || possible_argument == "--police"
+		|| possible_argument == "-k" || possible_argument == "--lockstep")) {
 		host_name = name;
 		return true;
 	}
@@ -353,6 +848,23 @@ bool WinMTRCmd::GetHostNameParamValue(LPTSTR cmd, std::string& host_name)
 
 void WinMTRCmd::PrintReport(FILE* file, WinMTRNet* net, int getType,
 	const char* fields, bool reportwide)
+{
+	std::string out;
+	LONGLONG start = WinMTRMetrics::Now();
+
+	RenderReport(out, net, getType, fields, reportwide);
+	fputs(out.c_str(), file);
+
+	metrics.Add(METRIC_RENDER, start, WinMTRMetrics::Now());
+}
+
+//*****************************************************************************
+// WinMTRCmd::RenderReport
+//
+// 
+//*****************************************************************************
+void WinMTRCmd::RenderReport(std::string& out, WinMTRNet* net, int getType,
+	const char* fields, bool reportwide)
 {
 	int max;
 	char name[81];
@@ -386,7 +898,8 @@ void WinMTRCmd::PrintReport(FILE* file, WinMTRNet* net, int getType,
 		_snprintf(buf + len, sizeof(buf) - len, fmt, dataFields[j].title);
 		len += dataFields[j].length;
 	}
-	fprintf(file, "%s\n", buf);
+	out += buf;
+	out += "\n";
 
 	for (int at = 0; at < max; at++) {
 		net->GetName(at, name);
@@ -412,37 +925,1187 @@ void WinMTRCmd::PrintReport(FILE* file, WinMTRNet* net, int getType,
 				_snprintf(buf + len, sizeof(buf) - len, dataFields[j].format);
 			len += dataFields[j].length;
 		}
-		fprintf(file, "%s\n", buf);
+		out += buf;
+		out += "\n";
+
+		RenderResponders(out, net, at, len_hosts, reportwide);
 	}
 }
 
 //*****************************************************************************
-// WinMTRCmd::GetAddr
+// WinMTRCmd::RenderResponders
 //
-// 
+// One line per responder below hops answered by more than one address.
 //*****************************************************************************
-int WinMTRCmd::GetAddr(char* s)
+void WinMTRCmd::RenderResponders(std::string& out, WinMTRNet* net, int at, int len_hosts,
+	bool reportwide)
+{
+	s_responder r[MAX_RESPONDERS];
+	char name[81];
+	char buf[1024];
+	char fmt[16];
+	int n = 0, total = 0;
+
+	while (n < MAX_RESPONDERS && net->GetResponder(at, n, &r[n])) {
+		total += r[n].returned;
+		n++;
+	}
+	if (n < 2)
+		return;
+
+	_snprintf(fmt, sizeof(fmt), "    +-- %%-%ds", len_hosts);
+	for (int i = 0; i < n; i++) {
+		int addr = ntohl(r[i].addr);
+		sprintf(name, "%d.%d.%d.%d", (addr >> 24) & 0xff, (addr >> 16) & 0xff,
+			(addr >> 8) & 0xff, addr & 0xff);
+		_snprintf(buf, sizeof(buf), fmt, name);
+		int len = reportwide ? strlen(buf) : len_hosts;
+		_snprintf(buf + len, sizeof(buf) - len,
+			" %5.1f%%  Rcv %4d  Avg %6.1f  Best %4d  Wrst %4d",
+			total ? 100.0f * r[i].returned / total : 0.0f, r[i].returned,
+			r[i].avg, r[i].best, r[i].worst);
+		out += buf;
+		out += "\n";
+	}
+}
+
+//*****************************************************************************
+// WinMTRCmd::PrintMultipath
+//
+//*****************************************************************************
+void WinMTRCmd::PrintMultipath(FILE* file, WinMTRNet* net, float confidence)
+{
+	std::string out;
+
+	RenderMultipath(out, net, confidence);
+	fputs(out.c_str(), file);
+}
+
+//*****************************************************************************
+// WinMTRCmd::RenderMultipath
+//
+// The hop graph found by multipath discovery: for every hop the number of
+// responders and probes, and the links to the next hop with the number of
+// flow ids seen on each.
+//*****************************************************************************
+void WinMTRCmd::RenderMultipath(std::string& out, WinMTRNet* net, float confidence)
+{
+	s_responder r[MAX_RESPONDERS], next[MAX_RESPONDERS];
+	int links[MAX_RESPONDERS][MAX_RESPONDERS];
+	char from[16], to[16];
+	char buf[256];
+	int n, nnext = 0;
+	int max = net->GetMax();
+
+	_snprintf(buf, sizeof(buf), "MULTIPATH: %.1f%% confidence\n", confidence);
+	out += buf;
+
+	for (n = 0; n < MAX_RESPONDERS && net->GetResponder(0, n, &next[n]); n++) ;
+	nnext = n;
+
+	for (int at = 0; at < max; at++) {
+		n = nnext;
+		memcpy(r, next, sizeof(r));
+		for (nnext = 0; at + 1 < max && nnext < MAX_RESPONDERS
+			&& net->GetResponder(at + 1, nnext, &next[nnext]); nnext++) ;
+
+		_snprintf(buf, sizeof(buf), " %2d. %d responder%s, %d probes, %d needed\n",
+			at + 1, n, (n == 1) ? "" : "s", net->GetXmit(at),
+			net->GetMultipathProbes(n > 0 ? n : 1));
+		out += buf;
+
+		memset(links, 0, sizeof(links));
+		for (int flow = 0; flow < MAX_FLOWS; flow++) {
+			int i = net->GetFlowResponder(at, flow);
+			int j = (at + 1 < max) ? net->GetFlowResponder(at + 1, flow) : -1;
+			if (i >= 0 && j >= 0)
+				links[i][j]++;
+		}
+
+		for (int i = 0; i < n; i++) {
+			for (int j = 0; j < nnext; j++) {
+				if (links[i][j] == 0)
+					continue;
+				int fa = ntohl(r[i].addr), ta = ntohl(next[j].addr);
+				sprintf(from, "%d.%d.%d.%d", (fa >> 24) & 0xff, (fa >> 16) & 0xff,
+					(fa >> 8) & 0xff, fa & 0xff);
+				sprintf(to, "%d.%d.%d.%d", (ta >> 24) & 0xff, (ta >> 16) & 0xff,
+					(ta >> 8) & 0xff, ta & 0xff);
+				_snprintf(buf, sizeof(buf), "      %-15s -> %-15s %4d flows\n",
+					from, to, links[i][j]);
+				out += buf;
+			}
+		}
+	}
+}
+
+//*****************************************************************************
+// WinMTRCmd::PrintRange
+//
+//*****************************************************************************
+void WinMTRCmd::PrintRange(FILE* file, WinMTRNet* net, WinMTRParams* params)
+{
+	std::string out;
+
+	RenderRange(out, net, params);
+	fputs(out.c_str(), file);
+}
+
+//*****************************************************************************
+// WinMTRCmd::RenderRange
+//
+// The report of the probes sent between params->rangeFrom and rangeTo
+// seconds after the start, from the recorded probes.
+//*****************************************************************************
+void WinMTRCmd::RenderRange(std::string& out, WinMTRNet* net, WinMTRParams* params)
+{
+	char buf[64];
+	WinMTRSeries *series = net->GetSeries();
+	WinMTRStats *stats = new WinMTRStats;
+	WinMTRNet *range = new WinMTRNet(params, NULL);
+	DWORD from = (DWORD)(params->rangeFrom * 1000);
+	DWORD to = (DWORD)(params->rangeTo * 1000);
+
+	stats->Collect(net, params->hostname, 0, 0);
+	for (int at = 0; at < stats->header.hops; at++)
+		series->Summarize(at, from, to, &stats->hop[at]);
+	stats->Apply(range);
+
+	_snprintf(buf, sizeof(buf), "RANGE: %.1f - %.1f s\n", params->rangeFrom, params->rangeTo);
+	out += buf;
+	RenderReport(out, range, UnsafeGet, params->fields, params->wide);
+
+	delete range;
+	delete stats;
+}
+
+//*****************************************************************************
+// WinMTRCmd::PrintMtu
+//
+//*****************************************************************************
+void WinMTRCmd::PrintMtu(FILE* file, WinMTRNet* net)
+{
+	std::string out;
+
+	RenderMtu(out, net);
+	fputs(out.c_str(), file);
+}
+
+//*****************************************************************************
+// WinMTRCmd::RenderMtu
+//
+// The path MTU found by --pmtu, the MTU of the first hop and of every hop
+// where it shrinks, with the hop that answered too big in front of it.
+// Hops that never answered only have the MTU of their neighbours, a drop
+// is shown at the next hop that answered.
+//*****************************************************************************
+void WinMTRCmd::RenderMtu(std::string& out, WinMTRNet* net)
+{
+	char buf[128];
+	int max = net->GetMax();
+	int prev = 0;
+
+	int mtu = (max > 0) ? net->GetMtu(max - 1) : 0;
+	if (mtu == 0) {
+		out += "PATH MTU: unknown\n";
+		return;
+	}
+	_snprintf(buf, sizeof(buf), "PATH MTU: %d bytes\n", mtu);
+	out += buf;
+
+	for (int at = 0; at < max; at++) {
+		mtu = net->GetMtu(at);
+		if (mtu == 0 || (prev != 0 && mtu >= prev) || net->GetReturned(at) == 0)
+			continue;
+		int len = _snprintf(buf, sizeof(buf), " %2d. %d bytes", at + 1, mtu);
+		int r = ntohl(net->GetMtuReporter(at));
+		if (prev != 0 && r != 0)
+			_snprintf(buf + len, sizeof(buf) - len, ", too big at %d.%d.%d.%d",
+				(r >> 24) & 0xff, (r >> 16) & 0xff, (r >> 8) & 0xff, r & 0xff);
+		out += buf;
+		out += "\n";
+		prev = mtu;
+	}
+}
+
+//*****************************************************************************
+// WinMTRCmd::PrintCapacity
+//
+//*****************************************************************************
+void WinMTRCmd::PrintCapacity(FILE* file, WinMTRNet* net)
+{
+	std::string out;
+
+	RenderCapacity(out, net);
+	fputs(out.c_str(), file);
+}
+
+//*****************************************************************************
+// WinMTRCmd::RenderCapacity
+//
+// The slowest link found by --capacity.
+//*****************************************************************************
+void WinMTRCmd::RenderCapacity(std::string& out, WinMTRNet* net)
 {
-	struct hostent *host;
+	char buf[128];
+	int max = net->GetMax();
+	int bottleneck = -1;
+	float slowest = 0;
 
-	int isIP=1;
-	char *t = s;
-	while(*t) {
-		if(!isdigit(*t) && *t!='.') {
-			isIP=0;
-			break;
+	for (int at = 0; at < max; at++) {
+		float c = net->GetCapacity(at);
+		if (c > 0 && (bottleneck < 0 || c < slowest)) {
+			bottleneck = at;
+			slowest = c;
 		}
-		t++;
+	}
+	if (bottleneck < 0) {
+		out += "BOTTLENECK: unknown\n";
+		return;
 	}
 
-	if(!isIP) {
-		host = gethostbyname(s);
-		if (host)
-			return *(int *)host->h_addr;
-		else
-			return INADDR_NONE;
-	} else
-		return inet_addr(s);
+	int a = net->GetAddr(bottleneck);
+	_snprintf(buf, sizeof(buf), "BOTTLENECK: %.1f Mbit/s into hop %d, %d.%d.%d.%d\n",
+		slowest, bottleneck + 1, (a >> 24) & 0xff, (a >> 16) & 0xff, (a >> 8) & 0xff, a & 0xff);
+	out += buf;
+}
+
+//*****************************************************************************
+// WinMTRCmd::PrintTrains
+//
+//*****************************************************************************
+void WinMTRCmd::PrintTrains(FILE* file, WinMTRNet* net, WinMTRParams* params)
+{
+	std::string out;
+
+	RenderTrains(out, net, params);
+	fputs(out.c_str(), file);
+}
+
+//*****************************************************************************
+// WinMTRCmd::RenderTrains
+//
+// Loss and RTT of every hop over the --train trains, with their confidence
+// intervals and the loss of the worst train.
+//*****************************************************************************
+void WinMTRCmd::RenderTrains(std::string& out, WinMTRNet* net, WinMTRParams* params)
+{
+	s_trainstats t;
+	char buf[256];
+	int max = net->GetMax();
+
+	_snprintf(buf, sizeof(buf), "TRAINS: %d probes per train, %.1f%% confidence\n",
+		params->train, params->confidence);
+	out += buf;
+
+	for (int at = 0; at < max; at++) {
+		net->GetTrain(at, &t);
+		int len = _snprintf(buf, sizeof(buf),
+			" %2d. %d trains, loss %.1f%% [%.1f, %.1f] of %d, worst train %.1f%%",
+			at + 1, t.trains, t.loss, t.lossLow, t.lossHigh, t.sent, t.worst);
+		if (t.lost < t.sent)
+			_snprintf(buf + len, sizeof(buf) - len, ", rtt %.1f ms [%.1f, %.1f]",
+				t.rtt, t.rttLow, t.rttHigh);
+		out += buf;
+		out += "\n";
+	}
+}
+
+//*****************************************************************************
+// WinMTRCmd::PrintPrecision
+//
+//*****************************************************************************
+void WinMTRCmd::PrintPrecision(FILE* file, WinMTRNet* net, WinMTRParams* params)
+{
+	std::string out;
+
+	RenderPrecision(out, net, params);
+	fputs(out.c_str(), file);
+}
+
+//*****************************************************************************
+// WinMTRCmd::RenderPrecision
+//
+//*****************************************************************************
+void WinMTRCmd::RenderPrecision(std::string& out, WinMTRNet* net, WinMTRParams* params)
+{
+	char buf[256];
+	int len;
+
+	len = _snprintf(buf, sizeof(buf), "PRECISION: loss +-%.1f%%", params->precisionLoss);
+	if (params->precisionRtt > 0)
+		len += _snprintf(buf + len, sizeof(buf) - len, ", rtt +-%.1f ms", params->precisionRtt);
+	_snprintf(buf + len, sizeof(buf) - len, " at %.1f%%, %d of %d hops converged, %d probes\n",
+		params->confidence, net->GetConverged(), net->GetMax(), net->GetProbesSent());
+	out += buf;
+}
+
+//*****************************************************************************
+// WinMTRCmd::PrintPolice
+//
+//*****************************************************************************
+void WinMTRCmd::PrintPolice(FILE* file, WinMTRNet* net, WinMTRParams* params)
+{
+	std::string out;
+
+	RenderPolice(out, net, params);
+	fputs(out.c_str(), file);
+}
+
+//*****************************************************************************
+// WinMTRCmd::RenderPolice
+//
+// The hops whose ICMP is rate limited, with the probe interval they backed
+// off to.
+//*****************************************************************************
+void WinMTRCmd::RenderPolice(std::string& out, WinMTRNet* net, WinMTRParams* params)
+{
+	char buf[256];
+	int max = net->GetMax();
+	bool any = false;
+
+	for (int at = 0; at < max; at++) {
+		if (!net->GetPoliced(at))
+			continue;
+		int a = net->GetAddr(at);
+		_snprintf(buf, sizeof(buf),
+			"POLICED: hop %d, %d.%d.%d.%d, %.1f%% of %.1f%% loss rate limited, probed every %.1f s\n",
+			at + 1, (a >> 24) & 0xff, (a >> 16) & 0xff, (a >> 8) & 0xff, a & 0xff,
+			net->GetPolicedLoss(at), net->GetPercent(at),
+			params->interval * (1 << net->GetBackoff(at)));
+		out += buf;
+		any = true;
+	}
+	if (!any)
+		out += "POLICED: none\n";
+}
+
+//*****************************************************************************
+// WinMTRCmd::PrintTos
+//
+//*****************************************************************************
+void WinMTRCmd::PrintTos(FILE* file, WinMTRNet* net, WinMTRParams* params)
+{
+	std::string out;
+
+	RenderTos(out, net, params);
+	fputs(out.c_str(), file);
+}
+
+//*****************************************************************************
+// WinMTRCmd::RenderTos
+//
+// Loss, average and 95th percentile RTT of every TOS class side by side,
+// one line per hop.
+//*****************************************************************************
+void WinMTRCmd::RenderTos(std::string& out, WinMTRNet* net, WinMTRParams* params)
+{
+	s_tosstats t;
+	char buf[256], addr[16];
+	int len;
+	int max = net->GetMax();
+
+	len = _snprintf(buf, sizeof(buf), "%-20s", "TOS CLASSES");
+	for (int i = 0; i < params->tosCount; i++) {
+		_snprintf(addr, sizeof(addr), "0x%02x (DSCP %d)", params->tos[i], params->tos[i] >> 2);
+		len += _snprintf(buf + len, sizeof(buf) - len, " | %-23s", addr);
+	}
+	while (len > 0 && buf[len - 1] == ' ')
+		buf[--len] = 0;
+	out += buf;
+	out += "\n";
+	len = _snprintf(buf, sizeof(buf), "%-20s", "");
+	for (int i = 0; i < params->tosCount; i++)
+		len += _snprintf(buf + len, sizeof(buf) - len, " | %4s %6s %6s %4s", "Snt", "Loss%", "Avg", "P95");
+	out += buf;
+	out += "\n";
+
+	for (int at = 0; at < max; at++) {
+		int a = net->GetAddr(at);
+		if (a != 0)
+			_snprintf(addr, sizeof(addr), "%d.%d.%d.%d",
+				(a >> 24) & 0xff, (a >> 16) & 0xff, (a >> 8) & 0xff, a & 0xff);
+		else
+			strcpy(addr, "???");
+		len = _snprintf(buf, sizeof(buf), " %2d. %-15s", at + 1, addr);
+		for (int i = 0; i < params->tosCount; i++) {
+			net->GetTos(at, i, &t);
+			len += _snprintf(buf + len, sizeof(buf) - len, " | %4d %5.1f%% %6.1f %4d",
+				t.sent, t.loss, t.avg, t.p95);
+		}
+		out += buf;
+		out += "\n";
+	}
+}
+
+//*****************************************************************************
+// WinMTRCmd::PrintLockstep
+//
+//*****************************************************************************
+void WinMTRCmd::PrintLockstep(FILE* file, WinMTRNet* net)
+{
+	std::string out;
+
+	RenderLockstep(out, net);
+	fputs(out.c_str(), file);
+}
+
+//*****************************************************************************
+// WinMTRCmd::RenderLockstep
+//
+// Per hop the loss over the cycles shared by all hops, the loss while the
+// hop before answered, the correlation with the loss at the target and the
+// target losses that start at the hop, then the hop most of them start at.
+//*****************************************************************************
+void WinMTRCmd::RenderLockstep(std::string& out, WinMTRNet* net)
+{
+	s_lockhop hop[MAX_HOPS];
+	char buf[256], addr[16];
+	int max, targetLost, origin = -1;
+	int cycles = net->GetLockstep(hop, &max, &targetLost);
+
+	_snprintf(buf, sizeof(buf), "LOCKSTEP: %d cycles, %d lost at the target\n", cycles, targetLost);
+	out += buf;
+	if (cycles == 0)
+		return;
+	_snprintf(buf, sizeof(buf), "%-20s %6s %6s %6s %6s\n", "", "Loss%", "Cond%", "Corr", "Orig");
+	out += buf;
+
+	for (int at = 0; at < max; at++) {
+		int a = net->GetAddr(at);
+		if (a != 0)
+			_snprintf(addr, sizeof(addr), "%d.%d.%d.%d",
+				(a >> 24) & 0xff, (a >> 16) & 0xff, (a >> 8) & 0xff, a & 0xff);
+		else
+			strcpy(addr, "???");
+		if (hop[at].silent) {
+			_snprintf(buf, sizeof(buf), " %2d. %-15s no replies\n", at + 1, addr);
+		} else {
+			_snprintf(buf, sizeof(buf), " %2d. %-15s %5.1f%% %5.1f%% %6.2f %6d\n", at + 1, addr,
+				100.0f * hop[at].lost / hop[at].sent,
+				hop[at].condSent ? 100.0f * hop[at].cond / hop[at].condSent : 0.0f,
+				hop[at].corr, hop[at].origin);
+			if (hop[at].origin > 0 && (origin < 0 || hop[at].origin > hop[origin].origin))
+				origin = at;
+		}
+		out += buf;
+	}
+
+	if (origin < 0) {
+		out += "LOSS ORIGIN: none\n";
+		return;
+	}
+	int a = net->GetAddr(origin);
+	_snprintf(buf, sizeof(buf), "LOSS ORIGIN: hop %d, %d.%d.%d.%d, %d of %d target losses start there\n",
+		origin + 1, (a >> 24) & 0xff, (a >> 16) & 0xff, (a >> 8) & 0xff, a & 0xff,
+		hop[origin].origin, targetLost);
+	out += buf;
+}
+
+//*****************************************************************************
+// WinMTRCmd::Snapshot
+//
+// Hands a report to the writer if a snapshot is due, the final one always.
+// Rendering reuses the buffer the writer gave back on the previous submit.
+//*****************************************************************************
+void WinMTRCmd::Snapshot(WinMTRNet* net, WinMTRParams* params, bool final)
+{
+	int cycle = final ? net->GetXmitUnsafe(0) : net->GetXmit(0);
+	DWORD now = GetTickCount();
+	SYSTEMTIME st;
+	char buf[128];
+
+	if (!final) {
+		bool due = (params->snapshotSeconds > 0 &&
+				now - snapshotTick >= (DWORD)(params->snapshotSeconds * 1000)) ||
+			(params->snapshotCycles > 0 && cycle - snapshotCycle >= params->snapshotCycles);
+		if (!due)
+			return;
+	}
+	snapshotTick = now;
+	snapshotCycle = cycle;
+
+	GetLocalTime(&st);
+	_snprintf(buf, sizeof(buf), "%s %04d-%02d-%02d %02d:%02d:%02d cycle %d\n",
+		final ? "FINAL" : "SNAPSHOT", st.wYear, st.wMonth, st.wDay, st.wHour,
+		st.wMinute, st.wSecond, cycle);
+
+	LONGLONG start = WinMTRMetrics::Now();
+	snapshot = buf;
+	RenderReport(snapshot, net, final ? UnsafeGet : SafeGet, params->fields, params->wide);
+	if (params->multipath)
+		RenderMultipath(snapshot, net, params->confidence);
+	if (params->pmtu)
+		RenderMtu(snapshot, net);
+	if (params->capacity)
+		RenderCapacity(snapshot, net);
+	if (params->train)
+		RenderTrains(snapshot, net, params);
+	if (params->adaptive)
+		RenderPrecision(snapshot, net, params);
+	if (params->police)
+		RenderPolice(snapshot, net, params);
+	if (params->tosCount > 1)
+		RenderTos(snapshot, net, params);
+	if (params->lockstep)
+		RenderLockstep(snapshot, net);
+	if (final && params->range)
+		RenderRange(snapshot, net, params);
+	snapshot += "\n";
+	metrics.Add(METRIC_RENDER, start, WinMTRMetrics::Now());
+
+	writer->Submit(snapshot);
+}
+
+//*****************************************************************************
+// WinMTRCmd::PrintMetrics
+//
+// 
+//*****************************************************************************
+void WinMTRCmd::PrintMetrics(FILE* file, WinMTREngine* engine, WinMTRNet* net)
+{
+	WinMTRMetrics total;
+
+	total.Merge(metrics);
+	engine->GetMetrics(&total);
+	net->GetMetrics(&total);
+	total.Print(file);
+
+	if (writer)
+		fprintf(file, "SNAPSHOTS: %d written, %d replaced before written, worst write %lu ms\n",
+			writer->GetWritten(), writer->GetDropped(), writer->GetWorstWrite());
+
+	WinMTRSeries *series = net->GetSeries();
+	if (series) {
+		__int64 samples = series->GetSamples();
+		size_t bytes = series->GetBytes();
+		fprintf(file, "SERIES: %.0f samples, %.0f bytes encoded, %.1f bits per sample\n",
+			(double)samples, (double)bytes, samples ? 8.0 * bytes / samples : 0.0);
+	}
+
+	if (!results.empty()) {
+		size_t bytes = 0;
+		int wide = 0;
+		for (size_t i = 0; i < results.size(); i++) {
+			bytes += results[i]->GetBytes();
+			wide += results[i]->IsWide();
+		}
+		fprintf(file, "RESULTS: %d targets, %d wide, %.0f bytes per target,"
+			" %d addresses in %.0f bytes\n", (int)results.size(), wide,
+			(double)bytes / results.size(), intern.GetCount(), (double)intern.GetBytes());
+	}
+}
+
+//*****************************************************************************
+// WinMTRCmd::FormatEvent
+//
+// 
+//*****************************************************************************
+void WinMTRCmd::FormatEvent(char* buf, size_t size, const wmtr_event* event, WinMTRNet* net)
+{
+	static const char *kinds[] = { "", "rtt up", "rtt down", "loss up", "loss down" };
+	char name[256];
+	char responder[16];
+	ULARGE_INTEGER t;
+	FILETIME ft, lft;
+	SYSTEMTIME st;
+
+	t.QuadPart = (event->time + 11644473600000ULL) * 10000;
+	ft.dwLowDateTime = t.LowPart;
+	ft.dwHighDateTime = t.HighPart;
+	FileTimeToLocalFileTime(&ft, &lft);
+	FileTimeToSystemTime(&lft, &st);
+
+	net->GetName(event->ttl - 1, name);
+	int len = _snprintf(buf, size, "%04d-%02d-%02d %02d:%02d:%02d.%03d %2d. %s ",
+		st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond, st.wMilliseconds,
+		event->ttl, name);
+	if (event->kind == WMTR_EVENT_NEW_RESPONDER) {
+		int addr = ntohl(event->responder);
+		sprintf(responder, "%d.%d.%d.%d", (addr >> 24) & 0xff, (addr >> 16) & 0xff,
+			(addr >> 8) & 0xff, addr & 0xff);
+		_snprintf(buf + len, size - len, "new responder %s, %d responders",
+			responder, (int)event->after);
+	} else {
+		_snprintf(buf + len, size - len, "%s %.1f -> %.1f %s",
+			kinds[event->kind], event->before, event->after,
+			(event->kind <= WMTR_EVENT_RTT_DOWN) ? "ms" : "%");
+	}
+	buf[size - 1] = 0;
+}
+
+//*****************************************************************************
+// EventCallback
+//
+// Runs on the engine worker that detected the event. A server job gets its
+// events as '<id> EVENT ...' lines in its stream, like the probe lines.
+//*****************************************************************************
+void EventCallback(const wmtr_event *event, void *context)
+{
+	event_sink *sink = (event_sink*)context;
+	WinMTRCmd *cmd = sink->cmd;
+	char line[512];
+
+	cmd->FormatEvent(line, sizeof(line), event, sink->net);
+
+	if (sink->stream) {
+		job_stream *stream = sink->stream;
+		EnterCriticalSection(&stream->lock);
+		stream->pending += stream->id;
+		stream->pending += " EVENT ";
+		stream->pending += line;
+		stream->pending += '\n';
+		LeaveCriticalSection(&stream->lock);
+	} else {
+		EnterCriticalSection(&cmd->outputLock);
+		if (sink->log) {
+			cmd->eventLog.push_back(line);
+			if (cmd->eventLog.size() > EVENTS_SHOWN)
+				cmd->eventLog.pop_front();
+		} else {
+			fprintf(stderr, "EVENT %s\n", line);
+		}
+		LeaveCriticalSection(&cmd->outputLock);
+	}
+
+	if (sink->stop)
+		sink->net->StopTrace();
+}
+
+//*****************************************************************************
+// server_job
+//
+// One trace requested in server mode.
+//*****************************************************************************
+struct server_job {
+	WinMTRCmd		*cmd;
+	WinMTREngine	*engine;
+	WinMTRParams	params;
+	char			id[64];
+	int				seq;		// trace jobs are numbered, a fleet summary waits for those before it
+	int				top;		// list length of a fleet summary
+};
+
+//*****************************************************************************
+// ProbeCallback
+//
+// Adds '<id> PROBE <ttl> <cycle> <responder> <rtt>' for every probe of a
+// server job, '*' for what a lost probe does not have.
+//*****************************************************************************
+void ProbeCallback(const wmtr_probe_result *result, void *context)
+{
+	job_stream *stream = (job_stream*)context;
+	char line[160];
+	unsigned long a = ntohl(result->responder);
+
+	// the first round goes to every TTL, those beyond the target are not reported
+	if (result->ttl > stream->net->GetMaxUnsafe())
+		return;
+
+	if (result->responder == 0)
+		_snprintf(line, sizeof(line), "%s PROBE %d %d * *\n", stream->id,
+			result->ttl, result->cycle);
+	else if (result->status != IP_SUCCESS && result->status != IP_TTL_EXPIRED_TRANSIT)
+		_snprintf(line, sizeof(line), "%s PROBE %d %d %lu.%lu.%lu.%lu *\n", stream->id,
+			result->ttl, result->cycle, (a >> 24) & 0xff, (a >> 16) & 0xff, (a >> 8) & 0xff, a & 0xff);
+	else
+		_snprintf(line, sizeof(line), "%s PROBE %d %d %lu.%lu.%lu.%lu %lu\n", stream->id,
+			result->ttl, result->cycle, (a >> 24) & 0xff, (a >> 16) & 0xff, (a >> 8) & 0xff, a & 0xff,
+			result->rtt);
+	line[sizeof(line) - 1] = 0;
+
+	EnterCriticalSection(&stream->lock);
+	stream->pending += line;
+	LeaveCriticalSection(&stream->lock);
+}
+
+//*****************************************************************************
+// WinMTRCmd::FlushStream
+//
+// Writes the probe and event lines of a server job added since the last
+// call.
+//*****************************************************************************
+void WinMTRCmd::FlushStream(job_stream* stream)
+{
+	std::string lines;
+
+	EnterCriticalSection(&stream->lock);
+	lines.swap(stream->pending);
+	LeaveCriticalSection(&stream->lock);
+	if (lines.empty())
+		return;
+
+	EnterCriticalSection(&outputLock);
+	fputs(lines.c_str(), stdout);
+	fflush(stdout);
+	LeaveCriticalSection(&outputLock);
+}
+
+//*****************************************************************************
+// WinMTRCmd::WriteStats
+//
+// Writes the mergeable statistics of the finished trace of net.
+//*****************************************************************************
+bool WinMTRCmd::WriteStats(WinMTRNet* net, const char* hostname, const char* file,
+	unsigned __int64 start)
+{
+	WinMTRStats *stats = new WinMTRStats;
+
+	stats->Collect(net, hostname, start, WinMTRStats::Now());
+	bool ok = stats->Write(file);
+	delete stats;
+	return ok;
+}
+
+//*****************************************************************************
+// WinMTRCmd::RunMerge
+//
+// Merges the statistics files matching params->merge and prints the report
+// of the combined record, which is also written to params->statsfile if
+// given. Files that cannot be read or belong to another target are skipped
+// and make the exit code 1.
+//*****************************************************************************
+int WinMTRCmd::RunMerge(WinMTRParams* params)
+{
+	WIN32_FIND_DATA fd;
+	WinMTRStats *total = new WinMTRStats;
+	WinMTRStats *part = new WinMTRStats;
+	std::string dir = params->merge;
+	int files = 0, failed = 0;
+	FILE *file;
+
+	size_t slash = dir.find_last_of("\\/:");
+	dir = (slash == std::string::npos) ? "" : dir.substr(0, slash + 1);
+
+	HANDLE hFind = FindFirstFile(params->merge, &fd);
+	if (hFind != INVALID_HANDLE_VALUE) {
+		do {
+			if (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+				continue;
+			std::string path = dir + fd.cFileName;
+			if (!part->Read(path.c_str())) {
+				failed++;
+			} else if (!total->Merge(part)) {
+				fprintf(stderr, "error: '%s' holds statistics of '%s', not '%s'\n",
+					path.c_str(), part->header.hostname, total->header.hostname);
+				failed++;
+			} else {
+				files++;
+			}
+		} while (FindNextFile(hFind, &fd));
+		FindClose(hFind);
+	}
+
+	if (files == 0) {
+		fprintf(stderr, "error: no statistics files match '%s'\n", params->merge);
+		delete part;
+		delete total;
+		return 1;
+	}
+
+	WinMTRNet *net = new WinMTRNet(params, NULL);
+	total->Apply(net);
+
+	file = stdout;
+	if (params->reportToFile) {
+		file = fopen(params->filename, "w");
+		if (file == NULL) {
+			fprintf(stderr, "error: could not redirect report to '%s': %s\n",
+				params->filename, strerror(errno));
+			file = stdout;
+		}
+	}
+	fprintf(file, "MERGED: %s, %d files, %d runs\n", total->header.hostname,
+		files, total->header.runs);
+	PrintReport(file, net, UnsafeGet, params->fields, params->wide);
+	if (file != stdout)
+		fclose(file);
+
+	if (params->statsfile[0] && !total->Write(params->statsfile))
+		failed++;
+
+	delete net;
+	delete part;
+	delete total;
+	return failed ? 1 : 0;
+}
+
+//*****************************************************************************
+// WinMTRCmd::RunServer
+//
+// Reads one job per line from stdin until EOF:
+//
+//     <id> <hostname> [cycles=COUNT] [interval=SECONDS] [size=BYTES]
+//                     [timeout=SECONDS] [order=FIELDS] [wide] [numeric]
+//                     [detect] [multipath] [confidence=PERCENT]
+//                     [stats=PATH]
+//     <id> * [top=COUNT]
+//
+// Jobs run concurrently on the resident engine. Every output line is
+// prefixed with the job id, a job ends with '<id> END' or '<id> ERROR ...'.
+// Every probe is written as '<id> PROBE ...' and detected events as
+// '<id> EVENT ...' while the job runs, the report follows at its end. The
+// hostname '*' prints the fleet summary of all finished jobs once the jobs
+// read before it are done, on its own thread, so later jobs still start.
+//*****************************************************************************
+void WinMTRCmd::RunServer(WinMTRParams* defaults, WinMTREngine* engine)
+{
+	char line[1024];
+
+	while (fgets(line, sizeof(line), stdin)) {
+		server_job *job = new server_job;
+		job->cmd = this;
+		job->engine = engine;
+		job->params = *defaults;
+		job->top = FLEET_TOP;
+
+		if (!ParseJob(line, job)) {
+			delete job;
+			continue;
+		}
+
+		bool fleet = !strcmp(job->params.hostname, "*");
+		job->seq = fleet ? jobSeq : jobSeq++;
+		if (!fleet) {
+			EnterCriticalSection(&outputLock);
+			running.insert(job->seq);
+			LeaveCriticalSection(&outputLock);
+		}
+
+		if (InterlockedIncrement(&runningJobs) == 1)
+			ResetEvent(hJobsDone);
+		if (_beginthread(fleet ? FleetThread : JobThread, 0, job) == -1L) {
+			EnterCriticalSection(&outputLock);
+			if (!fleet)
+				running.erase(job->seq);
+			printf("%s ERROR could not start the job\n", job->id);
+			fflush(stdout);
+			LeaveCriticalSection(&outputLock);
+			delete job;
+			if (InterlockedDecrement(&runningJobs) == 0)
+				SetEvent(hJobsDone);
+		}
+	}
+
+	WaitForSingleObject(hJobsDone, INFINITE);
+}
+
+//*****************************************************************************
+// WinMTRCmd::JobsDoneBefore
+//
+// True if every trace job numbered below seq has finished.
+//*****************************************************************************
+bool WinMTRCmd::JobsDoneBefore(int seq)
+{
+	EnterCriticalSection(&outputLock);
+	bool done = running.empty() || *running.begin() >= seq;
+	LeaveCriticalSection(&outputLock);
+	return done;
+}
+
+//*****************************************************************************
+// WinMTRCmd::PrintFleet
+//
+// The summary over the results of all finished jobs. Only the results are
+// read under outputLock, the lines are written after it in one go, which
+// the lock of stdout keeps whole.
+//*****************************************************************************
+void WinMTRCmd::PrintFleet(const char* id, int top)
+{
+	WinMTRFleet fleet;
+	s_widehop hop[MAX_HOPS];
+	std::string report, lines;
+
+	EnterCriticalSection(&outputLock);
+	LONGLONG start = WinMTRMetrics::Now();
+	for (size_t i = 0; i < results.size(); i++) {
+		results[i]->Decode(hop);
+		fleet.Add(results[i]->GetTarget(), hop, results[i]->GetHops());
+	}
+	LeaveCriticalSection(&outputLock);
+	fleet.Render(report, &intern, top);
+
+	for (size_t pos = 0; pos < report.size(); ) {
+		size_t eol = report.find('\n', pos);
+		lines += id;
+		lines += ' ';
+		lines.append(report, pos, eol - pos);
+		lines += '\n';
+		pos = eol + 1;
+	}
+	lines += id;
+	lines += " END\n";
+
+	EnterCriticalSection(&outputLock);
+	metrics.Add(METRIC_RENDER, start, WinMTRMetrics::Now());
+	LeaveCriticalSection(&outputLock);
+	fputs(lines.c_str(), stdout);
+	fflush(stdout);
+}
+
+//*****************************************************************************
+// WinMTRCmd::ParseJob
+//
+// 
+//*****************************************************************************
+bool WinMTRCmd::ParseJob(char* line, server_job* job)
+{
+	char *token, *value;
+	char *context = line;
+	WinMTRParams *params = &job->params;
+
+	token = strtok(context, " \t\r\n");
+	if (token == NULL)
+		return false;
+	_snprintf(job->id, sizeof(job->id), "%s", token);
+	job->id[sizeof(job->id) - 1] = 0;
+
+	token = strtok(NULL, " \t\r\n");
+	if (token == NULL) {
+		EnterCriticalSection(&outputLock);
+		printf("%s ERROR no hostname specified\n", job->id);
+		fflush(stdout);
+		LeaveCriticalSection(&outputLock);
+		return false;
+	}
+	params->SetHostName(token);
+
+	while ((token = strtok(NULL, " \t\r\n")) != NULL) {
+		value = strchr(token, '=');
+		if (value)
+			*value++ = 0;
+
+		if (!strcmp(token, "wide"))
+			params->SetWide(true);
+		else if (!strcmp(token, "detect"))
+			params->SetDetect(true);
+		else if (!strcmp(token, "multipath"))
+			params->SetMultipath(true);
+		else if (value && !strcmp(token, "confidence"))
+			params->SetConfidence((float)atof(value));
+		else if (value && !strcmp(token, "stats"))
+			params->SetStatsFile(value);
+		else if (value && !strcmp(token, "top"))
+			job->top = atoi(value);
+		else if (!strcmp(token, "numeric"))
+			params->SetUseDNS(false);
+		else if (value && !strcmp(token, "cycles"))
+			params->SetCycles(atoi(value));
+		else if (value && !strcmp(token, "interval"))
+			params->SetInterval((float)atof(value));
+		else if (value && !strcmp(token, "size"))
+			params->SetPingSize(atoi(value));
+		else if (value && !strcmp(token, "timeout"))
+			params->SetTimeout((float)atof(value));
+		else if (value && !strcmp(token, "order"))
+			params->SetFields(value);
+		else {
+			EnterCriticalSection(&outputLock);
+			printf("%s ERROR unknown job parameter '%s'\n", job->id, token);
+			fflush(stdout);
+			LeaveCriticalSection(&outputLock);
+			return false;
+		}
+	}
+
+	if (params->pingsize < MINPACKET || params->pingsize > MAXPACKET) {
+		EnterCriticalSection(&outputLock);
+		printf("%s ERROR size has to be in the range [%d, %d]\n", job->id, MINPACKET, MAXPACKET);
+		fflush(stdout);
+		LeaveCriticalSection(&outputLock);
+		return false;
+	}
+
+	if (params->cycles < 1) {
+		EnterCriticalSection(&outputLock);
+		printf("%s ERROR cycles has to be positive\n", job->id);
+		fflush(stdout);
+		LeaveCriticalSection(&outputLock);
+		return false;
+	}
+
+	if (!(params->interval >= 0 && params->interval <= MAX_SECONDS)) {
+		EnterCriticalSection(&outputLock);
+		printf("%s ERROR interval has to be in the range [0, %d]\n", job->id, MAX_SECONDS);
+		fflush(stdout);
+		LeaveCriticalSection(&outputLock);
+		return false;
+	}
+
+	if (params->lockstep && params->interval <= 0) {
+		EnterCriticalSection(&outputLock);
+		printf("%s ERROR lockstep needs a positive interval\n", job->id);
+		fflush(stdout);
+		LeaveCriticalSection(&outputLock);
+		return false;
+	}
+
+	if (!(params->timeout > 0 && params->timeout <= MAX_SECONDS)) {
+		EnterCriticalSection(&outputLock);
+		printf("%s ERROR timeout has to be in the range (0, %d]\n", job->id, MAX_SECONDS);
+		fflush(stdout);
+		LeaveCriticalSection(&outputLock);
+		return false;
+	}
+	// as ValidateParams does it, the job may have a shorter interval
+	if (params->lockstep && params->timeout > params->interval)
+		params->SetTimeout(params->interval);
+
+	if (job->top < 1) {
+		EnterCriticalSection(&outputLock);
+		printf("%s ERROR top has to be positive\n", job->id);
+		fflush(stdout);
+		LeaveCriticalSection(&outputLock);
+		return false;
+	}
+
+	if (params->confidence < 50.0f || params->confidence > 99.9f) {
+		EnterCriticalSection(&outputLock);
+		printf("%s ERROR confidence has to be in the range [50, 99.9]\n", job->id);
+		fflush(stdout);
+		LeaveCriticalSection(&outputLock);
+		return false;
+	}
+
+	return true;
+}
+
+//*****************************************************************************
+// JobThread
+//
+// 
+//*****************************************************************************
+void JobThread(void *p)
+{
+	server_job *job = (server_job*)p;
+	WinMTRCmd *cmd = job->cmd;
+	std::string report;
+
+	int addr = cmd->GetCachedAddr(job->params.hostname);
+	if (addr == INADDR_NONE) {
+		EnterCriticalSection(&cmd->outputLock);
+		printf("%s ERROR could not resolve hostname\n", job->id);
+		fflush(stdout);
+		LeaveCriticalSection(&cmd->outputLock);
+	} else {
+		WinMTRNet net(&job->params, job->engine);
+		event_sink sink;
+		job_stream stream;
+		stream.id = job->id;
+		stream.net = &net;
+		InitializeCriticalSection(&stream.lock);
+		net.SetProbeCallback(ProbeCallback, &stream);
+		if (job->params.detect) {
+			sink.cmd = cmd;
+			sink.net = &net;
+			sink.stream = &stream;
+			sink.log = false;
+			sink.stop = job->params.detectStop;
+			net.SetEventCallback(EventCallback, &sink);
+		}
+		unsigned __int64 started = WinMTRStats::Now();
+		net.DoTrace(addr, true);
+		while (!net.WaitTrace(STREAM_POLL))
+			cmd->FlushStream(&stream);
+		cmd->FlushStream(&stream);
+		DeleteCriticalSection(&stream.lock);
+		bool written = !job->params.statsfile[0]
+			|| cmd->WriteStats(&net, job->params.hostname, job->params.statsfile, started);
+
+		LONGLONG start = WinMTRMetrics::Now();
+		cmd->RenderReport(report, &net, WinMTRCmd::UnsafeGet, job->params.fields,
+			job->params.wide);
+		if (job->params.multipath)
+			cmd->RenderMultipath(report, &net, job->params.confidence);
+
+		WinMTRCompact *result = new WinMTRCompact(&cmd->intern);
+		result->Store(&net);
+
+		EnterCriticalSection(&cmd->outputLock);
+		if (cmd->results.size() == MAX_RESULTS) {
+			delete cmd->results.front();
+			cmd->results.pop_front();
+		}
+		cmd->results.push_back(result);
+		cmd->metrics.Add(METRIC_RENDER, start, WinMTRMetrics::Now());
+		for (size_t pos = 0; pos < report.size(); ) {
+			size_t eol = report.find('\n', pos);
+			printf("%s %s\n", job->id, report.substr(pos, eol - pos).c_str());
+			pos = eol + 1;
+		}
+		if (job->params.metrics)
+			cmd->PrintMetrics(stdout, job->engine, &net);
+		if (written)
+			printf("%s END\n", job->id);
+		else
+			printf("%s ERROR could not write statistics\n", job->id);
+		fflush(stdout);
+		LeaveCriticalSection(&cmd->outputLock);
+	}
+
+	EnterCriticalSection(&cmd->outputLock);
+	cmd->running.erase(job->seq);
+	LeaveCriticalSection(&cmd->outputLock);
+
+	delete job;
+	if (InterlockedDecrement(&cmd->runningJobs) == 0)
+		SetEvent(cmd->hJobsDone);
+}
+
+//*****************************************************************************
+// FleetThread
+//
+// Waits for the trace jobs read before the summary line, the stdin loop
+// keeps starting new ones meanwhile.
+//*****************************************************************************
+void FleetThread(void *p)
+{
+	server_job *job = (server_job*)p;
+	WinMTRCmd *cmd = job->cmd;
+
+	while (!cmd->JobsDoneBefore(job->seq))
+		Sleep(STREAM_POLL);
+	cmd->PrintFleet(job->id, job->top);
+
+	delete job;
+	if (InterlockedDecrement(&cmd->runningJobs) == 0)
+		SetEvent(cmd->hJobsDone);
+}
+
+//*****************************************************************************
+// WinMTRCmd::GetCachedAddr
+//
+// GetAddr with the results kept for later jobs.
+//*****************************************************************************
+int WinMTRCmd::GetCachedAddr(char* s)
+{
+	std::map<std::string, int>::iterator it;
+	int addr;
+
+	EnterCriticalSection(&cacheLock);
+	it = addrCache.find(s);
+	addr = (it == addrCache.end()) ? INADDR_NONE : it->second;
+	LeaveCriticalSection(&cacheLock);
+	if (addr != INADDR_NONE)
+		return addr;
+
+	addr = GetAddr(s);
+	if (addr != INADDR_NONE) {
+		EnterCriticalSection(&cacheLock);
+		addrCache[s] = addr;
+		LeaveCriticalSection(&cacheLock);
+	}
+	return addr;
+}
+
+//*****************************************************************************
+// WinMTRCmd::GetAddr
+//
+// 
+//*****************************************************************************
+int WinMTRCmd::GetAddr(char* s)
+{
+	return WinMTRNet::ResolveAddr(s);
 }
 
 //*****************************************************************************
@@ -483,5 +2146,23 @@ WinMTRCmd::fields WinMTRCmd::dataFields[] = {
 			NETM(GetJWorst), NETM(GetJWorstUnsafe) },
 		{'I', "I:    Interarrival Jitter", "Jint",   " %4d",     5, false,
 			NETM(GetJInta), NETM(GetJIntaUnsafe) },
+		{'P', "P:    95th Percentile(ms)", "P95",    " %4d",     5, false,
+			NETM(GetP95), NETM(GetP95Unsafe) },
+		{'U', "U:    Path MTU(bytes)",     "MTU",    " %5d",     6, false,
+			NETM(GetMtu), NETM(GetMtuUnsafe) },
+		{'K', "K:    Link Capacity(Mbit/s)", "Mbps", " %7.1f",  8, true,
+			NETM(GetCapacity), NETM(GetCapacityUnsafe) },
+		{'T', "T:    Timeout(ms)",         "RTO",    " %5d",     6, false,
+			NETM(GetRto), NETM(GetRtoUnsafe) },
+		{'E', "E:    Late Replies",        "Late",   " %4d",     5, false,
+			NETM(GetLate), NETM(GetLateUnsafe) },
+		{'H', "H:    Duplicates(simulator)", "Dup",    " %4d",     5, false,
+			NETM(GetDuplicates), NETM(GetDuplicatesUnsafe) },
+		{'O', "O:    Reordered Replies",   "Reord",  " %5d",     6, false,
+			NETM(GetReordered), NETM(GetReorderedUnsafe) },
+		{'F', "F:    Forwarding Loss",     "Fwd%",   " %5.1f%%", 7, true,
+			NETM(GetForwardLoss), NETM(GetForwardLossUnsafe) },
+		{'Q', "Q:    Policed Loss",        "Pol%",   " %5.1f%%", 7, true,
+			NETM(GetPolicedLoss), NETM(GetPolicedLossUnsafe) },
 		{'\0', NULL, NULL, NULL, 0, false, NULL, NULL}
 	};
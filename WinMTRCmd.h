@@ -18,8 +18,24 @@
 #define WINMTRCMD_H_
 
 #include "WinMTRGlobal.h"
+#include "WinMTRCompact.h"
+#include "WinMTREngine.h"
+#include "WinMTRMetrics.h"
 #include "WinMTRNet.h"
 #include "WinMTRParams.h"
+#include "WinMTRWriter.h"
+#include <deque>
+#include <map>
+#include <set>
+#include <vector>
+
+#define EXIT_EVENTS		2		// --detect saw at least one event
+#define EVENTS_SHOWN	5		// events kept below the interactive report
+#define STREAM_POLL		100		// ms between writes of the probe lines of a server job
+#define MAX_RESULTS		65536	// finished server jobs kept, the oldest is dropped first
+
+struct server_job;
+struct job_stream;
 
 //*****************************************************************************
 // CLASS:  WinMTRCmd
@@ -28,11 +44,15 @@
 //*****************************************************************************
 
 class WinMTRCmd {
+	friend void JobThread(void *p);
+	friend void FleetThread(void *p);
+	friend void EventCallback(const wmtr_event *event, void *context);
 
 public:
 	WinMTRCmd(_TCHAR *name);
+	~WinMTRCmd();
 
-	void	Run();
+	int		Run();
 
 private:
 	typedef void* (WinMTRNet::*VoidGetMethod)(int at);
@@ -60,7 +80,42 @@ private:
 
 	void	PrintReport(FILE* file, WinMTRNet* net, int getType, 
 		const char* fields, bool reportWide);
+	void	RenderReport(std::string& out, WinMTRNet* net, int getType,
+		const char* fields, bool reportWide);
+	void	RenderResponders(std::string& out, WinMTRNet* net, int at, int len_hosts,
+		bool reportWide);
+	void	PrintMultipath(FILE* file, WinMTRNet* net, float confidence);
+	void	RenderMultipath(std::string& out, WinMTRNet* net, float confidence);
+	void	PrintRange(FILE* file, WinMTRNet* net, WinMTRParams* params);
+	void	RenderRange(std::string& out, WinMTRNet* net, WinMTRParams* params);
+	void	PrintMtu(FILE* file, WinMTRNet* net);
+	void	RenderMtu(std::string& out, WinMTRNet* net);
+	void	PrintCapacity(FILE* file, WinMTRNet* net);
+	void	RenderCapacity(std::string& out, WinMTRNet* net);
+	void	PrintTrains(FILE* file, WinMTRNet* net, WinMTRParams* params);
+	void	RenderTrains(std::string& out, WinMTRNet* net, WinMTRParams* params);
+	void	PrintPrecision(FILE* file, WinMTRNet* net, WinMTRParams* params);
+	void	RenderPrecision(std::string& out, WinMTRNet* net, WinMTRParams* params);
+	void	PrintPolice(FILE* file, WinMTRNet* net, WinMTRParams* params);
+	void	RenderPolice(std::string& out, WinMTRNet* net, WinMTRParams* params);
+	void	PrintTos(FILE* file, WinMTRNet* net, WinMTRParams* params);
+	void	RenderTos(std::string& out, WinMTRNet* net, WinMTRParams* params);
+	void	PrintLockstep(FILE* file, WinMTRNet* net);
+	void	RenderLockstep(std::string& out, WinMTRNet* net);
+	void	Snapshot(WinMTRNet* net, WinMTRParams* params, bool final);
+	void	PrintMetrics(FILE* file, WinMTREngine* engine, WinMTRNet* net);
+	void	FormatEvent(char* buf, size_t size, const wmtr_event* event, WinMTRNet* net);
 	int		GetAddr(char* s);
+	int		GetCachedAddr(char* s);
+
+	int		RunMerge(WinMTRParams* params);
+	bool	WriteStats(WinMTRNet* net, const char* hostname, const char* file,
+		unsigned __int64 start);
+	void	RunServer(WinMTRParams* defaults, WinMTREngine* engine);
+	void	PrintFleet(const char* id, int top);
+	bool	JobsDoneBefore(int seq);
+	bool	ParseJob(char* line, server_job* job);
+	void	FlushStream(job_stream* stream);
 
 private:
 	_TCHAR *programName;
@@ -69,6 +124,25 @@ private:
 
 	static fields	dataFields[];
 	int				indexMapping[256];
+	WinMTRMetrics	metrics;		// render timings, guarded by outputLock in server mode
+	std::deque<std::string> eventLog;	// interactive mode, guarded by outputLock
+
+	// --snapshot
+	WinMTRWriter	*writer;
+	std::string		snapshot;		// swapped with the writer's buffer on submit
+	DWORD			snapshotTick;
+	int				snapshotCycle;
+
+	// server mode
+	CRITICAL_SECTION	outputLock;
+	CRITICAL_SECTION	cacheLock;
+	std::map<std::string, int> addrCache;
+	WinMTRIntern		intern;
+	std::deque<WinMTRCompact*> results;	// finished jobs, guarded by outputLock
+	std::set<int>		running;	// seq of the running trace jobs, guarded by outputLock
+	int					jobSeq;
+	volatile LONG		runningJobs;	// trace jobs and fleet summaries
+	HANDLE				hJobsDone;
 };
 
 #endif	// ifndef WINMTRCMD_H_
\ No newline at end of file
@@ -0,0 +1,299 @@
+//*****************************************************************************
+// FILE:            WinMTRCompact.cpp
+//
+//
+//*****************************************************************************
+
+#include "WinMTRCompact.h"
+
+//*****************************************************************************
+// WinMTRIntern::WinMTRIntern
+//
+// Index 0 stands for the address 0.
+//*****************************************************************************
+WinMTRIntern::WinMTRIntern()
+{
+	InitializeCriticalSection(&lock);
+	addrs.push_back(0);
+	names.push_back(0);
+}
+
+//*****************************************************************************
+// WinMTRIntern::~WinMTRIntern
+//
+//*****************************************************************************
+WinMTRIntern::~WinMTRIntern()
+{
+	DeleteCriticalSection(&lock);
+}
+
+//*****************************************************************************
+// WinMTRIntern::Add
+//
+//*****************************************************************************
+unsigned int WinMTRIntern::Add(__int32 addr, const char *name)
+{
+	unsigned int i;
+
+	if (addr == 0)
+		return 0;
+
+	EnterCriticalSection(&lock);
+	std::map<__int32, unsigned int>::iterator it = index.find(addr);
+	if (it == index.end()) {
+		i = (unsigned int)addrs.size();
+		index[addr] = i;
+		addrs.push_back(addr);
+		names.push_back(0);
+	} else {
+		i = it->second;
+	}
+	if (names[i] == 0 && name && name[0]) {
+		names[i] = (unsigned int)pool.size() + 1;
+		pool.append(name, strlen(name) + 1);
+	}
+	LeaveCriticalSection(&lock);
+	return i;
+}
+
+//*****************************************************************************
+// WinMTRIntern::GetName
+//
+// Returns false if there is no name for addr.
+//*****************************************************************************
+bool WinMTRIntern::GetName(__int32 addr, char *name, size_t size)
+{
+	bool ret = false;
+
+	EnterCriticalSection(&lock);
+	std::map<__int32, unsigned int>::iterator it = index.find(addr);
+	if (it != index.end() && names[it->second]) {
+		_snprintf(name, size, "%s", pool.c_str() + names[it->second] - 1);
+		name[size - 1] = 0;
+		ret = true;
+	}
+	LeaveCriticalSection(&lock);
+	return ret;
+}
+
+//*****************************************************************************
+// WinMTRIntern::GetCount
+//
+//*****************************************************************************
+int WinMTRIntern::GetCount()
+{
+	EnterCriticalSection(&lock);
+	int ret = (int)addrs.size() - 1;
+	LeaveCriticalSection(&lock);
+	return ret;
+}
+
+//*****************************************************************************
+// WinMTRIntern::GetBytes
+//
+// Estimated, a map node is taken as four pointer sized words over the key
+// and value.
+//*****************************************************************************
+size_t WinMTRIntern::GetBytes()
+{
+	EnterCriticalSection(&lock);
+	size_t ret = sizeof(*this)
+		+ addrs.capacity() * sizeof(__int32)
+		+ names.capacity() * sizeof(unsigned int)
+		+ pool.capacity()
+		+ index.size() * (4 * sizeof(void*) + sizeof(__int32) + sizeof(unsigned int));
+	LeaveCriticalSection(&lock);
+	return ret;
+}
+
+//*****************************************************************************
+// WinMTRCompact::WinMTRCompact
+//
+//*****************************************************************************
+WinMTRCompact::WinMTRCompact(WinMTRIntern *table)
+	: intern(table), target(0), hops(0), wide(false)
+{
+	data.narrow = NULL;
+}
+
+//*****************************************************************************
+// WinMTRCompact::~WinMTRCompact
+//
+//*****************************************************************************
+WinMTRCompact::~WinMTRCompact()
+{
+	if (wide)
+		delete [] data.full;
+	else
+		delete [] data.narrow;
+}
+
+//*****************************************************************************
+// WinMTRCompact::Store
+//
+// Replaces what was stored before. The narrow layout is used if every hop
+// fits, otherwise the wide one.
+//*****************************************************************************
+void WinMTRCompact::Store(WinMTRNet *net)
+{
+	s_widehop hop[MAX_HOPS];
+	unsigned int idx[MAX_HOPS];
+	bool fits = true;
+
+	if (wide)
+		delete [] data.full;
+	else
+		delete [] data.narrow;
+
+	target = net->last_remote_addr;
+	hops = (unsigned char)net->GetMaxUnsafe();
+
+	for (int at = 0; at < hops; at++) {
+		s_widehop *h = &hop[at];
+
+		h->addr = net->host[at].addr;
+		h->xmit = net->host[at].xmit;
+		h->returned = net->host[at].returned;
+		h->last = net->host[at].last;
+		h->best = net->host[at].best;
+		h->worst = net->host[at].worst;
+		h->jitter = net->host[at].jitter;
+		h->jworst = net->host[at].jworst;
+		h->jinta = net->host[at].jinta;
+		h->p95 = net->GetP95Unsafe(at);
+		h->avg = net->host[at].avg;
+		h->stdev = net->GetStDevUnsafe(at);
+		h->gmean = net->host[at].gmean;
+		h->javg = net->host[at].javg;
+
+		// the index of the target is not needed, its name is
+		idx[at] = intern->Add(h->addr, net->host[at].name);
+		if (h->addr == target && target != 0)
+			idx[at] = COMPACT_TARGET;
+		else if (idx[at] >= COMPACT_TARGET)
+			idx[at] = COMPACT_MAX + 1;
+
+		if (!Fits(h, idx[at]))
+			fits = false;
+	}
+
+	wide = !fits;
+	if (wide) {
+		data.full = new s_widehop[hops];
+		memcpy(data.full, hop, hops * sizeof(s_widehop));
+		return;
+	}
+
+	data.narrow = new s_compacthop[hops];
+	for (int at = 0; at < hops; at++) {
+		s_widehop *h = &hop[at];
+		s_compacthop *c = &data.narrow[at];
+
+		c->addr = (unsigned short)idx[at];
+		c->xmit = (unsigned short)h->xmit;
+		c->returned = (unsigned short)h->returned;
+		c->last = (unsigned short)h->last;
+		c->best = (unsigned short)h->best;
+		c->worst = (unsigned short)h->worst;
+		c->jitter = (unsigned short)h->jitter;
+		c->jworst = (unsigned short)h->jworst;
+		c->jinta = (unsigned short)h->jinta;
+		c->p95 = (unsigned short)h->p95;
+		c->avg = (unsigned short)(h->avg * COMPACT_RTT_SCALE + 0.5f);
+		c->stdev = (unsigned short)(h->stdev * COMPACT_RTT_SCALE + 0.5f);
+		c->gmean = (unsigned short)(h->gmean * COMPACT_RTT_SCALE + 0.5f);
+		c->javg = (unsigned short)(h->javg * COMPACT_RTT_SCALE + 0.5f);
+	}
+}
+
+//*****************************************************************************
+// WinMTRCompact::Fits
+//
+//*****************************************************************************
+bool WinMTRCompact::Fits(const s_widehop *hop, unsigned int index)
+{
+	const int ints[] = { hop->xmit, hop->returned, hop->last, hop->best, hop->worst,
+		hop->jitter, hop->jworst, hop->jinta, hop->p95 };
+	const float floats[] = { hop->avg, hop->stdev, hop->gmean, hop->javg };
+
+	if (index > COMPACT_MAX)
+		return false;
+	for (int i = 0; i < sizeof(ints) / sizeof(ints[0]); i++)
+		if (ints[i] < 0 || ints[i] > COMPACT_MAX)
+			return false;
+	for (int i = 0; i < sizeof(floats) / sizeof(floats[0]); i++)
+		if (!(floats[i] >= 0) || floats[i] * COMPACT_RTT_SCALE + 0.5f >= COMPACT_MAX + 1)
+			return false;
+	return true;
+}
+
+//*****************************************************************************
+// WinMTRCompact::Decode
+//
+//*****************************************************************************
+void WinMTRCompact::Decode(s_widehop *hop)
+{
+	if (wide) {
+		memcpy(hop, data.full, hops * sizeof(s_widehop));
+		return;
+	}
+
+	EnterCriticalSection(&intern->lock);
+	for (int at = 0; at < hops; at++) {
+		s_compacthop *c = &data.narrow[at];
+		s_widehop *h = &hop[at];
+
+		h->addr = (c->addr == COMPACT_TARGET) ? target : intern->addrs[c->addr];
+		h->xmit = c->xmit;
+		h->returned = c->returned;
+		h->last = c->last;
+		h->best = c->best;
+		h->worst = c->worst;
+		h->jitter = c->jitter;
+		h->jworst = c->jworst;
+		h->jinta = c->jinta;
+		h->p95 = c->p95;
+		h->avg = (float)c->avg / COMPACT_RTT_SCALE;
+		h->stdev = (float)c->stdev / COMPACT_RTT_SCALE;
+		h->gmean = (float)c->gmean / COMPACT_RTT_SCALE;
+		h->javg = (float)c->javg / COMPACT_RTT_SCALE;
+	}
+	LeaveCriticalSection(&intern->lock);
+}
+
+//*****************************************************************************
+// WinMTRCompact::GetHops
+//
+//*****************************************************************************
+int WinMTRCompact::GetHops()
+{
+	return hops;
+}
+
+//*****************************************************************************
+// WinMTRCompact::GetTarget
+//
+//*****************************************************************************
+__int32 WinMTRCompact::GetTarget()
+{
+	return target;
+}
+
+//*****************************************************************************
+// WinMTRCompact::IsWide
+//
+//*****************************************************************************
+bool WinMTRCompact::IsWide()
+{
+	return wide;
+}
+
+//*****************************************************************************
+// WinMTRCompact::GetBytes
+//
+// Without the share of the intern table.
+//*****************************************************************************
+size_t WinMTRCompact::GetBytes()
+{
+	return sizeof(*this) + hops * (wide ? sizeof(s_widehop) : sizeof(s_compacthop));
+}
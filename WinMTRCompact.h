@@ -0,0 +1,129 @@
+//*****************************************************************************
+// FILE:            WinMTRCompact.h
+//
+//
+// DESCRIPTION: The WinMTRCompact class keeps the result of a finished trace
+//              in a few hundred bytes, for sweeps over many targets. The
+//              WinMTRIntern class is the address and name table shared by
+//              all compact records.
+//
+//
+// NOTES: A hop takes 28 bytes: 16 bit counters and RTTs in ms, averages in
+//        1/16 ms and the address as a 16 bit index into the intern table,
+//        the hop that answered as the target itself needs no index. A
+//        record whose values do not all fit is kept in the wide layout
+//        instead, 32 bit fields with the address itself, so nothing is
+//        ever clipped. Names are kept once per address in the table.
+//
+//*****************************************************************************
+
+#ifndef WINMTRCOMPACT_H_
+#define WINMTRCOMPACT_H_
+
+#include "WinMTRGlobal.h"
+#include "WinMTRNet.h"
+#include <map>
+#include <vector>
+
+#define COMPACT_RTT_SCALE	16			// fixed point averages, 1/16 ms
+#define COMPACT_TARGET		0xffff		// address index of the target
+#define COMPACT_MAX			0xffff
+
+struct s_compacthop {
+	unsigned short addr;		// WinMTRIntern index, 0 for none
+	unsigned short xmit;
+	unsigned short returned;
+	unsigned short last;
+	unsigned short best;
+	unsigned short worst;
+	unsigned short jitter;
+	unsigned short jworst;
+	unsigned short jinta;
+	unsigned short p95;
+	unsigned short avg;			// 1/COMPACT_RTT_SCALE ms
+	unsigned short stdev;
+	unsigned short gmean;
+	unsigned short javg;
+};
+
+// the wide layout, also what Decode returns
+struct s_widehop {
+	__int32 addr;				// network byte order
+	int xmit;
+	int returned;
+	int last;
+	int best;
+	int worst;
+	int jitter;
+	int jworst;
+	int jinta;
+	int p95;
+	float avg;
+	float stdev;
+	float gmean;
+	float javg;
+};
+
+//*****************************************************************************
+// CLASS:  WinMTRIntern
+//
+//
+//*****************************************************************************
+
+class WinMTRIntern {
+public:
+	WinMTRIntern();
+	~WinMTRIntern();
+
+	// returns the index of addr, 0 for the address 0, a name replaces none
+	unsigned int	Add(__int32 addr, const char *name);
+	bool			GetName(__int32 addr, char *name, size_t size);
+	int				GetCount();
+	size_t			GetBytes();
+
+private:
+	friend class WinMTRCompact;
+
+	CRITICAL_SECTION				lock;
+	std::vector<__int32>			addrs;		// by index
+	std::vector<unsigned int>		names;		// by index, offset into pool + 1, 0 for none
+	std::string						pool;		// names, 0 terminated
+	std::map<__int32, unsigned int>	index;
+};
+
+//*****************************************************************************
+// CLASS:  WinMTRCompact
+//
+//
+//*****************************************************************************
+
+class WinMTRCompact {
+public:
+	WinMTRCompact(WinMTRIntern *table);
+	~WinMTRCompact();
+
+	// the trace of net has to be finished
+	void	Store(WinMTRNet *net);
+	// hop needs room for GetHops() entries
+	void	Decode(s_widehop *hop);
+
+	int		GetHops();
+	__int32	GetTarget();
+	bool	IsWide();
+	size_t	GetBytes();
+
+private:
+	bool	Fits(const s_widehop *hop, unsigned int index);
+
+private:
+	WinMTRIntern	*intern;
+	__int32			target;
+	unsigned char	hops;
+	bool			wide;
+	union {
+		s_compacthop	*narrow;
+		s_widehop		*full;
+	} data;
+};
+
+#endif	// ifndef WINMTRCOMPACT_H_
@@ -0,0 +1,204 @@
+//*****************************************************************************
+// FILE:            WinMTRDetect.cpp
+//
+//
+//*****************************************************************************
+
+#include "WinMTRDetect.h"
+
+//*****************************************************************************
+// WinMTRDetect::WinMTRDetect
+//
+//*****************************************************************************
+WinMTRDetect::WinMTRDetect()
+{
+	Reset();
+}
+
+//*****************************************************************************
+// WinMTRDetect::Reset
+//
+//*****************************************************************************
+void WinMTRDetect::Reset()
+{
+	RestartRtt();
+	RestartLoss();
+}
+
+//*****************************************************************************
+// WinMTRDetect::Update
+//
+// events needs room for two events, kind, before and after are filled in.
+//*****************************************************************************
+int WinMTRDetect::Update(bool lost, int rtt, wmtr_event *events)
+{
+	int n = 0;
+
+	if (UpdateLoss(lost, &events[n]))
+		n++;
+	if (!lost && rtt >= 0 && UpdateRtt(rtt, &events[n]))
+		n++;
+	return n;
+}
+
+//*****************************************************************************
+// WinMTRDetect::RestartRtt
+//
+// The baseline is learned again from the next DETECT_WARMUP samples.
+//*****************************************************************************
+void WinMTRDetect::RestartRtt()
+{
+	rttSamples = 0;
+	mean = var = 0;
+	up = down = 0;
+	upLevel = downLevel = 0;
+	upRun = downRun = 0;
+}
+
+//*****************************************************************************
+// WinMTRDetect::RestartLoss
+//
+//*****************************************************************************
+void WinMTRDetect::RestartLoss()
+{
+	lossSamples = 0;
+	rate = 0;
+	lossUp = lossDown = 0;
+	lossUpRun = lossDownRun = 0;
+	lostUp = lostDown = 0;
+}
+
+//*****************************************************************************
+// WinMTRDetect::UpdateRtt
+//
+// The baseline only follows the samples while both sums are 0, so a shift
+// in progress does not drag it along. Alarms on shifts too small to matter
+// restart the baseline silently.
+//*****************************************************************************
+bool WinMTRDetect::UpdateRtt(int rtt, wmtr_event *event)
+{
+	float x = (float)rtt;
+	float d = x - mean;
+
+	if (rttSamples < DETECT_WARMUP) {
+		rttSamples++;
+		mean += d / rttSamples;
+		var += (d * (x - mean) - var) / rttSamples;
+		return false;
+	}
+
+	float scale = sqrt(var);
+	float least = (0.05f * mean > DETECT_MIN_SD) ? 0.05f * mean : DETECT_MIN_SD;
+	if (scale < least)
+		scale = least;
+
+	float z = d / scale;
+	if (z > DETECT_RTT_CLIP) z = DETECT_RTT_CLIP;
+	if (z < -DETECT_RTT_CLIP) z = -DETECT_RTT_CLIP;
+
+	// only samples beyond the slack estimate the new level, weighted towards
+	// the latest ones, noise that starts a sum before the actual shift would
+	// otherwise dilute it
+	up += z - DETECT_RTT_K;
+	if (up <= 0) {
+		up = 0;
+		upRun = 0;
+	} else if (z > DETECT_RTT_K) {
+		upLevel = upRun++ ? upLevel + DETECT_LEVEL_ALPHA * (x - upLevel) : x;
+	}
+
+	down += -z - DETECT_RTT_K;
+	if (down <= 0) {
+		down = 0;
+		downRun = 0;
+	} else if (z < -DETECT_RTT_K) {
+		downLevel = downRun++ ? downLevel + DETECT_LEVEL_ALPHA * (x - downLevel) : x;
+	}
+
+	if (up > DETECT_RTT_H || down > DETECT_RTT_H) {
+		float before = mean;
+		float after = (up > DETECT_RTT_H) ? upLevel : downLevel;
+		float minShift = (DETECT_RTT_SHIFT * before > 2 * DETECT_MIN_SD) ?
+			DETECT_RTT_SHIFT * before : 2 * DETECT_MIN_SD;
+
+		if (minShift < 2 * scale)
+			minShift = 2 * scale;
+
+		event->kind = (up > DETECT_RTT_H) ? WMTR_EVENT_RTT_UP : WMTR_EVENT_RTT_DOWN;
+		event->before = before;
+		event->after = after;
+		RestartRtt();
+		return fabs(after - before) >= minShift;
+	}
+
+	if (up == 0 && down == 0) {
+		mean += DETECT_RTT_ALPHA * d;
+		var = (1 - DETECT_RTT_ALPHA) * (var + DETECT_RTT_ALPHA * d * d);
+	}
+	return false;
+}
+
+//*****************************************************************************
+// WinMTRDetect::UpdateLoss
+//
+// Tests the baseline rate p0 against max(2 p0, p0 + 10%) and, once p0 is
+// above 5%, against p0 / 4. The baseline keeps following the samples until
+// a sum is half way to an alarm, the loss of a single hop is too noisy to
+// freeze it whenever a sum is above 0.
+//*****************************************************************************
+bool WinMTRDetect::UpdateLoss(bool lost, wmtr_event *event)
+{
+	float l = lost ? 1.0f : 0.0f;
+
+	if (lossSamples < DETECT_WARMUP) {
+		lossSamples++;
+		rate += (l - rate) / lossSamples;
+		return false;
+	}
+
+	float p0 = (rate > DETECT_MIN_LOSS) ? rate : DETECT_MIN_LOSS;
+	if (p0 > 0.95f)
+		p0 = 0.95f;
+
+	if (p0 < 0.9f) {
+		float p1 = (p0 > 0.1f) ? 2 * p0 : p0 + 0.1f;
+		if (p1 > 0.95f) p1 = 0.95f;
+		lossUp += lost ? log(p1 / p0) : log((1 - p1) / (1 - p0));
+		if (lossUp <= 0) {
+			lossUp = 0;
+			lossUpRun = 0;
+			lostUp = 0;
+		} else {
+			lossUpRun++;
+			lostUp += lost;
+		}
+	}
+
+	if (p0 >= 0.05f) {
+		float p1 = p0 / 4;
+		lossDown += lost ? log(p1 / p0) : log((1 - p1) / (1 - p0));
+		if (lossDown <= 0) {
+			lossDown = 0;
+			lossDownRun = 0;
+			lostDown = 0;
+		} else {
+			lossDownRun++;
+			lostDown += lost;
+		}
+	}
+
+	if (lossUp > DETECT_LOSS_H || lossDown > DETECT_LOSS_H) {
+		float before = rate;
+		float after = (lossUp > DETECT_LOSS_H) ?
+			(float)lostUp / lossUpRun : (float)lostDown / lossDownRun;
+		event->kind = (lossUp > DETECT_LOSS_H) ? WMTR_EVENT_LOSS_UP : WMTR_EVENT_LOSS_DOWN;
+		event->before = before * 100;
+		event->after = after * 100;
+		RestartLoss();
+		return fabs(after - before) >= DETECT_LOSS_SHIFT;
+	}
+
+	if (lossUp < DETECT_LOSS_H / 2 && lossDown < DETECT_LOSS_H / 2)
+		rate += DETECT_LOSS_ALPHA * (l - rate);
+	return false;
+}
@@ -0,0 +1,72 @@
+//*****************************************************************************
+// FILE:            WinMTRDetect.h
+//
+//
+// DESCRIPTION: The WinMTRDetect class detects shifts in the RTT and the loss
+//              rate of a single hop while the trace runs.
+//
+//
+// NOTES: RTT uses a two-sided CUSUM test on samples standardized against
+//        an EWMA baseline, loss a two-sided Bernoulli CUSUM test against an
+//        EWMA loss rate. Both are updated in constant time and memory per
+//        probe. After an alarm the baseline is learned again at the new
+//        level, so a later recovery is reported as a shift in the other
+//        direction.
+//
+//*****************************************************************************
+
+#ifndef WINMTRDETECT_H_
+#define WINMTRDETECT_H_
+
+#include "WinMTRGlobal.h"
+#include "WinMTRLib.h"
+
+#define DETECT_WARMUP		20		// samples before the tests start
+#define DETECT_RTT_ALPHA	0.0625f	// EWMA weight of the RTT baseline
+#define DETECT_RTT_K		0.5f	// CUSUM slack, in standard deviations
+#define DETECT_RTT_H		8.0f	// CUSUM alarm threshold
+#define DETECT_RTT_CLIP		4.0f	// limit of a single standardized sample
+#define DETECT_LEVEL_ALPHA	0.5f	// EWMA weight of the new level estimate
+#define DETECT_MIN_SD		1.0f	// ms, RTTs are whole milliseconds
+#define DETECT_RTT_SHIFT	0.1f	// smallest reported shift, relative, at least 2 * DETECT_MIN_SD
+#define DETECT_LOSS_ALPHA	0.015625f
+#define DETECT_LOSS_H		8.0f
+#define DETECT_MIN_LOSS		0.01f
+#define DETECT_LOSS_SHIFT	0.05f	// smallest reported shift of the loss rate
+
+//*****************************************************************************
+// CLASS:  WinMTRDetect
+//
+//
+//*****************************************************************************
+
+class WinMTRDetect {
+public:
+	WinMTRDetect();
+
+	void	Reset();
+	// rtt < 0 for replies without a usable RTT, returns the number of events
+	int		Update(bool lost, int rtt, wmtr_event *events);
+
+private:
+	bool	UpdateRtt(int rtt, wmtr_event *event);
+	bool	UpdateLoss(bool lost, wmtr_event *event);
+	void	RestartRtt();
+	void	RestartLoss();
+
+private:
+	int		rttSamples;
+	float	mean;
+	float	var;
+	float	up, down;			// CUSUM sums
+	float	upLevel, downLevel;	// EWMA of the RTTs beyond the slack since the sum left 0
+	int		upRun, downRun;
+
+	int		lossSamples;
+	float	rate;
+	float	lossUp, lossDown;
+	int		lossUpRun, lossDownRun;
+	int		lostUp, lostDown;	// losses since the sum left 0
+};
+
+#endif	// ifndef WINMTRDETECT_H_
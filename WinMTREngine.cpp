@@ -0,0 +1,737 @@
+//*****************************************************************************
+// FILE:            WinMTREngine.cpp
+//
+//*****************************************************************************
+#include "WinMTRGlobal.h"
+#include "WinMTREngine.h"
+#include "WinMTRMatrix.h"
+#include "WinMTRNet.h"
+#include "WinMTRParams.h"
+#include "WinMTRSim.h"
+#include "WinMTRTrace.h"
+
+// upper bound for a worker's sleep when it has nothing scheduled
+#define WORKER_IDLE_WAIT		250
+
+unsigned __stdcall WorkerThread(void *p);
+
+//*****************************************************************************
+// CLASS:  WinMTRIcmp
+//
+// The ICMP.DLL backend, one ICMP handle per worker.
+//*****************************************************************************
+
+class WinMTRIcmp : public WinMTRBackend {
+public:
+	WinMTRIcmp(WinMTREngine *e);
+	~WinMTRIcmp();
+
+	bool	Send(probe_req *req);
+	void	Wait(HANDLE hWake, DWORD ms);
+
+private:
+	static VOID NTAPI Completion(PVOID ctx, PVOID iosb, ULONG reserved);
+
+	WinMTREngine	*engine;
+	HANDLE			hICMP;
+};
+
+WinMTRIcmp::WinMTRIcmp(WinMTREngine *e)
+	: engine(e)
+{
+	hICMP = (HANDLE) engine->lpfnIcmpCreateFile();
+}
+
+WinMTRIcmp::~WinMTRIcmp()
+{
+	if (hICMP != INVALID_HANDLE_VALUE)
+		engine->lpfnIcmpCloseHandle(hICMP);
+}
+
+bool WinMTRIcmp::Send(probe_req *req)
+{
+	if (hICMP == INVALID_HANDLE_VALUE)
+		return false;
+
+	DWORD ret = engine->lpfnIcmpSendEcho2(hICMP, NULL, Completion, req, req->address,
+		(LPVOID)req->reqData, req->reqSize, &req->ipinfo, req->repData, req->repSize,
+		req->wait);
+
+	// with an APC routine the request either fails or is pending
+	return ret != 0 || GetLastError() == ERROR_IO_PENDING;
+}
+
+void WinMTRIcmp::Wait(HANDLE hWake, DWORD ms)
+{
+	// alertable, so completed requests run their APC here
+	WaitForSingleObjectEx(hWake, ms, TRUE);
+}
+
+VOID NTAPI WinMTRIcmp::Completion(PVOID ctx, PVOID iosb, ULONG reserved)
+{
+	probe_req *req = (probe_req*)ctx;
+	WinMTRIcmp *icmp = (WinMTRIcmp*)req->worker->backend;
+
+	req->replies = icmp->engine->lpfnIcmpParseReplies(req->repData, req->repSize);
+	icmp->engine->Complete(req);
+}
+
+//*****************************************************************************
+// WinMTREngine::WinMTREngine
+//
+// workers == 0 starts one worker per processor. A non-empty simfile replaces
+// ICMP.DLL with the simulated backend.
+//*****************************************************************************
+WinMTREngine::WinMTREngine(int workers, const char *simfile)
+{
+	SYSTEM_INFO si;
+	WSADATA wsaData;
+	LARGE_INTEGER counter;
+
+	initialized = false;
+	shutdown = false;
+	nworkers = 0;
+	nextWorker = 0;
+	simpath = NULL;
+	hICMP_DLL = 0;
+	InitializeCriticalSection(&submitLock);
+	InitializeCriticalSection(&rateLock);
+	rate = 0;
+	burst = 1;
+	tokens = 0;
+	refilled = 0;
+
+	// every probe sends the same read-only payload
+	memset(payload, 32, sizeof(payload)); //whitespaces
+	QueryPerformanceFrequency(&counter);
+	frequency = counter.QuadPart;
+
+	if( WSAStartup(MAKEWORD(2, 2), &wsaData) ) {
+		fprintf(stderr, "error: failed initializing windows sockets library\n");
+		return;
+	}
+
+	if (simfile && *simfile) {
+		simpath = new WinMTRSimPath;
+		if (!simpath->Load(simfile))
+			return;
+	} else {
+		hICMP_DLL =  LoadLibrary(_T("ICMP.DLL"));
+		if (hICMP_DLL == 0) {
+			fprintf(stderr, "error: unable to locate ICMP.DLL\n");
+			return;
+		}
+
+		/*
+		 * Get pointers to ICMP.DLL functions
+		 */
+		lpfnIcmpCreateFile   = (LPFNICMPCREATEFILE)GetProcAddress(hICMP_DLL,"IcmpCreateFile");
+		lpfnIcmpCloseHandle  = (LPFNICMPCLOSEHANDLE)GetProcAddress(hICMP_DLL,"IcmpCloseHandle");
+		lpfnIcmpSendEcho2    = (LPFNICMPSENDECHO2)GetProcAddress(hICMP_DLL,"IcmpSendEcho2");
+		lpfnIcmpParseReplies = (LPFNICMPPARSEREPLIES)GetProcAddress(hICMP_DLL,"IcmpParseReplies");
+		if ((!lpfnIcmpCreateFile) || (!lpfnIcmpCloseHandle) || (!lpfnIcmpSendEcho2) || (!lpfnIcmpParseReplies)) {
+			fprintf(stderr, "error: wrong ICMP.DLL system library\n");
+			return;
+		}
+	}
+
+	GetSystemInfo(&si);
+	if (workers <= 0)
+		workers = si.dwNumberOfProcessors;
+	if (workers > MAX_WORKERS)
+		workers = MAX_WORKERS;
+
+	for (int i = 0; i < workers; i++) {
+		engine_worker *w = &worker[i];
+		w->engine = this;
+		w->index = i;
+		w->taskCount = 0;
+		w->wheel.Reset(GetTickCount());
+		w->inFlight = 0;
+		InitializeCriticalSection(&w->lock);
+		w->hWake = CreateEvent(NULL, FALSE, FALSE, NULL);
+		if (simpath)
+			w->backend = new WinMTRSim(this, simpath, GetTickCount() + i * 7919);
+		else
+			w->backend = new WinMTRIcmp(this);
+	}
+	nworkers = workers;
+
+	for (int i = 0; i < nworkers; i++) {
+		engine_worker *w = &worker[i];
+		w->hThread = (HANDLE)_beginthreadex(NULL, 0, WorkerThread, w, 0, NULL);
+		// pin workers to cores, wrapping around when there are more workers
+		if (si.dwNumberOfProcessors <= sizeof(DWORD_PTR) * 8)
+			SetThreadAffinityMask(w->hThread, (DWORD_PTR)1 << (i % si.dwNumberOfProcessors));
+	}
+
+	initialized = true;
+}
+
+WinMTREngine::~WinMTREngine()
+{
+	shutdown = true;
+	for (int i = 0; i < nworkers; i++)
+		SetEvent(worker[i].hWake);
+
+	for (int i = 0; i < nworkers; i++) {
+		engine_worker *w = &worker[i];
+		WaitForSingleObject(w->hThread, INFINITE);
+		CloseHandle(w->hThread);
+		CloseHandle(w->hWake);
+		for (size_t j = 0; j < w->tasks.size(); j++)
+			delete w->tasks[j];
+		delete w->backend;
+		DeleteCriticalSection(&w->lock);
+	}
+
+	if (hICMP_DLL)
+		FreeLibrary(hICMP_DLL);
+	delete simpath;
+	DeleteCriticalSection(&submitLock);
+	DeleteCriticalSection(&rateLock);
+
+	WSACleanup();
+}
+
+bool WinMTREngine::IsInitialized()
+{
+	return initialized;
+}
+
+int WinMTREngine::GetWorkers()
+{
+	return nworkers;
+}
+
+//*****************************************************************************
+// WinMTREngine::GetMetrics
+//
+// Adds the counters of all workers to m. The workers keep counting, so the
+// figures are only exact once they are idle.
+//*****************************************************************************
+void WinMTREngine::GetMetrics(WinMTRMetrics *m)
+{
+	for (int i = 0; i < nworkers; i++)
+		m->Merge(worker[i].metrics);
+}
+
+//*****************************************************************************
+// WinMTREngine::SetRate
+//
+// Caps the probes of all traces of the engine with a token bucket.
+//*****************************************************************************
+void WinMTREngine::SetRate(float pps, int b)
+{
+	EnterCriticalSection(&rateLock);
+	rate = pps / 1000.0;
+	burst = (b > 1) ? b : 1;
+	tokens = burst;
+	refilled = GetTickCount();
+	LeaveCriticalSection(&rateLock);
+}
+
+//*****************************************************************************
+// WinMTREngine::TakeToken
+//
+// Takes a token to send a probe, or sets next to when one will be there.
+//*****************************************************************************
+bool WinMTREngine::TakeToken(DWORD now, DWORD *next)
+{
+	bool taken = true;
+
+	EnterCriticalSection(&rateLock);
+	tokens += (now - refilled) * rate;
+	if (tokens > burst)
+		tokens = burst;
+	refilled = now;
+	if (tokens >= 1)
+		tokens -= 1;
+	else {
+		*next = now + (DWORD)ceil((1 - tokens) / rate);
+		taken = false;
+	}
+	LeaveCriticalSection(&rateLock);
+	return taken;
+}
+
+//*****************************************************************************
+// WinMTREngine::Submit
+//
+// Creates one task per TTL and lane and deals them out round-robin,
+// continuing where the previous trace stopped so concurrent traces spread
+// evenly. The lanes of a --train start TRAIN_SPACING apart.
+//*****************************************************************************
+void WinMTREngine::Submit(WinMTRNet *net, int address)
+{
+	int lanes = net->lanes;
+	DWORD spacing = (net->wmtrparams->train > 1) ? TRAIN_SPACING : 0;
+
+	EnterCriticalSection(&submitLock);
+	for (int i = 0; i < MAX_HOPS * lanes; i++) {
+		probe_task *task = new probe_task;
+		task->net = net;
+		task->ttl = i / lanes + 1;
+		task->lane = i % lanes;
+		task->cycle = 0;
+		task->answered = 0;
+		task->address = address;
+		task->nextSend = GetTickCount() + task->lane * spacing;
+		task->intended = WinMTRMetrics::Now();
+		task->inFlight = false;
+		task->outstanding = 0;
+		task->req = NULL;
+		task->timer.prev = task->timer.next = NULL;
+		task->timer.data = task;
+
+		engine_worker *w = &worker[nextWorker];
+		nextWorker = (nextWorker + 1) % nworkers;
+
+		EnterCriticalSection(&w->lock);
+		AddTask(w, task);
+		w->taskCount = (LONG)w->tasks.size();
+		LeaveCriticalSection(&w->lock);
+		SetEvent(w->hWake);
+	}
+	LeaveCriticalSection(&submitLock);
+}
+
+//*****************************************************************************
+// WinMTREngine::AddTask
+//
+// Under the lock of w.
+//*****************************************************************************
+void WinMTREngine::AddTask(engine_worker *w, probe_task *task)
+{
+	task->index = w->tasks.size();
+	w->tasks.push_back(task);
+	w->wheel.Add(&task->timer, task->nextSend);
+}
+
+//*****************************************************************************
+// WinMTREngine::RemoveTask
+//
+// Under the lock of w.
+//*****************************************************************************
+void WinMTREngine::RemoveTask(engine_worker *w, probe_task *task)
+{
+	probe_task *last = w->tasks.back();
+
+	w->wheel.Cancel(&task->timer);
+	w->tasks[task->index] = last;
+	last->index = task->index;
+	w->tasks.pop_back();
+}
+
+//*****************************************************************************
+// WinMTREngine::RunTask
+//
+// The timer of the task went off, under the lock of w: either the timeout
+// of its request in flight or the time to send the next one.
+//*****************************************************************************
+void WinMTREngine::RunTask(engine_worker *w, probe_task *task)
+{
+	if (task->inFlight) {
+		Expire(task);
+	} else if (!SendProbe(w, task)) {
+		RemoveTask(w, task);
+		FinishTask(w, task);
+	} else if (!task->inFlight) {
+		// held back, due again at nextSend
+		w->wheel.Add(&task->timer, task->nextSend);
+	} else if (task->req == NULL) {
+		// the send failed and was completed, the task waits in ready
+	} else if (task->req->wait > task->req->timeout) {
+		// counted lost at its timeout, ICMP.DLL waits on for --late
+		w->wheel.Add(&task->timer, task->req->sentAt + task->req->timeout);
+	}
+}
+
+//*****************************************************************************
+// WinMTREngine::Schedule
+//
+// Arms the timers of the tasks accounted since the last round, under the
+// lock of w. Only then are they not in flight and can be stolen.
+//*****************************************************************************
+void WinMTREngine::Schedule(engine_worker *w)
+{
+	for (size_t i = 0; i < w->ready.size(); i++) {
+		probe_task *task = w->ready[i];
+		w->wheel.Cancel(&task->timer);
+		w->wheel.Add(&task->timer, task->nextSend);
+		task->inFlight = false;
+	}
+	w->ready.clear();
+}
+
+//*****************************************************************************
+// WinMTREngine::SendProbe
+//
+// Returns false once the task is done.
+//*****************************************************************************
+bool WinMTREngine::SendProbe(engine_worker *w, probe_task *task)
+{
+	WinMTRNet *net = task->net;
+	probe_req *req;
+	int nDataLen = net->wmtrparams->pingsize;
+
+	if (!net->tracing || net->settled)
+		return false;
+	if (net->wmtrparams->pmtu) {
+		// the search ends the task, not the cycles
+	} else if (net->wmtrparams->adaptive) {
+		if (net->AdaptiveDone(task->ttl - 1))
+			return false;
+	} else if (net->wmtrparams->multipath ? net->MultipathDone(task->ttl - 1)
+			: task->cycle >= net->wmtrparams->cycles)
+		return false;
+
+	// For some strange reason, ICMP API is not filling the TTL for icmp echo reply
+	// Check if the current task should be closed. Hop addresses are only
+	// ever set once, so this is read without the trace lock.
+	if (task->ttl > net->GetMaxUnsafe())
+		return false;
+
+	if (net->wmtrparams->pmtu) {
+		int size = net->NextMtuProbe(task->ttl - 1, task->lane);
+		if (size == 0)
+			return false;
+		nDataLen = size - PMTU_HEADER;
+	}
+	if (net->wmtrparams->capacity) {
+		if (net->CapacityDone(task->ttl - 1))
+			return false;
+		nDataLen = WinMTRNet::CapacitySize(task->cycle % CAPACITY_SIZES);
+	}
+	// held back by a full table or by --rate, the task stays and is due
+	// again at nextSend
+	if (w->probes.IsFull()) {
+		task->nextSend = GetTickCount() + 1;
+		return true;
+	}
+	if (rate > 0 && !TakeToken(GetTickCount(), &task->nextSend))
+		return true;
+
+	req = w->probes.Insert();
+	task->cycle++;
+	if (net->wmtrparams->adaptive)
+		InterlockedIncrement(&net->probesSent);
+	w->metrics.Add(METRIC_SEND_LAG, task->intended, WinMTRMetrics::Now());
+
+	req->task = task;
+	req->worker = w;
+	req->cycle = task->cycle;
+	// only Account changes it, on this worker or one that stole the task
+	req->police = net->wmtrparams->police ? net->police[task->ttl - 1].level : 0;
+	req->address = task->address;
+	req->ipinfo.Ttl = task->ttl;
+	req->ipinfo.Tos = net->wmtrparams->tos[net->wmtrparams->tosCount > 1 ? task->lane : 0];
+	req->ipinfo.Flags = IPFLAG_DONT_FRAGMENT;
+	req->ipinfo.OptionsSize = 0;
+	req->ipinfo.OptionsData = NULL;
+	req->reqSize = nDataLen;
+	req->reqData = payload;
+	req->flow = -1;
+	req->flowData = NULL;
+	if (net->wmtrparams->multipath) {
+		// ICMP.DLL picks identifier and sequence, so the flow id goes into
+		// the payload and with it into the checksum routers hash on
+		req->flow = task->cycle - 1;
+		req->flowData = w->pool.Get(nDataLen, &req->flowSize);
+		memcpy(req->flowData, payload, nDataLen);
+		req->flowData[0] = (char)(req->flow >> 8);
+		req->flowData[1] = (char)req->flow;
+		req->reqData = req->flowData;
+	}
+	req->timeout = net->wmtrparams->rto ? net->ProbeTimeout(task->ttl - 1)
+		: (DWORD)(net->wmtrparams->timeout * 1000);
+	req->wait = req->timeout + (DWORD)(net->wmtrparams->late * 1000);
+	req->replies = 0;
+	req->repData = w->pool.Get(REPLY_SIZE(nDataLen), &req->repSize);
+
+	task->req = req;
+	task->inFlight = true;
+	task->outstanding++;
+	w->inFlight++;
+	req->sentAt = GetTickCount();
+	if (net->wmtrparams->capacity) {
+		LARGE_INTEGER counter;
+		QueryPerformanceCounter(&counter);
+		req->sentCounter = counter.QuadPart;
+	}
+	if (!w->backend->Send(req)) {
+		TRACE_ERROR(TRACE_SEND_FAILED, task->ttl, task->cycle, GetLastError());
+		req->replies = 0;
+		Complete(req);
+	}
+	return true;
+}
+
+//*****************************************************************************
+// WinMTREngine::Complete
+//
+// Runs on the worker that sent the request, when ICMP.DLL is done with it.
+// The request may have been counted lost already, a reply then is late.
+//*****************************************************************************
+void WinMTREngine::Complete(probe_req *req)
+{
+	probe_task *task = req->task;
+	engine_worker *w = req->worker;
+	PICMPECHO icmp_echo_reply = (PICMPECHO)req->repData;
+
+	if (task) {
+		WinMTRNet *net = task->net;
+		bool replied = req->replies != 0 && (icmp_echo_reply->Status == IP_SUCCESS
+			|| icmp_echo_reply->Status == IP_TTL_EXPIRED_TRANSIT);
+
+		// a reply after the timeout that came before the worker expired it
+		if (!req->expired && replied && req->wait > req->timeout
+				&& icmp_echo_reply->RoundTripTime > req->timeout)
+			Expire(task);
+		if (!req->expired)
+			Account(req, req->replies);
+
+		bool reordered = replied && req->cycle < task->answered;
+		if (replied && !reordered)
+			task->answered = req->cycle;
+		EnterCriticalSection(&net->laneLock[task->ttl - 1]);
+		if (req->expired && replied) {
+			net->CreditLate(task->ttl - 1, task->lane, req->police, req->cycle,
+				icmp_echo_reply, &w->metrics);
+			if (net->matrix)
+				net->matrix->Credit(task->ttl - 1, req->cycle - 1);
+		}
+		net->RecordOrder(task->ttl - 1, (req->replies > 1) ? req->replies - 1 : 0, reordered);
+		LeaveCriticalSection(&net->laneLock[task->ttl - 1]);
+		task->outstanding--;
+	}
+
+	if (req->flowData) {
+		w->pool.Put(req->flowData, req->flowSize);
+		req->flowData = NULL;
+	}
+	w->pool.Put(req->repData, req->repSize);
+	req->repData = NULL;
+	w->probes.Remove(req);
+	w->inFlight--;
+}
+
+//*****************************************************************************
+// WinMTREngine::Expire
+//
+// Counts the request in flight lost at its timeout, ICMP.DLL keeps it until
+// the end of the --late window.
+//*****************************************************************************
+void WinMTREngine::Expire(probe_task *task)
+{
+	task->req->expired = true;
+	Account(task->req, 0);
+}
+
+//*****************************************************************************
+// WinMTREngine::Account
+//
+// Adds the outcome of the request in flight to the trace and sets the time
+// of the next probe of its task, which waits in ready for Schedule.
+//*****************************************************************************
+void WinMTREngine::Account(probe_req *req, DWORD replies)
+{
+	probe_task *task = req->task;
+	WinMTRNet *net = task->net;
+	PICMPECHO icmp_echo_reply = (PICMPECHO)req->repData;
+	DWORD interval = (DWORD)(net->wmtrparams->interval * 1000);
+	DWORD delay = 0;
+	LONGLONG start = WinMTRMetrics::Now();
+	bool pmtu = net->wmtrparams->pmtu;
+
+	EnterCriticalSection(&net->laneLock[task->ttl - 1]);
+	if (pmtu)
+		net->ProcessMtu(task->ttl - 1, task->lane, req->reqSize + PMTU_HEADER,
+			replies, icmp_echo_reply);
+	// a too big reply comes from an earlier hop, it says nothing about this one
+	if (!pmtu || replies == 0 || icmp_echo_reply->Status != IP_PACKET_TOO_BIG) {
+		net->ProcessReply(task->ttl - 1, replies, icmp_echo_reply, &req->worker->metrics);
+		net->NotifyProbe(task->ttl - 1, task->cycle, replies, icmp_echo_reply);
+		net->DetectChange(task->ttl - 1, replies, icmp_echo_reply);
+		if (net->series)
+			net->RecordSample(task->ttl - 1, req->sentAt, replies, icmp_echo_reply);
+	}
+	if (net->wmtrparams->capacity) {
+		// ICMP.DLL only has whole milliseconds
+		LARGE_INTEGER counter;
+		QueryPerformanceCounter(&counter);
+		net->RecordCapacity(task->ttl - 1, task->cycle,
+			(int)((counter.QuadPart - req->sentCounter) * 1000000 / frequency),
+			replies, icmp_echo_reply);
+	}
+	if (req->flow >= 0)
+		net->RecordFlow(task->ttl - 1, req->flow, replies, icmp_echo_reply);
+	if (net->wmtrparams->rto)
+		net->UpdateRto(task->ttl - 1, replies, icmp_echo_reply);
+	if (net->wmtrparams->train > 0)
+		net->RecordTrain(task->ttl - 1, task->cycle, replies, icmp_echo_reply);
+	if (net->wmtrparams->police)
+		net->RecordPolice(task->ttl - 1, req->police, replies, icmp_echo_reply);
+	if (net->wmtrparams->tosCount > 1)
+		net->RecordTos(task->ttl - 1, task->lane, replies, icmp_echo_reply);
+	if (net->matrix)
+		net->matrix->Record(task->ttl - 1, req->cycle - 1, replies == 0 ||
+			(icmp_echo_reply->Status != IP_SUCCESS &&
+			 icmp_echo_reply->Status != IP_TTL_EXPIRED_TRANSIT));
+	LeaveCriticalSection(&net->laneLock[task->ttl - 1]);
+	if (net->wmtrparams->fast && !net->wmtrparams->multipath && !pmtu &&
+		!net->settled && task->cycle >= FAST_MIN_CYCLES && net->IsSettled())
+		net->settled = true;
+
+	// the trains and TOS classes stay on the grid of the given interval
+	if (net->wmtrparams->adaptive && net->wmtrparams->train == 0 && net->wmtrparams->tosCount <= 1)
+		interval = net->AdaptiveInterval(interval);
+
+	// --pmtu sends the next size as soon as this one is known, the others
+	// wait out the interval from the send, --police the one its hop backed
+	// off to
+	if (net->wmtrparams->police) {
+		DWORD elapsed = GetTickCount() - req->sentAt;
+		interval = net->PoliceInterval(task->ttl - 1, interval);
+		if (interval > elapsed)
+			delay = interval - elapsed;
+	} else if (net->wmtrparams->lockstep || net->wmtrparams->tosCount > 1) {
+		// cycle n of every hop goes out n - 1 intervals after the start, the
+		// TOS classes of a hop together
+		DWORD due = net->startTick + task->cycle * interval;
+		DWORD now = GetTickCount();
+		if ((LONG)(due - now) > 0)
+			delay = due - now;
+	} else if (net->wmtrparams->train > 0) {
+		// a lane keeps its place in the train, a loss does not pull it ahead
+		DWORD spacing = (net->wmtrparams->train > 1) ? TRAIN_SPACING : 0;
+		DWORD due = net->startTick + task->cycle * interval + task->lane * spacing;
+		DWORD now = GetTickCount();
+		if ((LONG)(due - now) > 0)
+			delay = due - now;
+	} else if (!pmtu) {
+		// a probe lost early (--rto) does not pull the next one ahead
+		DWORD elapsed = GetTickCount() - req->sentAt;
+		if (interval > elapsed)
+			delay = interval - elapsed;
+	}
+
+	task->nextSend = GetTickCount() + delay;
+	task->req = NULL;
+
+	LONGLONG end = WinMTRMetrics::Now();
+	task->intended = end + WinMTRMetrics::Ticks(delay);
+	req->worker->metrics.Add(METRIC_REPLY, start, end);
+	req->worker->ready.push_back(task);
+}
+
+//*****************************************************************************
+// WinMTREngine::FinishTask
+//
+// Requests of the task still out are left to complete on their own.
+//*****************************************************************************
+void WinMTREngine::FinishTask(engine_worker *w, probe_task *task)
+{
+	WinMTRNet *net = task->net;
+
+	if (task->outstanding > 0)
+		w->probes.Orphan(task);
+	delete task;
+	if (InterlockedDecrement(&net->activeTasks) == 0)
+		SetEvent(net->hDone);
+}
+
+//*****************************************************************************
+// WinMTREngine::Steal
+//
+// Moves half of the idle tasks of the busiest worker to w. Only one worker
+// lock is held at a time.
+//*****************************************************************************
+bool WinMTREngine::Steal(engine_worker *w)
+{
+	engine_worker *victim = NULL;
+	LONG most = 1;
+	std::vector<probe_task*> stolen;
+
+	for (int i = 1; i < nworkers; i++) {
+		engine_worker *v = &worker[(w->index + i) % nworkers];
+		if (v->taskCount > most) {
+			most = v->taskCount;
+			victim = v;
+		}
+	}
+	if (victim == NULL)
+		return false;
+
+	EnterCriticalSection(&victim->lock);
+	size_t want = victim->tasks.size() / 2;
+	for (size_t i = 0; i < victim->tasks.size() && stolen.size() < want; ) {
+		probe_task *task = victim->tasks[i];
+		// completions run on the worker that sent the request
+		if (task->inFlight || task->outstanding > 0) {
+			i++;
+			continue;
+		}
+		stolen.push_back(task);
+		RemoveTask(victim, task);
+	}
+	victim->taskCount = (LONG)victim->tasks.size();
+	LeaveCriticalSection(&victim->lock);
+
+	if (stolen.empty())
+		return false;
+
+	EnterCriticalSection(&w->lock);
+	for (size_t i = 0; i < stolen.size(); i++)
+		AddTask(w, stolen[i]);
+	w->taskCount = (LONG)w->tasks.size();
+	LeaveCriticalSection(&w->lock);
+	return true;
+}
+
+//*****************************************************************************
+// WorkerThread
+//
+//
+//*****************************************************************************
+unsigned __stdcall WorkerThread(void *p)
+{
+	engine_worker *w = (engine_worker*)p;
+	WinMTREngine *engine = w->engine;
+
+	TRACE_INFO(TRACE_WORKER_START, w->index, 0, 0);
+	while (!engine->shutdown) {
+		DWORD now = GetTickCount();
+		DWORD wait;
+		LONGLONG start = WinMTRMetrics::Now();
+
+		EnterCriticalSection(&w->lock);
+		w->metrics.Add(METRIC_LOCK_WAIT, start, WinMTRMetrics::Now());
+		engine->Schedule(w);
+		wheel_timer *t = w->wheel.Advance(now);
+		while (t) {
+			wheel_timer *next = t->next;
+			engine->RunTask(w, (probe_task*)t->data);
+			t = next;
+		}
+		// lost at their timeout just now
+		engine->Schedule(w);
+		wait = w->wheel.NextDue(now, WORKER_IDLE_WAIT);
+		w->taskCount = (LONG)w->tasks.size();
+		bool idle = w->tasks.empty();
+		LeaveCriticalSection(&w->lock);
+
+		if (idle && engine->Steal(w))
+			continue;
+
+		w->backend->Wait(w->hWake, wait);
+	}
+
+	// let outstanding requests complete before the backend goes away
+	while (w->inFlight > 0)
+		w->backend->Wait(w->hWake, WORKER_IDLE_WAIT);
+
+	TRACE_INFO(TRACE_WORKER_STOP, w->index, 0, 0);
+	TRACE_THREAD_EXIT();
+	return 0;
+}
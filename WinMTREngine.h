@@ -0,0 +1,179 @@
+//*****************************************************************************
+// FILE:            WinMTREngine.h
+//
+//
+// DESCRIPTION: The WinMTREngine class runs the probes of one or more
+//              WinMTRNet traces on a fixed pool of worker threads.
+//
+//
+// NOTES: Every TTL of a trace is a probe task. Tasks are spread across the
+//        workers, each worker owns its own ICMP handle (or simulated
+//        backend), its own send timers and the statistics of the hops it
+//        is currently probing, so replies are processed without any shared
+//        lock. Idle workers steal tasks without requests outstanding from
+//        the busiest worker. Probes are sent with IcmpSendEcho2 and complete
+//        as APCs on the worker that sent them. A probe is counted lost at
+//        its timeout, but ICMP.DLL keeps waiting for --late more, a reply in
+//        that window is credited to the hop as late. The send times and
+//        timeouts of a worker's tasks hang in its timing wheel, so a round
+//        of the worker only touches the tasks that are due.
+//
+//*****************************************************************************
+
+#ifndef WINMTRENGINE_H_
+#define WINMTRENGINE_H_
+
+#include "WinMTRGlobal.h"
+#include "WinMTRMetrics.h"
+#include "WinMTRPool.h"
+#include "WinMTRProbes.h"
+#include "WinMTRWheel.h"
+#include <vector>
+
+#define IPFLAG_DONT_FRAGMENT	0x02
+
+class WinMTRNet;
+class WinMTRBackend;
+class WinMTREngine;
+class WinMTRSimPath;
+struct engine_worker;
+
+// one echo request, in the worker's table from its send to its completion
+struct probe_req {
+	struct probe_task	*task;			// NULL once the task finished
+	engine_worker		*worker;
+	bool				busy;			// in the table
+	bool				expired;		// counted lost, a reply now is late
+	int					cycle;			// of the task when sent
+	int					police;			// --police level of the hop when sent
+	u_long				address;
+	IPINFO				ipinfo;
+	WORD				reqSize;
+	DWORD				timeout;		// ms, counted lost after it
+	DWORD				wait;			// ms, given to ICMP.DLL, timeout plus --late
+	DWORD				sentAt;			// GetTickCount() when sent
+	LONGLONG			sentCounter;	// performance counter when sent, --capacity
+	DWORD				replies;		// filled in on completion
+	const char			*reqData;		// the engine's shared payload or flowData
+	char				*repData;		// from the worker's pool while in flight
+	DWORD				repSize;
+	int					flow;			// multipath flow id, -1 for plain probes
+	char				*flowData;		// payload carrying the flow id, from the pool
+	DWORD				flowSize;
+};
+
+// one TTL of one trace
+struct probe_task {
+	WinMTRNet			*net;
+	int					ttl;
+	int					lane;			// --pmtu search lane, --train probe or --tos class, 0 otherwise
+	int					cycle;
+	int					answered;		// latest cycle answered, for reordering
+	u_long				address;
+	DWORD				nextSend;		// GetTickCount() based
+	LONGLONG			intended;		// nextSend in WinMTRMetrics ticks
+	volatile bool		inFlight;		// waiting for req to complete or expire
+	volatile LONG		outstanding;	// requests still in the worker's table
+	probe_req			*req;			// the request in flight
+	wheel_timer			timer;			// nextSend, or the timeout of req with --late
+	size_t				index;			// in the worker's tasks
+};
+
+struct engine_worker {
+	WinMTREngine		*engine;
+	int					index;
+	HANDLE				hThread;
+	HANDLE				hWake;
+	WinMTRBackend		*backend;
+	CRITICAL_SECTION	lock;			// guards tasks, taken by thieves
+	std::vector<probe_task*> tasks;
+	WinMTRWheel			wheel;			// guarded by lock, the timers of tasks
+	volatile LONG		taskCount;
+	int					inFlight;		// only touched by the worker itself
+	WinMTRPool			pool;			// only touched by the worker itself
+	WinMTRProbes		probes;			// only touched by the worker itself
+	std::vector<probe_task*> ready;		// accounted, to be scheduled, only touched by the worker itself
+	WinMTRMetrics		metrics;		// only written by the worker itself
+};
+
+//*****************************************************************************
+// CLASS:  WinMTRBackend
+//
+// Sends echo requests asynchronously. Completions are reported through
+// WinMTREngine::Complete on the thread that sent the request, from within
+// Wait.
+//*****************************************************************************
+
+class WinMTRBackend {
+public:
+	virtual ~WinMTRBackend() {}
+
+	virtual bool	Send(probe_req *req) = 0;
+	virtual void	Wait(HANDLE hWake, DWORD ms) = 0;
+};
+
+//*****************************************************************************
+// CLASS:  WinMTREngine
+//
+//
+//*****************************************************************************
+
+class WinMTREngine {
+	typedef HANDLE (WINAPI *LPFNICMPCREATEFILE)(VOID);
+	typedef BOOL  (WINAPI *LPFNICMPCLOSEHANDLE)(HANDLE);
+	typedef VOID  (NTAPI *LPFNICMPAPCROUTINE)(PVOID, PVOID, ULONG);
+	typedef DWORD (WINAPI *LPFNICMPSENDECHO2)(HANDLE, HANDLE, LPFNICMPAPCROUTINE, PVOID, u_long, LPVOID, WORD, LPVOID, LPVOID, DWORD, DWORD);
+	typedef DWORD (WINAPI *LPFNICMPPARSEREPLIES)(LPVOID, DWORD);
+
+	friend class WinMTRIcmp;
+	friend unsigned __stdcall WorkerThread(void *p);
+
+public:
+
+	WinMTREngine(int workers, const char *simfile);
+	~WinMTREngine();
+
+	bool	IsInitialized();
+	int		GetWorkers();
+	void	GetMetrics(WinMTRMetrics *m);
+	// pps of 0 for no limit, burst probes may go back to back
+	void	SetRate(float pps, int burst);
+	void	Submit(WinMTRNet *net, int address);
+	void	Complete(probe_req *req);
+
+private:
+	static void	AddTask(engine_worker *w, probe_task *task);
+	static void	RemoveTask(engine_worker *w, probe_task *task);
+	void	RunTask(engine_worker *w, probe_task *task);
+	void	Schedule(engine_worker *w);
+	bool	SendProbe(engine_worker *w, probe_task *task);
+	void	Expire(probe_task *task);
+	void	Account(probe_req *req, DWORD replies);
+	void	FinishTask(engine_worker *w, probe_task *task);
+	bool	Steal(engine_worker *w);
+	bool	TakeToken(DWORD now, DWORD *next);
+
+private:
+	bool				initialized;
+	volatile bool		shutdown;
+	int					nworkers;
+	int					nextWorker;
+	engine_worker		worker[MAX_WORKERS];
+	CRITICAL_SECTION	submitLock;
+	CRITICAL_SECTION	rateLock;		// guards the token bucket
+	double				rate;			// probes per ms, 0 for no limit
+	double				burst;
+	double				tokens;
+	DWORD				refilled;		// GetTickCount() of the last refill
+	WinMTRSimPath		*simpath;
+	LONGLONG			frequency;		// performance counter
+	char				payload[MAXPACKET];
+
+	HINSTANCE			hICMP_DLL;
+	LPFNICMPCREATEFILE	lpfnIcmpCreateFile;
+	LPFNICMPCLOSEHANDLE lpfnIcmpCloseHandle;
+	LPFNICMPSENDECHO2	lpfnIcmpSendEcho2;
+	LPFNICMPPARSEREPLIES lpfnIcmpParseReplies;
+};
+
+#endif	// ifndef WINMTRENGINE_H_
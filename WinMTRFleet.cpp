@@ -0,0 +1,317 @@
+//*****************************************************************************
+// FILE:            WinMTRFleet.cpp
+//
+//
+//*****************************************************************************
+
+#include "WinMTRFleet.h"
+#include <algorithm>
+#include <functional>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define FLEET_AVX2
+#endif
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#include <emmintrin.h>
+#define FLEET_SSE2
+#endif
+
+typedef std::pair<float, int> ranked;
+
+//*****************************************************************************
+// WinMTRFleet::WinMTRFleet
+//
+//*****************************************************************************
+WinMTRFleet::WinMTRFleet()
+	: targets(0)
+{
+}
+
+//*****************************************************************************
+// WinMTRFleet::Add
+//
+// Appends the hops of one trace.
+//*****************************************************************************
+void WinMTRFleet::Add(__int32 targetAddr, const s_widehop *hop, int hops)
+{
+	targets++;
+	for (int at = 0; at < hops; at++) {
+		target.push_back(targetAddr);
+		addr.push_back(hop[at].addr);
+		ttl.push_back((unsigned char)(at + 1));
+		xmit.push_back(hop[at].xmit);
+		returned.push_back(hop[at].returned);
+		avg.push_back(hop[at].avg);
+	}
+	if (hops > 0 && hop[hops - 1].addr == targetAddr && hop[hops - 1].returned > 0)
+		dest.push_back(hop[hops - 1].avg);
+}
+
+//*****************************************************************************
+// WinMTRFleet::GetHops
+//
+//*****************************************************************************
+size_t WinMTRFleet::GetHops()
+{
+	return addr.size();
+}
+
+//*****************************************************************************
+// WinMTRFleet::Render
+//
+//*****************************************************************************
+void WinMTRFleet::Render(std::string& out, WinMTRIntern *intern, int top)
+{
+	size_t n = addr.size();
+	std::vector<float> loss(n), weighted(n);
+	std::vector<int> index;
+	char buf[512], name[256], to[256];
+
+	if (n > 0) {
+		ComputeLoss(&xmit[0], &returned[0], &loss[0], n);
+		Multiply(&avg[0], &returned[0], &weighted[0], n);
+	}
+
+	__int64 sent = n ? Sum(&xmit[0], n) : 0;
+	__int64 got = n ? Sum(&returned[0], n) : 0;
+	_snprintf(buf, sizeof(buf), "FLEET: %d targets, %d hops, %.0f sent, %.1f%% loss\n",
+		targets, (int)n, (double)sent, sent ? 100.0 - 100.0 * got / sent : 0.0);
+	out += buf;
+
+	if (!dest.empty()) {
+		std::vector<float> d(dest);
+		const int p[] = { 50, 90, 99 };
+		float v[3];
+		for (int i = 0; i < 3; i++) {
+			size_t rank = (d.size() * p[i] + 99) / 100 - 1;
+			std::nth_element(d.begin(), d.begin() + rank, d.end());
+			v[i] = d[rank];
+		}
+		_snprintf(buf, sizeof(buf), "TARGET RTT: %d answered, p50 %.1f, p90 %.1f, p99 %.1f ms\n",
+			(int)d.size(), v[0], v[1], v[2]);
+		out += buf;
+	}
+
+	out += "WORST LOSS:\n";
+	if (n > 0)
+		TopK(&loss[0], n, top, index);
+	for (size_t i = 0; i < index.size(); i++) {
+		int h = index[i];
+		if (loss[h] <= 0)
+			break;
+		FormatAddr(name, sizeof(name), addr[h], intern);
+		FormatAddr(to, sizeof(to), target[h], intern);
+		_snprintf(buf, sizeof(buf), "  %-30s ttl %2d %5.1f%% %5d sent  to %s\n",
+			name, ttl[h], loss[h], xmit[h], to);
+		out += buf;
+	}
+
+	// average RTT per hop address, weighted by the replies of each trace
+	std::vector<std::pair<__int32, int> > order;
+	order.reserve(n);
+	for (size_t i = 0; i < n; i++)
+		if (addr[i] != 0 && returned[i] > 0)
+			order.push_back(std::make_pair(addr[i], (int)i));
+	std::sort(order.begin(), order.end());
+
+	std::vector<__int32> groupAddr;
+	std::vector<float> groupAvg;
+	std::vector<int> groupHops;
+	for (size_t i = 0; i < order.size(); ) {
+		double sum = 0;
+		__int64 count = 0;
+		size_t j = i;
+		for (; j < order.size() && order[j].first == order[i].first; j++) {
+			sum += weighted[order[j].second];
+			count += returned[order[j].second];
+		}
+		groupAddr.push_back(order[i].first);
+		groupAvg.push_back((float)(sum / count));
+		groupHops.push_back((int)(j - i));
+		i = j;
+	}
+
+	out += "SLOWEST ADDRESSES:\n";
+	if (!groupAvg.empty())
+		TopK(&groupAvg[0], groupAvg.size(), top, index);
+	else
+		index.clear();
+	for (size_t i = 0; i < index.size(); i++) {
+		int g = index[i];
+		FormatAddr(name, sizeof(name), groupAddr[g], intern);
+		_snprintf(buf, sizeof(buf), "  %-30s %7.1f ms %5d hops\n",
+			name, groupAvg[g], groupHops[g]);
+		out += buf;
+	}
+}
+
+//*****************************************************************************
+// WinMTRFleet::FormatAddr
+//
+//*****************************************************************************
+void WinMTRFleet::FormatAddr(char *buf, size_t size, __int32 a, WinMTRIntern *intern)
+{
+	if (a == 0) {
+		_snprintf(buf, size, "???");
+		return;
+	}
+	if (intern->GetName(a, buf, size))
+		return;
+
+	int h = ntohl(a);
+	_snprintf(buf, size, "%d.%d.%d.%d", (h >> 24) & 0xff, (h >> 16) & 0xff,
+		(h >> 8) & 0xff, h & 0xff);
+}
+
+//*****************************************************************************
+// WinMTRFleet::ComputeLoss
+//
+// Loss in percent, computed like WinMTRNet::GetPercent, 0 if nothing was
+// sent.
+//*****************************************************************************
+void WinMTRFleet::ComputeLoss(const int *x, const int *r, float *loss, size_t n)
+{
+	size_t i = 0;
+
+#if defined(FLEET_AVX2)
+	const __m256 hundred8 = _mm256_set1_ps(100.0f);
+	const __m256i zero8 = _mm256_setzero_si256();
+	for (; i + 8 <= n; i += 8) {
+		__m256i vx = _mm256_loadu_si256((const __m256i*)(x + i));
+		__m256i vr = _mm256_loadu_si256((const __m256i*)(r + i));
+		__m256 none = _mm256_castsi256_ps(_mm256_cmpeq_epi32(vx, zero8));
+		__m256 part = _mm256_div_ps(_mm256_mul_ps(hundred8, _mm256_cvtepi32_ps(vr)),
+			_mm256_cvtepi32_ps(vx));
+		_mm256_storeu_ps(loss + i, _mm256_andnot_ps(none, _mm256_sub_ps(hundred8, part)));
+	}
+#endif
+#if defined(FLEET_SSE2)
+	const __m128 hundred = _mm_set1_ps(100.0f);
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + 4 <= n; i += 4) {
+		__m128i vx = _mm_loadu_si128((const __m128i*)(x + i));
+		__m128i vr = _mm_loadu_si128((const __m128i*)(r + i));
+		__m128 none = _mm_castsi128_ps(_mm_cmpeq_epi32(vx, zero));
+		__m128 part = _mm_div_ps(_mm_mul_ps(hundred, _mm_cvtepi32_ps(vr)), _mm_cvtepi32_ps(vx));
+		_mm_storeu_ps(loss + i, _mm_andnot_ps(none, _mm_sub_ps(hundred, part)));
+	}
+#endif
+	for (; i < n; i++)
+		loss[i] = x[i] ? 100.0f - (100.0f * r[i] / x[i]) : 0.0f;
+}
+
+//*****************************************************************************
+// WinMTRFleet::Multiply
+//
+//*****************************************************************************
+void WinMTRFleet::Multiply(const float *a, const int *b, float *product, size_t n)
+{
+	size_t i = 0;
+
+#if defined(FLEET_AVX2)
+	for (; i + 8 <= n; i += 8) {
+		__m256 vb = _mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i*)(b + i)));
+		_mm256_storeu_ps(product + i, _mm256_mul_ps(_mm256_loadu_ps(a + i), vb));
+	}
+#endif
+#if defined(FLEET_SSE2)
+	for (; i + 4 <= n; i += 4) {
+		__m128 vb = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(b + i)));
+		_mm_storeu_ps(product + i, _mm_mul_ps(_mm_loadu_ps(a + i), vb));
+	}
+#endif
+	for (; i < n; i++)
+		product[i] = a[i] * b[i];
+}
+
+//*****************************************************************************
+// WinMTRFleet::FindAbove
+//
+// The index of the first value after 'from' above threshold, n if none.
+//*****************************************************************************
+size_t WinMTRFleet::FindAbove(const float *v, size_t from, size_t n, float threshold)
+{
+	size_t i = from;
+
+#if defined(FLEET_AVX2)
+	const __m256 t8 = _mm256_set1_ps(threshold);
+	for (; i + 8 <= n; i += 8)
+		if (_mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(v + i), t8, _CMP_GT_OQ)))
+			break;
+#endif
+#if defined(FLEET_SSE2)
+	const __m128 t = _mm_set1_ps(threshold);
+	for (; i + 4 <= n; i += 4)
+		if (_mm_movemask_ps(_mm_cmpgt_ps(_mm_loadu_ps(v + i), t)))
+			break;
+#endif
+	for (; i < n; i++)
+		if (v[i] > threshold)
+			return i;
+	return n;
+}
+
+//*****************************************************************************
+// WinMTRFleet::Sum
+//
+// The values must not be negative.
+//*****************************************************************************
+__int64 WinMTRFleet::Sum(const int *v, size_t n)
+{
+	__int64 sum = 0;
+	size_t i = 0;
+
+#if defined(FLEET_SSE2)
+	const __m128i zero = _mm_setzero_si128();
+	__m128i acc = _mm_setzero_si128();
+	for (; i + 4 <= n; i += 4) {
+		__m128i x = _mm_loadu_si128((const __m128i*)(v + i));
+		acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(x, zero));
+		acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(x, zero));
+	}
+	__int64 lanes[2];
+	_mm_storeu_si128((__m128i*)lanes, acc);
+	sum = lanes[0] + lanes[1];
+#endif
+	for (; i < n; i++)
+		sum += v[i];
+	return sum;
+}
+
+//*****************************************************************************
+// WinMTRFleet::TopK
+//
+// The indexes of the k largest values, largest first.
+//*****************************************************************************
+void WinMTRFleet::TopK(const float *v, size_t n, int k, std::vector<int>& index)
+{
+	std::vector<ranked> heap;
+	std::greater<ranked> later;
+	size_t i = 0;
+
+	index.clear();
+	if (k > (int)n)
+		k = (int)n;
+	if (k <= 0)
+		return;
+
+	heap.reserve(k);
+	for (; i < n && (int)heap.size() < k; i++) {
+		heap.push_back(ranked(v[i], (int)i));
+		std::push_heap(heap.begin(), heap.end(), later);
+	}
+
+	// the smallest of the k kept so far is on top
+	while ((i = FindAbove(v, i, n, heap.front().first)) < n) {
+		std::pop_heap(heap.begin(), heap.end(), later);
+		heap.back() = ranked(v[i], (int)i);
+		std::push_heap(heap.begin(), heap.end(), later);
+		i++;
+	}
+
+	std::sort_heap(heap.begin(), heap.end(), later);
+	for (size_t j = 0; j < heap.size(); j++)
+		index.push_back(heap[j].second);
+}
@@ -0,0 +1,62 @@
+//*****************************************************************************
+// FILE:            WinMTRFleet.h
+//
+//
+// DESCRIPTION: The WinMTRFleet class summarizes the results of many
+//              traces: overall loss, the percentiles of the RTT to the
+//              targets, the hops with the most loss and the hop addresses
+//              with the highest average RTT across all targets.
+//
+//
+// NOTES: The hops are kept in columns, one array per statistic, so the
+//        reductions run over contiguous memory with SSE2 kernels, AVX2
+//        when the compiler targets it, and a scalar loop otherwise. The
+//        top N lists are kept in a min heap of N entries, blocks of values
+//        that cannot enter it are skipped with one compare per vector.
+//
+//*****************************************************************************
+
+#ifndef WINMTRFLEET_H_
+#define WINMTRFLEET_H_
+
+#include "WinMTRGlobal.h"
+#include "WinMTRCompact.h"
+#include <vector>
+
+#define FLEET_TOP		10		// default length of the top lists
+
+//*****************************************************************************
+// CLASS:  WinMTRFleet
+//
+//
+//*****************************************************************************
+
+class WinMTRFleet {
+public:
+	WinMTRFleet();
+
+	void	Add(__int32 target, const s_widehop *hop, int hops);
+	void	Render(std::string& out, WinMTRIntern *intern, int top);
+	size_t	GetHops();
+
+	static void		ComputeLoss(const int *xmit, const int *returned, float *loss, size_t n);
+	static void		Multiply(const float *a, const int *b, float *product, size_t n);
+	static size_t	FindAbove(const float *v, size_t from, size_t n, float threshold);
+	static __int64	Sum(const int *v, size_t n);
+	static void		TopK(const float *v, size_t n, int k, std::vector<int>& index);
+
+private:
+	void	FormatAddr(char *buf, size_t size, __int32 addr, WinMTRIntern *intern);
+
+private:
+	int						targets;
+	std::vector<__int32>	target;		// per hop
+	std::vector<__int32>	addr;
+	std::vector<unsigned char> ttl;
+	std::vector<int>		xmit;
+	std::vector<int>		returned;
+	std::vector<float>		avg;
+	std::vector<float>		dest;		// per target that answered, average RTT
+};
+
+#endif	// ifndef WINMTRFLEET_H_
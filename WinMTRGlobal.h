@@ -52,13 +52,64 @@
 #define DEFAULT_INTERVAL	1.0
 #define DEFAULT_PING_SIZE	64
 #define DEFAULT_TIMEOUT		5.0
+#define DEFAULT_LATE		0.0		// s, replies after the timeout still credited
 #define DEFAULT_FIELDS		"LS NABWV"
+#define DEFAULT_WORKERS		0		// one per processor
+#define DEFAULT_CONFIDENCE	95.0	// percent, multipath discovery
+#define DEFAULT_RECORD		256		// KB per hop kept by --range without --record
+#define MAX_RECORD			65536	// KB per hop
+#define MAX_SECONDS			86400	// largest interval and timeout
+
+#define FAST_INTERVAL		0.1		// --fast defaults
+#define FAST_TIMEOUT		1.0
+#define FAST_WORKERS		1
+#define FAST_MIN_CYCLES		3		// probes per hop before a --fast trace may end
+#define FAST_RTT_ERROR		0.1		// settled standard error of the mean RTT, relative
+#define FAST_LOSS_ERROR		0.1		// settled standard error of the loss ratio
+
+#define CAPACITY_CYCLES		256		// --capacity defaults, the probe budget per hop
+#define CAPACITY_INTERVAL	0.1
+
+#define ADAPTIVE_CYCLES		1000	// --precision default, the mean probe budget per hop
+#define ADAPTIVE_MIN_CYCLES	20		// probes of a hop before it may converge
 
 #define MAX_HOPS				40
+#define MAX_WORKERS				64
+#define MAX_RESPONDERS			8		// per hop, more are only counted
+#define MAX_FLOWS				160		// multipath flow ids per hop
+#define STATS_BUCKETS			64		// RTT histogram, see WinMTRStats::Bucket
+#define PMTU_LANES				4		// --pmtu probes in flight per hop
+#define PMTU_HEADER				28		// IPv4 and ICMP echo headers
+#define PMTU_MIN				68		// smallest IPv4 MTU
+#define PMTU_MAX				(MAXPACKET + PMTU_HEADER)
+#define PMTU_TRIES				2		// unanswered probes before a size fails
+#define CAPACITY_SIZES			8		// --capacity payload sizes per hop
+#define CAPACITY_MAX_SIZE		1472	// largest payload, fits a 1500 byte MTU
+#define CAPACITY_STABLE			3		// rounds without a new minimum RTT before a hop is done
+#define CAPACITY_RESOLUTION		50		// us, a smaller drop of a minimum RTT is not new
+#define TRAIN_MAX				64		// --train probes per TTL and cycle
+#define TRAIN_SPACING			10		// ms between the probes of a train to one TTL
+#define TRAIN_SLOTS				16		// trains per hop still waiting for replies
+#define RTO_MIN					100		// ms, --rto floor, --timeout is the ceiling
+#define RTO_INITIAL				1000	// ms, before any hop answered
+#define RTO_GRANULARITY			10		// ms, least variation allowed for
+#define RTO_GRACE				2		// probes are counted lost after this many RTOs
+#define POLICE_LEVELS			4		// --police probe rates per hop, each half the one before
+#define POLICE_MIN_PROBES		10		// probes at a rate between two tests of a hop
+#define POLICE_TEST_PROBES		20		// probes at the lowest rate before loss is taken as rate independent
+#define MAX_TOS					4		// --tos classes probed side by side
 
 #define MAXPACKET 4096
 #define MINPACKET 64
 
 #define CLS() system("cls")
 
+typedef ip_option_information IPINFO, *PIPINFO, FAR *LPIPINFO;
+
+#ifdef _WIN64
+typedef icmp_echo_reply32 ICMPECHO, *PICMPECHO, FAR *LPICMPECHO;
+#else
+typedef icmp_echo_reply ICMPECHO, *PICMPECHO, FAR *LPICMPECHO;
+#endif
+
 #endif // ifndef GLOBAL_H_
@@ -0,0 +1,238 @@
+//*****************************************************************************
+// FILE:            WinMTRLib.cpp
+//
+//
+//*****************************************************************************
+
+#include "WinMTRGlobal.h"
+#include "WinMTRLib.h"
+#include "WinMTREngine.h"
+#include "WinMTRNet.h"
+#include "WinMTRParams.h"
+
+struct wmtr_engine {
+	WinMTREngine	*engine;
+};
+
+struct wmtr_trace {
+	WinMTRParams	params;
+	WinMTRNet		*net;
+	int				addr;
+	HANDLE			hThread;
+};
+
+static unsigned __stdcall TraceThread(void *p);
+
+//*****************************************************************************
+// wmtr_engine_create
+//
+//*****************************************************************************
+wmtr_engine *wmtr_engine_create(int workers)
+{
+	if (workers < 0 || workers > MAX_WORKERS)
+		return NULL;
+
+	wmtr_engine *e = new wmtr_engine;
+	e->engine = new WinMTREngine(workers, NULL);
+	if (!e->engine->IsInitialized()) {
+		wmtr_engine_destroy(e);
+		return NULL;
+	}
+	return e;
+}
+
+//*****************************************************************************
+// wmtr_engine_destroy
+//
+// All traces of the engine have to be destroyed first.
+//*****************************************************************************
+void wmtr_engine_destroy(wmtr_engine *engine)
+{
+	delete engine->engine;
+	delete engine;
+}
+
+//*****************************************************************************
+// wmtr_options_init
+//
+//*****************************************************************************
+void wmtr_options_init(wmtr_options *options)
+{
+	options->cycles = DEFAULT_CYCLES;
+	options->interval = DEFAULT_INTERVAL;
+	options->size = DEFAULT_PING_SIZE;
+	options->timeout = DEFAULT_TIMEOUT;
+	options->use_dns = DEFAULT_DNS;
+}
+
+//*****************************************************************************
+// wmtr_trace_create
+//
+// options NULL for the defaults of wmtr_options_init. The options are
+// checked against the ranges WinMTRCmd::ValidateParams allows.
+//*****************************************************************************
+wmtr_trace *wmtr_trace_create(wmtr_engine *engine, const char *host,
+				const wmtr_options *options, wmtr_probe_callback callback, void *context)
+{
+	wmtr_options defaults;
+
+	if (options == NULL) {
+		wmtr_options_init(&defaults);
+		options = &defaults;
+	}
+	// written so that NaN fails too
+	if (options->cycles < 1 || options->size < MINPACKET || options->size > MAXPACKET ||
+			!(options->interval >= 0 && options->interval <= MAX_SECONDS) ||
+			!(options->timeout > 0 && options->timeout <= MAX_SECONDS))
+		return NULL;
+
+	int addr = WinMTRNet::ResolveAddr(host);
+	if (addr == INADDR_NONE)
+		return NULL;
+
+	wmtr_trace *t = new wmtr_trace;
+	t->params.SetHostName(host);
+	t->params.SetCycles(options->cycles);
+	t->params.SetInterval(options->interval);
+	t->params.SetPingSize(options->size);
+	t->params.SetTimeout(options->timeout);
+	t->params.SetUseDNS(options->use_dns != 0);
+	t->params.SetWide(DEFAULT_WIDE);
+	t->params.SetFields(DEFAULT_FIELDS);
+	t->addr = addr;
+	t->hThread = NULL;
+	t->net = new WinMTRNet(&t->params, engine->engine);
+	t->net->SetProbeCallback(callback, context);
+	return t;
+}
+
+//*****************************************************************************
+// wmtr_trace_set_event_callback
+//
+//*****************************************************************************
+void wmtr_trace_set_event_callback(wmtr_trace *trace,
+				wmtr_event_callback callback, void *context)
+{
+	trace->net->SetEventCallback(callback, context);
+}
+
+//*****************************************************************************
+// wmtr_trace_start
+//
+// Returns 0 if the trace is already running or cannot be started.
+//*****************************************************************************
+int wmtr_trace_start(wmtr_trace *trace)
+{
+	if (trace->hThread) {
+		if (WaitForSingleObject(trace->hThread, 0) != WAIT_OBJECT_0)
+			return 0;
+		CloseHandle(trace->hThread);
+	}
+
+	trace->hThread = (HANDLE)_beginthreadex(NULL, 0, TraceThread, trace, 0, NULL);
+	return trace->hThread != NULL;
+}
+
+//*****************************************************************************
+// wmtr_trace_stop
+//
+// Probes in flight still complete, use wmtr_trace_wait to wait for them.
+//*****************************************************************************
+void wmtr_trace_stop(wmtr_trace *trace)
+{
+	trace->net->StopTrace();
+}
+
+//*****************************************************************************
+// wmtr_trace_wait
+//
+//*****************************************************************************
+int wmtr_trace_wait(wmtr_trace *trace, unsigned long timeout_ms)
+{
+	if (!trace->hThread)
+		return 1;
+	return WaitForSingleObject(trace->hThread, timeout_ms) == WAIT_OBJECT_0;
+}
+
+//*****************************************************************************
+// wmtr_trace_hops
+//
+//*****************************************************************************
+int wmtr_trace_hops(wmtr_trace *trace)
+{
+	return trace->net->GetMax();
+}
+
+//*****************************************************************************
+// wmtr_trace_hop
+//
+// Returns 0 if 'at' is out of range. Can be called while the trace runs.
+//*****************************************************************************
+int wmtr_trace_hop(wmtr_trace *trace, int at, wmtr_hop *hop)
+{
+	WinMTRNet *net = trace->net;
+
+	if (at < 0 || at >= MAX_HOPS)
+		return 0;
+
+	hop->addr = htonl(net->GetAddr(at));
+	net->GetName(at, hop->name);
+	hop->xmit = net->GetXmit(at);
+	hop->returned = net->GetReturned(at);
+	hop->last = net->GetLast(at);
+	hop->best = net->GetBest(at);
+	hop->worst = net->GetWorst(at);
+	hop->avg = net->GetAvg(at);
+	hop->stdev = net->GetStDev(at);
+	hop->loss = net->GetPercent(at);
+	hop->responders = net->GetResponders(at);
+	return 1;
+}
+
+//*****************************************************************************
+// wmtr_trace_responder
+//
+// Returns 0 if there is no responder 'index' at hop 'at'.
+//*****************************************************************************
+int wmtr_trace_responder(wmtr_trace *trace, int at, int index, wmtr_responder *responder)
+{
+	s_responder r;
+
+	if (at < 0 || at >= MAX_HOPS || !trace->net->GetResponder(at, index, &r))
+		return 0;
+
+	responder->addr = r.addr;
+	responder->returned = r.returned;
+	responder->last = r.last;
+	responder->best = r.best;
+	responder->worst = r.worst;
+	responder->avg = r.avg;
+	return 1;
+}
+
+//*****************************************************************************
+// wmtr_trace_destroy
+//
+//*****************************************************************************
+void wmtr_trace_destroy(wmtr_trace *trace)
+{
+	if (trace->hThread) {
+		trace->net->StopTrace();
+		WaitForSingleObject(trace->hThread, INFINITE);
+		CloseHandle(trace->hThread);
+	}
+	delete trace->net;
+	delete trace;
+}
+
+//*****************************************************************************
+// TraceThread
+//
+//*****************************************************************************
+static unsigned __stdcall TraceThread(void *p)
+{
+	wmtr_trace *trace = (wmtr_trace*)p;
+
+	trace->net->DoTrace(trace->addr, false);
+	return 0;
+}
@@ -0,0 +1,117 @@
+/*****************************************************************************
+ * FILE:            WinMTRLib.h
+ *
+ *
+ * DESCRIPTION: The C interface of the WinMTR probing library.
+ *
+ *
+ * NOTES: An engine owns the probe worker threads and can run any number of
+ *        traces at once. A trace reports every completed probe, and every
+ *        detected shift in the RTT or loss of a hop, through callbacks which
+ *        run on an engine worker thread: they must return quickly and must
+ *        not destroy the trace. C++ code can use WinMTREngine and WinMTRNet
+ *        directly, with the same callback types.
+ *
+ *****************************************************************************/
+
+#ifndef WINMTRLIB_H_
+#define WINMTRLIB_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct wmtr_engine wmtr_engine;
+typedef struct wmtr_trace wmtr_trace;
+
+typedef struct wmtr_probe_result {
+	unsigned long	target;			/* IPv4 address, network byte order */
+	int				ttl;
+	int				cycle;			/* 1 for the first probe of the TTL */
+	unsigned long	status;			/* IP_* status, IP_REQ_TIMED_OUT without reply */
+	unsigned long	rtt;			/* ms, 0 without reply */
+	unsigned long	responder;		/* IPv4 address, network byte order, 0 without reply */
+} wmtr_probe_result;
+
+typedef void (*wmtr_probe_callback)(const wmtr_probe_result *result, void *context);
+
+enum {
+	WMTR_EVENT_RTT_UP = 1,
+	WMTR_EVENT_RTT_DOWN,
+	WMTR_EVENT_LOSS_UP,
+	WMTR_EVENT_LOSS_DOWN,
+	WMTR_EVENT_NEW_RESPONDER
+};
+
+typedef struct wmtr_event {
+	unsigned long	target;			/* IPv4 address, network byte order */
+	int				ttl;
+	int				kind;			/* WMTR_EVENT_* */
+	float			before;			/* baseline, ms or loss percent, responders before */
+	float			after;			/* estimated new level, same unit, responders after */
+	unsigned long	responder;		/* new responder, network byte order, else 0 */
+	unsigned long long	time;		/* ms since 1970-01-01 UTC */
+} wmtr_event;
+
+typedef void (*wmtr_event_callback)(const wmtr_event *event, void *context);
+
+typedef struct wmtr_options {
+	int				cycles;
+	float			interval;		/* seconds */
+	int				size;			/* bytes */
+	float			timeout;		/* seconds */
+	int				use_dns;
+} wmtr_options;
+
+typedef struct wmtr_hop {
+	unsigned long	addr;			/* IPv4 address, network byte order */
+	char			name[256];
+	int				xmit;
+	int				returned;
+	int				last;
+	int				best;
+	int				worst;
+	float			avg;
+	float			stdev;
+	float			loss;			/* percent */
+	int				responders;		/* distinct addresses that answered */
+} wmtr_hop;
+
+typedef struct wmtr_responder {
+	unsigned long	addr;			/* IPv4 address, network byte order */
+	int				returned;
+	int				last;
+	int				best;
+	int				worst;
+	float			avg;
+} wmtr_responder;
+
+/* workers == 0 starts one worker per processor */
+wmtr_engine	*wmtr_engine_create(int workers);
+void		wmtr_engine_destroy(wmtr_engine *engine);
+
+void		wmtr_options_init(wmtr_options *options);
+
+/* options NULL for the defaults, returns NULL if the host cannot be resolved
+   or an option is out of range: cycles >= 1, size 64 to 4096 bytes, interval
+   0 to 86400 s and timeout above 0 up to 86400 s */
+wmtr_trace	*wmtr_trace_create(wmtr_engine *engine, const char *host,
+				const wmtr_options *options, wmtr_probe_callback callback, void *context);
+/* turns on change detection on RTT and loss of every hop, set before starting */
+void		wmtr_trace_set_event_callback(wmtr_trace *trace,
+				wmtr_event_callback callback, void *context);
+int			wmtr_trace_start(wmtr_trace *trace);
+void		wmtr_trace_stop(wmtr_trace *trace);
+/* returns 1 once the trace has finished, 0 on timeout */
+int			wmtr_trace_wait(wmtr_trace *trace, unsigned long timeout_ms);
+int			wmtr_trace_hops(wmtr_trace *trace);
+int			wmtr_trace_hop(wmtr_trace *trace, int at, wmtr_hop *hop);
+int			wmtr_trace_responder(wmtr_trace *trace, int at, int index, wmtr_responder *responder);
+/* stops the trace and waits for it to finish */
+void		wmtr_trace_destroy(wmtr_trace *trace);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* ifndef WINMTRLIB_H_ */
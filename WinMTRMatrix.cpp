@@ -0,0 +1,203 @@
+//*****************************************************************************
+// FILE:            WinMTRMatrix.cpp
+//
+//
+//*****************************************************************************
+
+#include "WinMTRMatrix.h"
+
+#define MATRIX_BIT(i)		((unsigned __int64)1 << (i))
+
+//*****************************************************************************
+// WinMTRMatrix::WinMTRMatrix
+//
+//*****************************************************************************
+WinMTRMatrix::WinMTRMatrix(int c)
+	: cycles(c), words((c + MATRIX_WORD_BITS - 1) / MATRIX_WORD_BITS),
+	  sent((size_t)words * MAX_HOPS, 0), lost((size_t)words * MAX_HOPS, 0)
+{
+}
+
+//*****************************************************************************
+// WinMTRMatrix::PopCount
+//
+// The set bits of x, by adding neighbouring fields of 1, 2, 4 and then 8
+// bits. The projects build for SSE2 at most, where POPCNT is not there.
+//*****************************************************************************
+int WinMTRMatrix::PopCount(unsigned __int64 x)
+{
+	x = x - ((x >> 1) & 0x5555555555555555ULL);
+	x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+	x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+	return (int)((x * 0x0101010101010101ULL) >> 56);
+}
+
+//*****************************************************************************
+// WinMTRMatrix::Record
+//
+//*****************************************************************************
+void WinMTRMatrix::Record(int at, int cycle, bool isLost)
+{
+	if (cycle < 0 || cycle >= cycles)
+		return;
+
+	size_t i = (size_t)(cycle / MATRIX_WORD_BITS) * MAX_HOPS + at;
+	unsigned __int64 bit = MATRIX_BIT(cycle % MATRIX_WORD_BITS);
+	sent[i] |= bit;
+	if (isLost)
+		lost[i] |= bit;
+	else
+		lost[i] &= ~bit;
+}
+
+//*****************************************************************************
+// WinMTRMatrix::Credit
+//
+//*****************************************************************************
+void WinMTRMatrix::Credit(int at, int cycle)
+{
+	if (cycle < 0 || cycle >= cycles)
+		return;
+
+	lost[(size_t)(cycle / MATRIX_WORD_BITS) * MAX_HOPS + at] &= ~MATRIX_BIT(cycle % MATRIX_WORD_BITS);
+}
+
+//*****************************************************************************
+// WinMTRMatrix::Analyze
+//
+// Hops that never answered are left out, the last hop up to target that
+// did is the target then. Only the cycles probed to all other hops up to
+// it count, so every hop is compared over the same cycles. A loss at the
+// target is counted at the hop where the run of lost hops ending at the
+// target starts, the first hop of the path if the run covers them all.
+// Runs only go through hops whose loss is correlated with that of the
+// target at the normal quantile z, a hop that just does not answer now and
+// then would otherwise be taken for the origin of what it happens to
+// share with the target.
+//*****************************************************************************
+int WinMTRMatrix::Analyze(int target, double z, s_lockhop *hop, int *targetLost)
+{
+	int prev[MAX_HOPS];
+	int n = 0, nTarget = 0;
+	int n1[MAX_HOPS], n11[MAX_HOPS];
+
+	memset(hop, 0, (target + 1) * sizeof(s_lockhop));
+	memset(n1, 0, sizeof(n1));
+	memset(n11, 0, sizeof(n11));
+	*targetLost = 0;
+
+	for (int w = 0; w < words; w++) {
+		const unsigned __int64 *s = &sent[(size_t)w * MAX_HOPS];
+		const unsigned __int64 *l = &lost[(size_t)w * MAX_HOPS];
+		for (int at = 0; at <= target; at++) {
+			hop[at].sent += PopCount(s[at]);
+			hop[at].lost += PopCount(l[at] & s[at]);
+		}
+	}
+
+	int last = -1;
+	for (int at = 0; at <= target; at++) {
+		hop[at].silent = (hop[at].sent == 0 || hop[at].lost == hop[at].sent);
+		prev[at] = last;
+		if (!hop[at].silent)
+			last = at;
+	}
+	if (last < 0)
+		return 0;
+	target = last;
+
+	for (int w = 0; w < words; w++) {
+		const unsigned __int64 *s = &sent[(size_t)w * MAX_HOPS];
+		const unsigned __int64 *l = &lost[(size_t)w * MAX_HOPS];
+		unsigned __int64 valid = Valid(s, target, hop);
+		if (valid == 0)
+			continue;
+		unsigned __int64 lostTarget = l[target] & valid;
+		n += PopCount(valid);
+		nTarget += PopCount(lostTarget);
+
+		for (int at = 0; at <= target; at++) {
+			if (hop[at].silent)
+				continue;
+			unsigned __int64 lh = l[at] & valid;
+			unsigned __int64 ok = valid;
+			if (prev[at] >= 0)
+				ok &= ~l[prev[at]];
+			n1[at] += PopCount(lh);
+			n11[at] += PopCount(lh & lostTarget);
+			hop[at].condSent += PopCount(ok);
+			hop[at].cond += PopCount(lh & ok);
+		}
+	}
+
+	last = -1;
+	for (int at = 0; at <= target; at++) {
+		if (hop[at].silent)
+			continue;
+		hop[at].sent = n;
+		hop[at].lost = n1[at];
+		double d = (double)n1[at] * (n - n1[at]) * nTarget * (n - nTarget);
+		if (d > 0)
+			hop[at].corr = (float)(((double)n * n11[at] - (double)n1[at] * nTarget) / sqrt(d));
+		// phi^2 * n is the chi-square of the 2 x 2 table, one degree of freedom
+		hop[at].linked = (at == target || hop[at].corr * sqrt((double)n) > z);
+		prev[at] = last;
+		if (hop[at].linked)
+			last = at;
+	}
+
+	for (int w = 0; w < words; w++) {
+		const unsigned __int64 *s = &sent[(size_t)w * MAX_HOPS];
+		const unsigned __int64 *l = &lost[(size_t)w * MAX_HOPS];
+		unsigned __int64 valid = Valid(s, target, hop);
+
+		// from the target back, chain is the cycles lost by every linked
+		// hop from at up to the target
+		unsigned __int64 chain = valid;
+		for (int at = target; at >= 0 && chain != 0; at--) {
+			if (!hop[at].linked)
+				continue;
+			chain &= l[at];
+			unsigned __int64 start = chain;
+			if (prev[at] >= 0)
+				start &= ~l[prev[at]];
+			hop[at].origin += PopCount(start);
+		}
+	}
+	*targetLost = nTarget;
+	return n;
+}
+
+//*****************************************************************************
+// WinMTRMatrix::Valid
+//
+// The cycles of a word that were probed to every hop up to target that
+// answered.
+//*****************************************************************************
+unsigned __int64 WinMTRMatrix::Valid(const unsigned __int64 *s, int target, const s_lockhop *hop)
+{
+	unsigned __int64 valid = ~(unsigned __int64)0;
+
+	for (int at = 0; at <= target; at++)
+		if (!hop[at].silent)
+			valid &= s[at];
+	return valid;
+}
+
+//*****************************************************************************
+// WinMTRMatrix::GetCycles
+//
+//*****************************************************************************
+int WinMTRMatrix::GetCycles()
+{
+	return cycles;
+}
+
+//*****************************************************************************
+// WinMTRMatrix::GetBytes
+//
+//*****************************************************************************
+size_t WinMTRMatrix::GetBytes()
+{
+	return (sent.size() + lost.size()) * sizeof(unsigned __int64);
+}
@@ -0,0 +1,78 @@
+//*****************************************************************************
+// FILE:            WinMTRMatrix.h
+//
+//
+// DESCRIPTION: The WinMTRMatrix class keeps the outcome of every probe of a
+//              --lockstep trace as a hop by cycle bit matrix and finds the
+//              hop where the loss seen at the target starts.
+//
+//
+// NOTES: Every hop has a sent and a lost bit per cycle. The matrix is
+//        stored column-major in words of 64 cycles: the words of all hops
+//        for cycles 64k to 64k + 63 follow each other, so a trace grows by
+//        one column of words and the analysis walks memory once. The
+//        analysis works on whole words, a handful of AND, ANDNOT and
+//        population counts per hop covers 64 cycles. Each word of a hop is
+//        only written by the worker that owns the hop, like its statistics,
+//        readers take no lock.
+//
+//        In lockstep the probes of one cycle to all TTLs go out at the same
+//        moment, so a drop on a link loses the probes to every hop behind
+//        it in that cycle, while ICMP that a hop does not send loses the
+//        probe to that hop alone. A loss at the target therefore starts at
+//        the first hop of the run of hops that lost the cycle up to it.
+//
+//*****************************************************************************
+
+#ifndef WINMTRMATRIX_H_
+#define WINMTRMATRIX_H_
+
+#include "WinMTRGlobal.h"
+#include <vector>
+
+#define MATRIX_WORD_BITS	64
+
+// the loss of one hop over the cycles it shares with the hops up to the target
+struct s_lockhop {
+	int sent;
+	int lost;
+	int cond;			// lost while the previous answering hop was not
+	int condSent;		// cycles the previous answering hop was not lost
+	int origin;			// losses at the target that start at this hop
+	float corr;			// phi coefficient of its loss and that of the target
+	bool silent;		// never answered, left out of the analysis
+	bool linked;		// its loss goes on to the target, part of the runs
+};
+
+//*****************************************************************************
+// CLASS:  WinMTRMatrix
+//
+//
+//*****************************************************************************
+
+class WinMTRMatrix {
+public:
+	WinMTRMatrix(int cycles);
+
+	// cycle counts from 0, cycles beyond the matrix are ignored
+	void	Record(int at, int cycle, bool lost);
+	// a late reply to a probe recorded lost
+	void	Credit(int at, int cycle);
+	// analyzes hops 0 to target, returns the cycles probed to all of them
+	int		Analyze(int target, double z, s_lockhop *hop, int *targetLost);
+	int		GetCycles();
+	size_t	GetBytes();
+
+	static int	PopCount(unsigned __int64 x);
+
+private:
+	static unsigned __int64	Valid(const unsigned __int64 *s, int target, const s_lockhop *hop);
+
+private:
+	int		cycles;
+	int		words;			// per hop
+	std::vector<unsigned __int64>	sent;	// words * MAX_HOPS, column-major
+	std::vector<unsigned __int64>	lost;
+};
+
+#endif	// ifndef WINMTRMATRIX_H_
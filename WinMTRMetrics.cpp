@@ -0,0 +1,154 @@
+//*****************************************************************************
+// FILE:            WinMTRMetrics.cpp
+//
+//
+//*****************************************************************************
+
+#include "WinMTRMetrics.h"
+
+bool WinMTRMetrics::enabled = false;
+LONGLONG WinMTRMetrics::frequency = 0;
+
+static const char *metricNames[METRIC_COUNT] = {
+	"send lag",
+	"lock wait",
+	"reply processing",
+	"resolver",
+	"render"
+};
+
+//*****************************************************************************
+// WinMTRMetrics::WinMTRMetrics
+//
+//*****************************************************************************
+WinMTRMetrics::WinMTRMetrics()
+{
+	Reset();
+}
+
+//*****************************************************************************
+// WinMTRMetrics::Enable
+//
+//*****************************************************************************
+void WinMTRMetrics::Enable(bool e)
+{
+	LARGE_INTEGER f;
+
+	QueryPerformanceFrequency(&f);
+	frequency = f.QuadPart;
+	enabled = e;
+}
+
+//*****************************************************************************
+// WinMTRMetrics::IsEnabled
+//
+//*****************************************************************************
+bool WinMTRMetrics::IsEnabled()
+{
+	return enabled;
+}
+
+//*****************************************************************************
+// WinMTRMetrics::Now
+//
+// Performance counter ticks, 0 while collection is off.
+//*****************************************************************************
+LONGLONG WinMTRMetrics::Now()
+{
+	LARGE_INTEGER now;
+
+	if (!enabled)
+		return 0;
+	QueryPerformanceCounter(&now);
+	return now.QuadPart;
+}
+
+//*****************************************************************************
+// WinMTRMetrics::Ticks
+//
+// Converts milliseconds to performance counter ticks.
+//*****************************************************************************
+LONGLONG WinMTRMetrics::Ticks(DWORD ms)
+{
+	return (LONGLONG)ms * frequency / 1000;
+}
+
+//*****************************************************************************
+// WinMTRMetrics::Reset
+//
+//*****************************************************************************
+void WinMTRMetrics::Reset()
+{
+	memset(metric, 0, sizeof(metric));
+}
+
+//*****************************************************************************
+// WinMTRMetrics::Add
+//
+// Records the interval between two Now() values, negative ones count as 0.
+//*****************************************************************************
+void WinMTRMetrics::Add(int m, LONGLONG start, LONGLONG end)
+{
+	if (!enabled)
+		return;
+
+	s_metric *sm = &metric[m];
+	ULONGLONG us = (end > start) ? (ULONGLONG)((end - start) * 1000000 / frequency) : 0;
+	int b = 0;
+
+	while (b < METRICS_BUCKETS - 1 && (us >> b) != 0)
+		b++;
+
+	sm->count++;
+	sm->total += us;
+	if (us > sm->worst)
+		sm->worst = us;
+	sm->bucket[b]++;
+}
+
+//*****************************************************************************
+// WinMTRMetrics::Merge
+//
+//*****************************************************************************
+void WinMTRMetrics::Merge(const WinMTRMetrics &m)
+{
+	for (int i = 0; i < METRIC_COUNT; i++) {
+		metric[i].count += m.metric[i].count;
+		metric[i].total += m.metric[i].total;
+		if (m.metric[i].worst > metric[i].worst)
+			metric[i].worst = m.metric[i].worst;
+		for (int b = 0; b < METRICS_BUCKETS; b++)
+			metric[i].bucket[b] += m.metric[i].bucket[b];
+	}
+}
+
+//*****************************************************************************
+// WinMTRMetrics::Print
+//
+// Bucket b of the histograms holds values below 2^b microseconds.
+//*****************************************************************************
+void WinMTRMetrics::Print(FILE *file)
+{
+	fprintf(file, "METRICS:              Count   Avg(us)   Max(us)\n");
+	for (int i = 0; i < METRIC_COUNT; i++) {
+		s_metric *sm = &metric[i];
+		fprintf(file, "  %-16s %10llu %9.1f %9llu\n", metricNames[i], sm->count,
+			sm->count ? (double)sm->total / sm->count : 0.0, sm->worst);
+	}
+
+	for (int i = 0; i < METRIC_COUNT; i++) {
+		s_metric *sm = &metric[i];
+		if (sm->count == 0)
+			continue;
+		fprintf(file, "  %s histogram (us):", metricNames[i]);
+		for (int b = 0; b < METRICS_BUCKETS; b++) {
+			if (sm->bucket[b] == 0)
+				continue;
+			if (b == METRICS_BUCKETS - 1)
+				fprintf(file, " >=%u:%llu", 1u << (b - 1), sm->bucket[b]);
+			else
+				fprintf(file, " <%u:%llu", 1u << b, sm->bucket[b]);
+		}
+		fprintf(file, "\n");
+	}
+}
@@ -0,0 +1,71 @@
+//*****************************************************************************
+// FILE:            WinMTRMetrics.h
+//
+//
+// DESCRIPTION: The WinMTRMetrics class collects timings of WinMTRCmd itself:
+//              how late probes are sent, lock waits, reply processing,
+//              reverse DNS lookups and report rendering.
+//
+//
+// NOTES: Collection is off unless --metrics is given. Every thread that
+//        records timings owns its own WinMTRMetrics, which are merged when
+//        the metrics are printed, so recording never takes a lock.
+//        Times are microseconds of the performance counter. Probes are
+//        scheduled on GetTickCount though, so the send lag, measured from
+//        the end of the previous reply plus the delay, includes rounding
+//        to the tick of 10 to 16 ms; probes the tick lets go early count
+//        as 0.
+//
+//*****************************************************************************
+
+#ifndef WINMTRMETRICS_H_
+#define WINMTRMETRICS_H_
+
+#include "WinMTRGlobal.h"
+
+#define METRICS_BUCKETS		24		// log2 microseconds, the last one open
+
+enum {
+	METRIC_SEND_LAG = 0,
+	METRIC_LOCK_WAIT,
+	METRIC_REPLY,
+	METRIC_RESOLVER,
+	METRIC_RENDER,
+	METRIC_COUNT
+};
+
+struct s_metric {
+	ULONGLONG	count;
+	ULONGLONG	total;					// us
+	ULONGLONG	worst;					// us
+	ULONGLONG	bucket[METRICS_BUCKETS];
+};
+
+//*****************************************************************************
+// CLASS:  WinMTRMetrics
+//
+//
+//*****************************************************************************
+
+class WinMTRMetrics {
+public:
+	WinMTRMetrics();
+
+	static void		Enable(bool e);
+	static bool		IsEnabled();
+	static LONGLONG	Now();
+	static LONGLONG	Ticks(DWORD ms);
+
+	void	Reset();
+	void	Add(int metric, LONGLONG start, LONGLONG end);
+	void	Merge(const WinMTRMetrics &m);
+	void	Print(FILE *file);
+
+private:
+	static bool		enabled;
+	static LONGLONG	frequency;
+
+	s_metric		metric[METRIC_COUNT];
+};
+
+#endif	// ifndef WINMTRMETRICS_H_
@@ -5,120 +5,131 @@
 #include "WinMTRGlobal.h"
 #include "WinMTRNet.h"
 #include "WinMTRParams.h"
-#include <sstream>
-
-#define TRACE_MSG(msg)										\
-	{														\
-	std::ostringstream dbg_msg(std::ostringstream::out);	\
-	dbg_msg << msg << std::endl;							\
-	OutputDebugString(dbg_msg.str().c_str());				\
-	}
-
-#define IPFLAG_DONT_FRAGMENT	0x02
-
-struct trace_thread {
-	int			address;
-	WinMTRNet	*winmtr;
-	int			ttl;
-};
+#include "WinMTREngine.h"
+#include "WinMTRSeries.h"
+#include "WinMTRMatrix.h"
+#include "WinMTRStats.h"
+#include "WinMTRTrace.h"
+#include <algorithm>
 
 struct dns_resolver_thread {
 	int			index;
 	WinMTRNet	*winmtr;
 };
 
-void FinishThread(void *p);
-void TraceThread(void *p);
 void DnsResolverThread(void *p);
 
-WinMTRNet::WinMTRNet(WinMTRParams *p) {
+WinMTRNet::WinMTRNet(WinMTRParams *p, WinMTREngine *e) {
 	
 	ghMutex = CreateMutex(NULL, FALSE, NULL);
+	hResolved = CreateEvent(NULL, TRUE, TRUE, NULL);
+	resolvers = 0;
+	hDone = CreateEvent(NULL, TRUE, TRUE, NULL);
+	activeTasks = 0;
+	probesSent = 0;
+	confidenceZ = 0;
+	lanes = 1;
+	for (int i = 0; i < MAX_HOPS; i++)
+		InitializeCriticalSection(&laneLock[i]);
 	tracing = false;
-	initialized = false;
+	settled = false;
 	wmtrparams = p;
-	WSADATA wsaData;
-
-    if( WSAStartup(MAKEWORD(2, 2), &wsaData) ) {
-		fprintf(stderr, "error: failed initializing windows sockets library\n");
-		return;
-    }
-
-    hICMP_DLL =  LoadLibrary(_T("ICMP.DLL"));
-    if (hICMP_DLL == 0) {
-		fprintf(stderr, "error: unable to locate ICMP.DLL\n");
-        return;
-    }
-
-    /* 
-     * Get pointers to ICMP.DLL functions
-     */
-    lpfnIcmpCreateFile  = (LPFNICMPCREATEFILE)GetProcAddress(hICMP_DLL,"IcmpCreateFile");
-    lpfnIcmpCloseHandle = (LPFNICMPCLOSEHANDLE)GetProcAddress(hICMP_DLL,"IcmpCloseHandle");
-    lpfnIcmpSendEcho    = (LPFNICMPSENDECHO)GetProcAddress(hICMP_DLL,"IcmpSendEcho");
-    if ((!lpfnIcmpCreateFile) || (!lpfnIcmpCloseHandle) || (!lpfnIcmpSendEcho)) {
-		fprintf(stderr, "error: wrong ICMP.DLL system library\n");
-        return;
-    }
-
-    /*
-     * IcmpCreateFile() - Open the ping service
-     */
-    hICMP = (HANDLE) lpfnIcmpCreateFile();
-    if (hICMP == INVALID_HANDLE_VALUE) {
-		fprintf(stderr, "error: could not create ICMP file handle\n");
-        return;
-    }
+	engine = e;
+	probeCallback = NULL;
+	probeContext = NULL;
+	eventCallback = NULL;
+	eventContext = NULL;
+	events = 0;
+	series = NULL;
+	matrix = NULL;
+	startTick = 0;
 
 	ResetHops();
 
-	initialized = true;
+	// merged reports use a WinMTRNet without engine
+	initialized = engine ? engine->IsInitialized() : false;
 	return;
 }
 
 WinMTRNet::~WinMTRNet()
 {
-	if(initialized) {
-		/*
-		 * IcmpCloseHandle - Close the ICMP handle
-		 */
-		lpfnIcmpCloseHandle(hICMP);
-
-		// Shut down...
-		FreeLibrary(hICMP_DLL);
+	// resolvers blocked in gethostbyaddr still write the names, the last
+	// one sets hResolved before it releases the mutex
+	WaitForSingleObject(hResolved, INFINITE);
+	WaitForSingleObject(ghMutex, INFINITE);
+	ReleaseMutex(ghMutex);
 
-		WSACleanup();
-	
-		CloseHandle(ghMutex);
-	}
+	CloseHandle(hResolved);
+	CloseHandle(hDone);
+	CloseHandle(ghMutex);
+	for (int i = 0; i < MAX_HOPS; i++)
+		DeleteCriticalSection(&laneLock[i]);
+	delete series;
+	delete matrix;
 }
 
 void WinMTRNet::ResetHops()
 {
 	memset(host, 0, MAX_HOPS * sizeof(s_nethost));
+	memset(hopset, 0, MAX_HOPS * sizeof(s_hopset));
+	memset(flowResponder, -1, sizeof(flowResponder));
+	for (int i = 0; i < MAX_HOPS; i++)
+		detect[i].Reset();
+	memset(pmtu, 0, sizeof(pmtu));
+	for (int i = 0; i < MAX_HOPS; i++)
+		pmtu[i].hi = pmtu[i].tooBig = PMTU_MAX + 1;
+	memset(capacity, 0, sizeof(capacity));
+	memset(train, 0, sizeof(train));
+	memset(rto, 0, sizeof(rto));
+	memset(order, 0, sizeof(order));
+	memset(police, 0, sizeof(police));
+	memset(tosclass, 0, sizeof(tosclass));
+	events = 0;
 }
 
 void WinMTRNet::DoTrace(int address, bool async)
 {
 	tracing = true;
+	settled = false;
 
 	ResetHops();
 
 	last_remote_addr = address;
 
-	// one thread per TTL value
-	for(int i = 0; i < MAX_HOPS; i++) {
-		trace_thread *current = new trace_thread;
-		current->address = address;
-		current->winmtr = this;
-		current->ttl = i + 1;
-		hThreads[i] = (HANDLE)_beginthread(TraceThread, 0 , current);
-	}
-
-	if (async)
-		_beginthread(FinishThread, 0 , this);
-	else
-		FinishThread(this);
+	delete series;
+	series = NULL;
+	if (wmtrparams->record > 0)
+		series = new WinMTRSeries((int)((size_t)wmtrparams->record * 1024 / SERIES_BLOCK_SIZE));
+	delete matrix;
+	matrix = NULL;
+	if (wmtrparams->lockstep)
+		matrix = new WinMTRMatrix(wmtrparams->cycles);
+	startTick = GetTickCount();
+
+	// MDA stopping rule: after k responders, n_k replies leave a chance of at
+	// most alpha / (k + 1) that an evenly balanced (k + 1)th branch was missed
+	double alpha = 1.0 - wmtrparams->confidence / 100.0;
+	mdaProbes[0] = 1;
+	for (int k = 1; k <= MAX_RESPONDERS; k++)
+		mdaProbes[k] = (int)ceil(log(alpha / (k + 1)) / log((double)k / (k + 1)));
+	confidenceZ = WinMTRStats::NormalQuantile(0.5 + wmtrparams->confidence / 200.0);
+	probesSent = 0;
+	memset((void*)converged, 0, sizeof(converged));
+
+	// one engine task per TTL value, one per lane with --pmtu, --train or --tos
+	lanes = 1;
+	if (wmtrparams->pmtu)
+		lanes = PMTU_LANES;
+	else if (wmtrparams->train > 1)
+		lanes = wmtrparams->train;
+	else if (wmtrparams->tosCount > 1)
+		lanes = wmtrparams->tosCount;
+	activeTasks = MAX_HOPS * lanes;
+	ResetEvent(hDone);
+	engine->Submit(this, address);
+
+	if (!async)
+		WaitTrace(INFINITE);
 }
 
 void WinMTRNet::StopTrace()
@@ -126,187 +137,981 @@ void WinMTRNet::StopTrace()
 	tracing = false;
 }
 
+//*****************************************************************************
+// WinMTRNet::IsTracing
+//
+// True until every task of the trace has finished, after StopTrace too
+// until the probes in flight have run out.
+//*****************************************************************************
 bool WinMTRNet::IsTracing()
 {
-	return tracing;
+	return WaitForSingleObject(hDone, 0) == WAIT_TIMEOUT;
 }
 
-void FinishThread(void *p)
+//*****************************************************************************
+// WinMTRNet::WaitTrace
+//
+// Returns true once every task of the trace has finished, false if that
+// takes longer than ms.
+//*****************************************************************************
+bool WinMTRNet::WaitTrace(DWORD ms)
 {
-	WinMTRNet *wmtrnet = (WinMTRNet*)p;
+	if (WaitForSingleObject(hDone, ms) != WAIT_OBJECT_0)
+		return false;
+	tracing = false;
+	return true;
+}
 
-	WaitForMultipleObjects(MAX_HOPS, wmtrnet->hThreads, TRUE, INFINITE);
+//*****************************************************************************
+// WinMTRNet::SetProbeCallback
+//
+// The callback runs on the engine worker that completed the probe, after the
+// hop statistics have been updated. Set it before DoTrace.
+//*****************************************************************************
+void WinMTRNet::SetProbeCallback(wmtr_probe_callback cb, void *context)
+{
+	probeCallback = cb;
+	probeContext = context;
+}
 
-	wmtrnet->tracing = false;
+//*****************************************************************************
+// WinMTRNet::SetEventCallback
+//
+// Change detection only runs while an event callback is set, the callback
+// runs on the engine worker like the probe callback. Set it before DoTrace.
+//*****************************************************************************
+void WinMTRNet::SetEventCallback(wmtr_event_callback cb, void *context)
+{
+	eventCallback = cb;
+	eventContext = context;
+}
+
+//*****************************************************************************
+// WinMTRNet::GetEvents
+//
+// Number of events detected by the current trace.
+//*****************************************************************************
+int WinMTRNet::GetEvents()
+{
+	return events;
+}
+
+//*****************************************************************************
+// WinMTRNet::ResolveAddr
+//
+// Dotted IPv4 addresses or host names, INADDR_NONE on failure.
+//*****************************************************************************
+int WinMTRNet::ResolveAddr(const char *s)
+{
+	struct hostent *host;
+
+	int isIP=1;
+	const char *t = s;
+	while(*t) {
+		if(!isdigit(*t) && *t!='.') {
+			isIP=0;
+			break;
+		}
+		t++;
+	}
+
+	if(!isIP) {
+		host = gethostbyname(s);
+		if (host)
+			return *(int *)host->h_addr;
+		else
+			return INADDR_NONE;
+	} else
+		return inet_addr(s);
 }
 
-void TraceThread(void *p)
+//*****************************************************************************
+// WinMTRNet::ProcessReply
+//
+// Called by the engine worker owning the task of hop 'at' for every
+// completed echo request.
+//*****************************************************************************
+void WinMTRNet::ProcessReply(int at, DWORD replies, PICMPECHO icmp_echo_reply, WinMTRMetrics *metrics)
 {
-	trace_thread* current = (trace_thread*)p;
-	WinMTRNet *wmtrnet = current->winmtr;
-	TRACE_MSG("Thread with TTL=" << current->ttl << " started.");
+	s_nethost *nethost = &host[at];
+	s_responder *responder;
+	int rtt;
+	float oldavg, oldjavg;
+
+	nethost->xmit++;
+	if (replies == 0)
+		return;
+
+	TRACE_DEBUG(TRACE_REPLY, at + 1, icmp_echo_reply->Status, replies);
 
-	s_nethost *nethost;
-    IPINFO			stIPInfo, *lpstIPInfo;
-    DWORD			dwReplyCount;
-	int				rtt;
-	char			achReqData[8192];
-	int				nDataLen									= wmtrnet->wmtrparams->pingsize;
-	char			achRepData[sizeof(ICMPECHO) + 8192];
-	int				cycle										= 0;
-	float			oldavg, oldjavg;
+	rtt = icmp_echo_reply->RoundTripTime;
 
-	nethost = &wmtrnet->host[current->ttl - 1];
+	switch(icmp_echo_reply->Status) {
+		case IP_SUCCESS:
+		case IP_TTL_EXPIRED_TRANSIT:
 
-    /*
-     * Init IPInfo structure
-     */
-    lpstIPInfo				= &stIPInfo;
-    stIPInfo.Ttl			= current->ttl;
-    stIPInfo.Tos			= 0;
-    stIPInfo.Flags			= IPFLAG_DONT_FRAGMENT;
-    stIPInfo.OptionsSize	= 0;
-    stIPInfo.OptionsData	= NULL;
+			// the following code is taken directly from the mtr-0.84 net implementation
+
+			nethost->jitter = rtt - nethost->last;
+			if (nethost->jitter < 0) nethost->jitter = -nethost->jitter;
+			nethost->last = rtt;
+
+			if (nethost->returned < 1)
+			{
+				nethost->best = nethost->worst = rtt;
+				nethost->gmean = rtt;
+				nethost->avg = 0;
+				nethost->var = 0;
+				nethost->jitter = nethost->jworst = nethost->jinta = 0;
+			}
 
-    for (int i=0; i<nDataLen; i++) achReqData[i] = 32; //whitespaces
+			if (rtt < nethost->best ) nethost->best  = rtt;
+			if (rtt > nethost->worst) nethost->worst = rtt;
 
-	while(wmtrnet->tracing && cycle++ < wmtrnet->wmtrparams->cycles) {
-	    
-		// For some strange reason, ICMP API is not filling the TTL for icmp echo reply
-		// Check if the current thread should be closed
-		if( current->ttl > wmtrnet->GetMax() ) break;
+			if (nethost->jitter > nethost->jworst)
+				nethost->jworst = nethost->jitter;
 
-		// NOTE: some servers does not respond back everytime, if TTL expires in transit; e.g. :
-		// ping -n 20 -w 5000 -l 64 -i 7 www.chinapost.com.tw  -> less that half of the replies are coming back from 219.80.240.93
-		// but if we are pinging ping -n 20 -w 5000 -l 64 219.80.240.93  we have 0% loss
-		// A resolution would be:
-		// - as soon as we get a hop, we start pinging directly that hop, with a greater TTL
-		// - a drawback would be that, some servers are configured to reply for TTL transit expire, but not to ping requests, so,
-		// for these servers we'll have 100% loss
-		dwReplyCount = wmtrnet->lpfnIcmpSendEcho(wmtrnet->hICMP, current->address, achReqData, nDataLen, lpstIPInfo, achRepData, sizeof(achRepData),
-			(int)(wmtrnet->wmtrparams->timeout * 1000));
+			nethost->returned++;
 
-		PICMPECHO icmp_echo_reply = (PICMPECHO)achRepData;
+			oldavg = nethost->avg;
+			nethost->avg += (float)(rtt - oldavg) / nethost->returned;
+			nethost->var += (rtt - oldavg) * (rtt - nethost->avg);
+
+			oldjavg = nethost->javg;
+			nethost->javg += (nethost->jitter - oldjavg) / nethost->returned;
+
+			nethost->jinta += nethost->jitter - ((nethost->jinta + 8) >> 4);
+
+			// keeps the geometric mean mergeable, a 0 ms reply makes it 0 for good
+			nethost->logsum += log((double)rtt);
+			nethost->gmean = (float)exp(nethost->logsum / nethost->returned);
+
+			nethost->hist[WinMTRStats::Bucket(rtt)]++;
+
+			// the common case of a single responder compares one address
+			responder = &hopset[at].responder[hopset[at].current];
+			if (responder->addr != icmp_echo_reply->Address || hopset[at].count == 0)
+				responder = AddResponder(at, icmp_echo_reply->Address, metrics);
+			if (responder) {
+				responder->returned++;
+				responder->last = rtt;
+				if (responder->returned == 1)
+					responder->best = responder->worst = rtt;
+				if (rtt < responder->best) responder->best = rtt;
+				if (rtt > responder->worst) responder->worst = rtt;
+				responder->avg += (rtt - responder->avg) / responder->returned;
+			}
+
+			// the address is set once per hop, only that takes the lock
+			if (nethost->addr == 0) {
+				LONGLONG start = WinMTRMetrics::Now();
+				WaitForSingleObject(ghMutex, INFINITE);
+				metrics->Add(METRIC_LOCK_WAIT, start, WinMTRMetrics::Now());
+				SetAddr(at, icmp_echo_reply->Address);
+				ReleaseMutex(ghMutex);
+			}
+			return;
+	}
+
+	LONGLONG start = WinMTRMetrics::Now();
+	WaitForSingleObject(ghMutex, INFINITE);
+	metrics->Add(METRIC_LOCK_WAIT, start, WinMTRMetrics::Now());
+	switch(icmp_echo_reply->Status) {
+		case IP_BUF_TOO_SMALL:
+			SetName(at, "Reply buffer too small.");
+		break;
+		case IP_DEST_NET_UNREACHABLE:
+			SetName(at, "Destination network unreachable.");
+		break;
+		case IP_DEST_HOST_UNREACHABLE:
+			SetName(at, "Destination host unreachable.");
+		break;
+		case IP_DEST_PROT_UNREACHABLE:
+			SetName(at, "Destination protocol unreachable.");
+		break;
+		case IP_DEST_PORT_UNREACHABLE:
+			SetName(at, "Destination port unreachable.");
+		break;
+		case IP_NO_RESOURCES:
+			SetName(at, "Insufficient IP resources were available.");
+		break;
+		case IP_BAD_OPTION:
+			SetName(at, "Bad IP option was specified.");
+		break;
+		case IP_HW_ERROR:
+			SetName(at, "Hardware error occurred.");
+		break;
+		case IP_PACKET_TOO_BIG:
+			SetName(at, "Packet was too big.");
+		break;
+		case IP_REQ_TIMED_OUT:
+			SetName(at, "Request timed out.");
+		break;
+		case IP_BAD_REQ:
+			SetName(at, "Bad request.");
+		break;
+		case IP_BAD_ROUTE:
+			SetName(at, "Bad route.");
+		break;
+		case IP_TTL_EXPIRED_REASSEM:
+			SetName(at, "The time to live expired during fragment reassembly.");
+		break;
+		case IP_PARAM_PROBLEM:
+			SetName(at, "Parameter problem.");
+		break;
+		case IP_SOURCE_QUENCH:
+			SetName(at, "Datagrams are arriving too fast to be processed and datagrams may have been discarded.");
+		break;
+		case IP_OPTION_TOO_BIG:
+			SetName(at, "An IP option was too big.");
+		break;
+		case IP_BAD_DESTINATION:
+			SetName(at, "Bad destination.");
+		break;
+		case IP_GENERAL_FAILURE:
+			SetName(at, "General failure.");
+		break;
+		default:
+			SetName(at, "General failure.");
+	}
+	ReleaseMutex(ghMutex);
+}
+
+//*****************************************************************************
+// WinMTRNet::NotifyProbe
+//
+//*****************************************************************************
+void WinMTRNet::NotifyProbe(int at, int cycle, DWORD replies, PICMPECHO icmp_echo_reply)
+{
+	wmtr_probe_result result;
+
+	if (probeCallback == NULL)
+		return;
+
+	result.target = last_remote_addr;
+	result.ttl = at + 1;
+	result.cycle = cycle;
+	if (replies != 0) {
+		result.status = icmp_echo_reply->Status;
+		result.rtt = icmp_echo_reply->RoundTripTime;
+		result.responder = icmp_echo_reply->Address;
+	} else {
+		result.status = IP_REQ_TIMED_OUT;
+		result.rtt = 0;
+		result.responder = 0;
+	}
+	probeCallback(&result, probeContext);
+}
+
+//*****************************************************************************
+// WinMTRNet::DetectChange
+//
+// Feeds the probe to the detector of the hop, called by the same worker
+// as ProcessReply.
+//*****************************************************************************
+void WinMTRNet::DetectChange(int at, DWORD replies, PICMPECHO icmp_echo_reply)
+{
+	wmtr_event event[2];
+	int rtt = -1;
+
+	if (eventCallback == NULL)
+		return;
+
+	if (replies != 0 && (icmp_echo_reply->Status == IP_SUCCESS
+			|| icmp_echo_reply->Status == IP_TTL_EXPIRED_TRANSIT))
 		rtt = icmp_echo_reply->RoundTripTime;
 
-		nethost->xmit++;
-		if (dwReplyCount != 0) {
-			TRACE_MSG("TTL " << current->ttl << " reply TTL " << icmp_echo_reply->Options.Ttl << " Status " << icmp_echo_reply->Status << " Reply count " << dwReplyCount);
-
-			WaitForSingleObject(wmtrnet->ghMutex, INFINITE);
-			switch(icmp_echo_reply->Status) {
-				case IP_SUCCESS:
-				case IP_TTL_EXPIRED_TRANSIT:
-
-					// the following code is taken directly from the mtr-0.84 net implementation
-
-					nethost->jitter = rtt - nethost->last;
-					if (nethost->jitter < 0) nethost->jitter = -nethost->jitter;
-					nethost->last = rtt;
-
-					if (nethost->returned < 1)
-					{
-						nethost->best = nethost->worst = rtt;
-						nethost->gmean = rtt;
-						nethost->avg = 0;
-						nethost->var = 0;
-						nethost->jitter = nethost->jworst = nethost->jinta = 0;
-					}
-
-					if (rtt < nethost->best ) nethost->best  = rtt;
-					if (rtt > nethost->worst) nethost->worst = rtt;
-
-					if (nethost->jitter > nethost->jworst)
-						nethost->jworst = nethost->jitter;
-
-					nethost->returned++;
-
-					oldavg = nethost->avg;
-					nethost->avg += (float)(rtt - oldavg) / nethost->returned;
-					nethost->var += (rtt - oldavg) * (rtt - nethost->avg);
-
-					oldjavg = nethost->javg;
-					nethost->javg += (nethost->jitter - oldjavg) / nethost->returned;
-
-					nethost->jinta += nethost->jitter - ((nethost->jinta + 8) >> 4);
-
-					if (nethost->returned > 1)
-						nethost->gmean = pow((float) nethost->gmean, (nethost->returned - 1.0f) / nethost->returned)
-						* pow((float) rtt, 1.0f / nethost->returned);
-					else
-						nethost->gmean = rtt;
-
-					wmtrnet->SetAddr(current->ttl - 1, icmp_echo_reply->Address);
-				break;
-				case IP_BUF_TOO_SMALL:
-					wmtrnet->SetName(current->ttl - 1, "Reply buffer too small.");
-				break;
-				case IP_DEST_NET_UNREACHABLE:
-					wmtrnet->SetName(current->ttl - 1, "Destination network unreachable.");
-				break;
-				case IP_DEST_HOST_UNREACHABLE:
-					wmtrnet->SetName(current->ttl - 1, "Destination host unreachable.");
-				break;
-				case IP_DEST_PROT_UNREACHABLE:
-					wmtrnet->SetName(current->ttl - 1, "Destination protocol unreachable.");
-				break;
-				case IP_DEST_PORT_UNREACHABLE:
-					wmtrnet->SetName(current->ttl - 1, "Destination port unreachable.");
-				break;
-				case IP_NO_RESOURCES:
-					wmtrnet->SetName(current->ttl - 1, "Insufficient IP resources were available.");
-				break;
-				case IP_BAD_OPTION:
-					wmtrnet->SetName(current->ttl - 1, "Bad IP option was specified.");
-				break;
-				case IP_HW_ERROR:
-					wmtrnet->SetName(current->ttl - 1, "Hardware error occurred.");
-				break;
-				case IP_PACKET_TOO_BIG:
-					wmtrnet->SetName(current->ttl - 1, "Packet was too big.");
-				break;
-				case IP_REQ_TIMED_OUT:
-					wmtrnet->SetName(current->ttl - 1, "Request timed out.");
-				break;
-				case IP_BAD_REQ:
-					wmtrnet->SetName(current->ttl - 1, "Bad request.");
-				break;
-				case IP_BAD_ROUTE:
-					wmtrnet->SetName(current->ttl - 1, "Bad route.");
-				break;
-				case IP_TTL_EXPIRED_REASSEM:
-					wmtrnet->SetName(current->ttl - 1, "The time to live expired during fragment reassembly.");
-				break;
-				case IP_PARAM_PROBLEM:
-					wmtrnet->SetName(current->ttl - 1, "Parameter problem.");
-				break;
-				case IP_SOURCE_QUENCH:
-					wmtrnet->SetName(current->ttl - 1, "Datagrams are arriving too fast to be processed and datagrams may have been discarded.");
-				break;
-				case IP_OPTION_TOO_BIG:
-					wmtrnet->SetName(current->ttl - 1, "An IP option was too big.");
-				break;
-				case IP_BAD_DESTINATION:
-					wmtrnet->SetName(current->ttl - 1, "Bad destination.");
-				break;
-				case IP_GENERAL_FAILURE:
-					wmtrnet->SetName(current->ttl - 1, "General failure.");
-				break;
-				default:
-					wmtrnet->SetName(current->ttl - 1, "General failure.");
+	int n = detect[at].Update(replies == 0, rtt, event);
+	for (int i = 0; i < n; i++) {
+		event[i].target = last_remote_addr;
+		event[i].ttl = at + 1;
+		event[i].responder = 0;
+		EmitEvent(&event[i]);
+	}
+}
+
+//*****************************************************************************
+// WinMTRNet::AddResponder
+//
+// The slow path of ProcessReply for an address other than the latest
+// responder of the hop. Returns NULL once the set is full.
+//*****************************************************************************
+s_responder *WinMTRNet::AddResponder(int at, __int32 addr, WinMTRMetrics *metrics)
+{
+	s_hopset *set = &hopset[at];
+	s_responder *r;
+
+	for (int i = 0; i < set->count; i++) {
+		if (set->responder[i].addr == addr) {
+			set->current = i;
+			return &set->responder[i];
+		}
+	}
+
+	if (set->count == MAX_RESPONDERS) {
+		set->others++;
+		return NULL;
+	}
+
+	// readers copy responders under ghMutex, count must not run ahead
+	LONGLONG start = WinMTRMetrics::Now();
+	WaitForSingleObject(ghMutex, INFINITE);
+	metrics->Add(METRIC_LOCK_WAIT, start, WinMTRMetrics::Now());
+	r = &set->responder[set->count];
+	memset(r, 0, sizeof(s_responder));
+	r->addr = addr;
+	set->current = set->count++;
+	ReleaseMutex(ghMutex);
+
+	if (set->count > 1) {
+		wmtr_event event;
+		event.target = last_remote_addr;
+		event.ttl = at + 1;
+		event.kind = WMTR_EVENT_NEW_RESPONDER;
+		event.before = (float)(set->count - 1);
+		event.after = (float)set->count;
+		event.responder = addr;
+		EmitEvent(&event);
+	}
+	return r;
+}
+
+//*****************************************************************************
+// WinMTRNet::MultipathDone
+//
+// Called by the engine before each multipath probe of hop 'at'. Gives up
+// on hops losing more than half of the probes.
+//*****************************************************************************
+bool WinMTRNet::MultipathDone(int at)
+{
+	int k = hopset[at].count;
+	if (k > MAX_RESPONDERS) k = MAX_RESPONDERS;
+	int need = mdaProbes[k > 0 ? k : 1];
+
+	return host[at].returned >= need || host[at].xmit >= 2 * need
+		|| host[at].xmit >= MAX_FLOWS;
+}
+
+//*****************************************************************************
+// WinMTRNet::IsSettled
+//
+// True once every hop up to the target has had FAST_MIN_CYCLES probes and
+// the standard errors of its loss ratio and mean RTT are small. Hops that
+// never answered count as settled. Called by the engine workers, each hop
+// is read under its lane lock, one at a time.
+//*****************************************************************************
+bool WinMTRNet::IsSettled()
+{
+	int max = GetMaxUnsafe();
+
+	for (int at = 0; at < max; at++) {
+		s_nethost *h = &host[at];
+
+		EnterCriticalSection(&laneLock[at]);
+		int xmit = h->xmit;
+		int returned = h->returned;
+		double stdev = GetStDevUnsafe(at);
+		double avg = h->avg;
+		LeaveCriticalSection(&laneLock[at]);
+
+		if (xmit < FAST_MIN_CYCLES)
+			return false;
+		if (returned == 0)
+			continue;
+		if (returned < 2)
+			return false;
+
+		double loss = 1.0 - (double)returned / xmit;
+		if (sqrt(loss * (1.0 - loss) / xmit) > FAST_LOSS_ERROR)
+			return false;
+
+		double error = stdev / sqrt((double)returned);
+		double allowed = FAST_RTT_ERROR * avg;
+		if (error > (allowed > 1.0 ? allowed : 1.0))
+			return false;
+	}
+	return max > 0;
+}
+
+//*****************************************************************************
+// WinMTRNet::HopConverged
+//
+// --precision: the hop is done once the confidence intervals of its loss
+// (Wilson) and mean RTT are within the precision asked for. Checked after
+// every probe from ADAPTIVE_MIN_CYCLES on, the fixed-width sequential rule
+// of Chow and Robbins. A hop that never answered has nothing to estimate.
+// The hop may be written by another worker, so this holds its lane lock.
+//*****************************************************************************
+bool WinMTRNet::HopConverged(int at)
+{
+	s_nethost *h = &host[at];
+	double low, high, stdev;
+
+	EnterCriticalSection(&laneLock[at]);
+	int xmit = h->xmit;
+	int returned = h->returned;
+	stdev = GetStDevUnsafe(at);
+	LeaveCriticalSection(&laneLock[at]);
+
+	if (xmit < ADAPTIVE_MIN_CYCLES)
+		return false;
+	if (returned == 0)
+		return true;
+
+	WinMTRStats::Wilson(1.0 - (double)returned / xmit, xmit, confidenceZ, &low, &high);
+	if ((high - low) * 50 > wmtrparams->precisionLoss)
+		return false;
+
+	if (wmtrparams->precisionRtt > 0) {
+		if (returned < 2)
+			return false;
+		if (confidenceZ * stdev / sqrt((double)returned) > wmtrparams->precisionRtt)
+			return false;
+	}
+	return true;
+}
+
+//*****************************************************************************
+// WinMTRNet::AdaptiveDone
+//
+// A converged hop stops, the others go on until the probes of all hops
+// together reach cycles per hop up to the target.
+//*****************************************************************************
+bool WinMTRNet::AdaptiveDone(int at)
+{
+	if (HopConverged(at)) {
+		converged[at] = 1;
+		return true;
+	}
+	return probesSent >= wmtrparams->cycles * GetMaxUnsafe();
+}
+
+//*****************************************************************************
+// WinMTRNet::AdaptiveInterval
+//
+// The hops that converged leave their share of the probe rate to the ones
+// still probing: with half of the hops done, the rest probe twice as often.
+//*****************************************************************************
+DWORD WinMTRNet::AdaptiveInterval(DWORD interval)
+{
+	int max = GetMaxUnsafe();
+	int left = max;
+
+	for (int at = 0; at < max; at++)
+		if (converged[at])
+			left--;
+	if (left < 1)
+		return interval;
+	return (DWORD)((unsigned __int64)interval * left / max);
+}
+
+//*****************************************************************************
+// WinMTRNet::MtuBounds
+//
+// What got through to a later hop got through to this one, and what an
+// earlier hop answered too big does not get here either, so hops that stay
+// silent still end up with the MTU of their neighbours. A size that only
+// went unanswered bounds its own hop: an earlier hop may just be rate
+// limiting or dropping probes to itself.
+//*****************************************************************************
+void WinMTRNet::MtuBounds(int at, int *lo, int *hi)
+{
+	*lo = pmtu[at].lo;
+	*hi = pmtu[at].hi;
+	for (int i = at + 1; i < MAX_HOPS; i++)
+		if (pmtu[i].lo > *lo)
+			*lo = pmtu[i].lo;
+	for (int i = 0; i < at; i++)
+		if (pmtu[i].tooBig < *hi)
+			*hi = pmtu[i].tooBig;
+	if (*hi <= *lo)
+		*hi = *lo + 1;
+}
+
+//*****************************************************************************
+// WinMTRNet::NextMtuProbe
+//
+// The size lane 'lane' of hop 'at' probes next: its unanswered size again,
+// else a common MTU or its successor not tested yet, else the middle of
+// the widest untested gap between the known sizes and those in flight.
+// Returns 0 once every size left is in flight on another lane, the lane is
+// done then.
+//*****************************************************************************
+int WinMTRNet::NextMtuProbe(int at, int lane)
+{
+	static const int plateaus[] = { 1500, 1501, 1492, 1493, 1280, 1281 };
+	s_pmtu *p = &pmtu[at];
+	int bound[PMTU_LANES + 2];
+	int n = 0, size = 0;
+	int lo, hi;
+
+	WaitForSingleObject(ghMutex, INFINITE);
+	MtuBounds(at, &lo, &hi);
+	if (lo < PMTU_MIN - 1)
+		lo = PMTU_MIN - 1;
+	if (p->inflight[lane]) {
+		size = p->inflight[lane];
+		ReleaseMutex(ghMutex);
+		return size;
+	}
+
+	for (int i = 0; i < sizeof(plateaus) / sizeof(plateaus[0]) && size == 0; i++) {
+		if (plateaus[i] <= lo || plateaus[i] >= hi)
+			continue;
+		size = plateaus[i];
+		for (int j = 0; j < PMTU_LANES; j++)
+			if (p->inflight[j] == size)
+				size = 0;
+	}
+
+	if (size == 0) {
+		bound[n++] = lo;
+		bound[n++] = hi;
+		for (int j = 0; j < PMTU_LANES; j++)
+			if (p->inflight[j] > lo && p->inflight[j] < hi)
+				bound[n++] = p->inflight[j];
+		std::sort(bound, bound + n);
+		int widest = 1;
+		for (int i = 1; i < n; i++)
+			if (bound[i] - bound[i - 1] > widest) {
+				widest = bound[i] - bound[i - 1];
+				size = bound[i - 1] + widest / 2;
 			}
-			ReleaseMutex(wmtrnet->ghMutex);
+	}
+
+	p->inflight[lane] = size;
+	p->tries[lane] = 0;
+	ReleaseMutex(ghMutex);
+	return size;
+}
+
+//*****************************************************************************
+// WinMTRNet::ProcessMtu
+//
+// Any reply but too big means the size reached the hop. A size fails after
+// PMTU_TRIES probes without reply, which also catches paths dropping big
+// packets without saying so.
+//*****************************************************************************
+void WinMTRNet::ProcessMtu(int at, int lane, int size, DWORD replies, PICMPECHO icmp_echo_reply)
+{
+	s_pmtu *p = &pmtu[at];
 
-			if(wmtrnet->wmtrparams->interval * 1000 > icmp_echo_reply->RoundTripTime)
-				Sleep(wmtrnet->wmtrparams->interval * 1000 - icmp_echo_reply->RoundTripTime);
+	WaitForSingleObject(ghMutex, INFINITE);
+	if (replies == 0 && ++p->tries[lane] < PMTU_TRIES) {
+		ReleaseMutex(ghMutex);
+		return;
+	}
+
+	if (replies != 0 && icmp_echo_reply->Status != IP_PACKET_TOO_BIG) {
+		if (size > p->lo)
+			p->lo = size;
+	} else {
+		if (size < p->hi)
+			p->hi = size;
+		if (replies != 0) {
+			if (size < p->tooBig)
+				p->tooBig = size;
+			p->reporter = icmp_echo_reply->Address;
 		}
+	}
+	// a lost probe taken for too big
+	if (p->hi <= p->lo)
+		p->hi = p->lo + 1;
+	if (p->tooBig <= p->lo)
+		p->tooBig = p->lo + 1;
+
+	p->inflight[lane] = 0;
+	p->tries[lane] = 0;
+	ReleaseMutex(ghMutex);
+}
+
+//*****************************************************************************
+// WinMTRNet::CapacitySize
+//
+// The payload of the i-th --capacity probe size, evenly spaced.
+//*****************************************************************************
+int WinMTRNet::CapacitySize(int i)
+{
+	return MINPACKET + i * (CAPACITY_MAX_SIZE - MINPACKET) / (CAPACITY_SIZES - 1);
+}
 
-    } /* end ping loop */
+//*****************************************************************************
+// WinMTRNet::RecordCapacity
+//
+// Keeps the minimum RTT per probe size, the probe least delayed by queues.
+// A hop is done once CAPACITY_STABLE rounds over all sizes found no
+// minimum lower by more than CAPACITY_RESOLUTION. Only the worker owning
+// the task of the hop calls this.
+//*****************************************************************************
+void WinMTRNet::RecordCapacity(int at, int cycle, int rtt, DWORD replies, PICMPECHO icmp_echo_reply)
+{
+	s_capacity *c = &capacity[at];
+	int i = (cycle - 1) % CAPACITY_SIZES;
+
+	if (replies != 0 && (icmp_echo_reply->Status == IP_SUCCESS ||
+			icmp_echo_reply->Status == IP_TTL_EXPIRED_TRANSIT)) {
+		if (c->minRtt[i] == 0 || rtt < c->minRtt[i] - CAPACITY_RESOLUTION)
+			c->improved = true;
+		if (c->minRtt[i] == 0 || rtt < c->minRtt[i])
+			c->minRtt[i] = (rtt > 0) ? rtt : 1;
+		c->echo = (icmp_echo_reply->Status == IP_SUCCESS);
+	}
 
-	TRACE_MSG("Thread with TTL=" << current->ttl << " stopped.");
+	if (i == CAPACITY_SIZES - 1) {
+		c->stable = c->improved ? 0 : c->stable + 1;
+		c->improved = false;
+	}
+}
 
-	delete p;
-	_endthread();
+//*****************************************************************************
+// WinMTRNet::CapacityDone
+//
+//*****************************************************************************
+bool WinMTRNet::CapacityDone(int at)
+{
+	return capacity[at].stable >= CAPACITY_STABLE;
+}
+
+//*****************************************************************************
+// WinMTRNet::CapacitySlope
+//
+// The serialization delay up to the hop in us per byte, the Theil-Sen
+// slope of the minimum RTTs over the probe sizes. Replies of the target
+// are as big as the probe and cross the links twice, time exceeded
+// replies are not, so the slope of the target is halved. Returns false
+// without two sizes answered.
+//*****************************************************************************
+bool WinMTRNet::CapacitySlope(int at, double *slope)
+{
+	double x[CAPACITY_SIZES], y[CAPACITY_SIZES];
+	int n = 0;
+
+	for (int i = 0; i < CAPACITY_SIZES; i++) {
+		if (capacity[at].minRtt[i] == 0)
+			continue;
+		x[n] = CapacitySize(i);
+		y[n] = capacity[at].minRtt[i];
+		n++;
+	}
+	if (n < 2)
+		return false;
+
+	*slope = WinMTRStats::TheilSen(x, y, n);
+	if (capacity[at].echo)
+		*slope /= 2;
+	return true;
+}
+
+//*****************************************************************************
+// WinMTRNet::RecordTrain
+//
+// Counts the probe into the slot of its train. A slot taken by an older
+// train folds that train into the sums first; probes of trains already
+// folded are only in the plain statistics.
+//*****************************************************************************
+void WinMTRNet::RecordTrain(int at, int cycle, DWORD replies, PICMPECHO icmp_echo_reply)
+{
+	s_train *t = &train[at];
+	s_trainslot *s = &t->slot[cycle % TRAIN_SLOTS];
+
+	if (s->cycle > cycle)
+		return;
+	if (s->cycle != cycle) {
+		FoldTrain(t, s);
+		memset(s, 0, sizeof(*s));
+		s->cycle = cycle;
+	}
+
+	s->sent++;
+	if (replies == 0)
+		s->lost++;
+	else
+		s->rttSum += icmp_echo_reply->RoundTripTime;
+}
+
+//*****************************************************************************
+// WinMTRNet::FoldTrain
+//
+//*****************************************************************************
+void WinMTRNet::FoldTrain(s_train *t, const s_trainslot *s)
+{
+	double n = s->sent, l = s->lost;
+
+	if (s->sent == 0)
+		return;
+	t->trains++;
+	t->sent += n;
+	t->lost += l;
+	t->sent2 += n * n;
+	t->lost2 += l * l;
+	t->sentLost += n * l;
+	if (l / n > t->worst)
+		t->worst = l / n;
+	if (s->lost < s->sent) {
+		double m = s->rttSum / (s->sent - s->lost);
+		t->rttTrains++;
+		t->rttSum += m;
+		t->rttSum2 += m * m;
+	}
+}
+
+//*****************************************************************************
+// WinMTRNet::ProbeTimeout
+//
+// --rto: the timeout of the next probe to the hop, RTO_GRACE times its
+// RTO within the floor and --timeout. A hop that has not answered yet
+// gets the largest RTO of the hops that did, the reply of a silent hop
+// would not take longer than that of the target behind it, so black holes
+// cost little. Replies update the RTO under the lane lock of their hop, so
+// each hop is read under its own, one at a time.
+//*****************************************************************************
+DWORD WinMTRNet::ProbeTimeout(int at)
+{
+	DWORD ceiling = (DWORD)(wmtrparams->timeout * 1000);
+
+	EnterCriticalSection(&laneLock[at]);
+	int r = rto[at].rto;
+	LeaveCriticalSection(&laneLock[at]);
+
+	if (r == 0) {
+		for (int i = 0; i < MAX_HOPS; i++) {
+			EnterCriticalSection(&laneLock[i]);
+			if (rto[i].rto > r)
+				r = rto[i].rto;
+			LeaveCriticalSection(&laneLock[i]);
+		}
+		if (r == 0)
+			r = RTO_INITIAL;
+	}
+	DWORD timeout = (DWORD)r * RTO_GRACE;
+	return (timeout < ceiling) ? timeout : ceiling;
+}
+
+//*****************************************************************************
+// WinMTRNet::UpdateRto
+//
+// RFC 6298 smoothing, without the backoff on timeouts: probes are not
+// retransmissions and a lost probe says nothing about the RTT.
+//*****************************************************************************
+void WinMTRNet::UpdateRto(int at, DWORD replies, PICMPECHO icmp_echo_reply)
+{
+	s_rto *r = &rto[at];
+
+	if (replies == 0 || (icmp_echo_reply->Status != IP_SUCCESS &&
+			icmp_echo_reply->Status != IP_TTL_EXPIRED_TRANSIT))
+		return;
+
+	float rtt = (float)icmp_echo_reply->RoundTripTime;
+	if (r->srtt == 0) {
+		r->srtt = (rtt > 0) ? rtt : 0.5f;
+		r->rttvar = rtt / 2;
+	} else {
+		r->rttvar = 0.75f * r->rttvar + 0.25f * fabs(r->srtt - rtt);
+		r->srtt = 0.875f * r->srtt + 0.125f * rtt;
+	}
+	float v = 4 * r->rttvar;
+	r->rto = (int)ceil(r->srtt + (v > RTO_GRANULARITY ? v : RTO_GRANULARITY));
+	if (r->rto < RTO_MIN)
+		r->rto = RTO_MIN;
+}
+
+//*****************************************************************************
+// WinMTRNet::CreditLate
+//
+// A reply to a probe already counted lost turns the loss into a reply. The
+// probe events, changes and the series keep it lost, they were reported at
+// the timeout. level is the --police level the probe was sent and counted
+// lost at, cycle the train it was part of. A train already folded into the
+// sums, TRAIN_SLOTS trains later, keeps the loss. Called like ProcessReply.
+//*****************************************************************************
+void WinMTRNet::CreditLate(int at, int lane, int level, int cycle, PICMPECHO icmp_echo_reply, WinMTRMetrics *metrics)
+{
+	host[at].xmit--;
+	ProcessReply(at, 1, icmp_echo_reply, metrics);
+	if (wmtrparams->rto)
+		UpdateRto(at, 1, icmp_echo_reply);
+	order[at].late++;
+	if (wmtrparams->police && police[at].lost[level] > 0)
+		police[at].lost[level]--;
+	if (wmtrparams->tosCount > 1) {
+		tosclass[at][lane].xmit--;
+		RecordTos(at, lane, 1, icmp_echo_reply);
+	}
+	if (wmtrparams->train > 0) {
+		s_trainslot *s = &train[at].slot[cycle % TRAIN_SLOTS];
+		if (s->cycle == cycle && s->lost > 0) {
+			s->lost--;
+			s->rttSum += icmp_echo_reply->RoundTripTime;
+		}
+	}
+}
+
+//*****************************************************************************
+// WinMTRNet::RecordOrder
+//
+// Called like ProcessReply.
+//*****************************************************************************
+void WinMTRNet::RecordOrder(int at, int duplicates, bool reordered)
+{
+	order[at].duplicate += duplicates;
+	if (reordered)
+		order[at].reordered++;
+}
+
+//*****************************************************************************
+// WinMTRNet::RecordPolice
+//
+// --police: a router that rate limits the ICMP it sends loses probes that
+// the hops behind it answer. Every POLICE_MIN_PROBES probes of a hop such
+// excess loss halves its probe rate. The hop is policed once its loss at a
+// lower rate is significantly below that at the interval; if it is not by
+// the lowest rate the loss does not depend on the rate and the hop goes
+// back to the interval. A probe counts at the level it was sent at, the
+// hop may have backed off while it was out. Called like ProcessReply.
+//*****************************************************************************
+void WinMTRNet::RecordPolice(int at, int level, DWORD replies, PICMPECHO icmp_echo_reply)
+{
+	s_police *p = &police[at];
+	int l = p->level;
+
+	p->xmit[level]++;
+	if (replies == 0 || (icmp_echo_reply->Status != IP_SUCCESS &&
+			icmp_echo_reply->Status != IP_TTL_EXPIRED_TRANSIT))
+		p->lost[level]++;
+	if (level != l || p->independent || p->xmit[l] % POLICE_MIN_PROBES != 0)
+		return;
+
+	if (l > 0 && !p->policed && WinMTRStats::ProportionZ(p->lost[0], p->xmit[0],
+			p->lost[l], p->xmit[l]) > confidenceZ)
+		p->policed = true;
+	if (!ExcessLoss(at, l))
+		return;
+	if (l < POLICE_LEVELS - 1) {
+		p->level++;
+	} else if (!p->policed && p->xmit[l] >= POLICE_TEST_PROBES) {
+		p->independent = true;
+		p->level = 0;
+	}
+}
+
+//*****************************************************************************
+// WinMTRNet::ExcessLoss
+//
+// Whether the loss of the hop at the level is significantly above that of
+// the later hop that lost least, which the probes went through. Called by
+// RecordPolice under the lane lock of the hop at, the later hops are read
+// under theirs, one at a time. Lane locks only ever nest in this order, an
+// earlier hop before a later one.
+//*****************************************************************************
+bool WinMTRNet::ExcessLoss(int at, int level)
+{
+	int max = GetMaxUnsafe();
+	int bestXmit = 0, bestReturned = 0;
+	double bestLoss = 2;
+
+	for (int i = at + 1; i < max; i++) {
+		EnterCriticalSection(&laneLock[i]);
+		int xmit = host[i].xmit;
+		int returned = host[i].returned;
+		LeaveCriticalSection(&laneLock[i]);
+
+		if (returned == 0 || xmit < POLICE_MIN_PROBES)
+			continue;
+		double loss = 1.0 - (double)returned / xmit;
+		if (loss < bestLoss) {
+			bestLoss = loss;
+			bestXmit = xmit;
+			bestReturned = returned;
+		}
+	}
+	if (bestXmit == 0)
+		return false;
+
+	return WinMTRStats::ProportionZ(police[at].lost[level], police[at].xmit[level],
+		bestXmit - bestReturned, bestXmit) > confidenceZ;
+}
+
+//*****************************************************************************
+// WinMTRNet::PoliceInterval
+//
+// The time between two probes of a hop that backed off.
+//*****************************************************************************
+DWORD WinMTRNet::PoliceInterval(int at, DWORD interval)
+{
+	return interval << police[at].level;
+}
+
+//*****************************************************************************
+// WinMTRNet::RecordTos
+//
+// --tos: every lane of a hop probes its own TOS class. Called like
+// ProcessReply.
+//*****************************************************************************
+void WinMTRNet::RecordTos(int at, int lane, DWORD replies, PICMPECHO icmp_echo_reply)
+{
+	s_tosclass *c = &tosclass[at][lane];
+
+	c->xmit++;
+	if (replies == 0 || (icmp_echo_reply->Status != IP_SUCCESS &&
+			icmp_echo_reply->Status != IP_TTL_EXPIRED_TRANSIT))
+		return;
+
+	int rtt = icmp_echo_reply->RoundTripTime;
+	if (c->returned == 0)
+		c->best = c->worst = rtt;
+	if (rtt < c->best) c->best = rtt;
+	if (rtt > c->worst) c->worst = rtt;
+	c->returned++;
+	float oldavg = c->avg;
+	c->avg += (rtt - oldavg) / c->returned;
+	c->var += (rtt - oldavg) * (rtt - c->avg);
+	c->hist[WinMTRStats::Bucket(rtt)]++;
+}
+
+//*****************************************************************************
+// WinMTRNet::RecordFlow
+//
+// ProcessReply has just made the responder of the reply the current one.
+//*****************************************************************************
+void WinMTRNet::RecordFlow(int at, int flow, DWORD replies, PICMPECHO icmp_echo_reply)
+{
+	s_hopset *set = &hopset[at];
+
+	if (flow >= MAX_FLOWS || replies == 0 || set->count == 0)
+		return;
+	if (set->responder[set->current].addr == icmp_echo_reply->Address)
+		flowResponder[at][flow] = (signed char)set->current;
+}
+
+//*****************************************************************************
+// WinMTRNet::RecordSample
+//
+// Called like ProcessReply when probes are recorded.
+//*****************************************************************************
+void WinMTRNet::RecordSample(int at, DWORD sentAt, DWORD replies, PICMPECHO icmp_echo_reply)
+{
+	int rtt = SERIES_LOST;
+
+	if (replies != 0 && (icmp_echo_reply->Status == IP_SUCCESS
+		|| icmp_echo_reply->Status == IP_TTL_EXPIRED_TRANSIT))
+		rtt = icmp_echo_reply->RoundTripTime;
+	series->Append(at, sentAt - startTick, rtt);
+}
+
+//*****************************************************************************
+// WinMTRNet::EmitEvent
+//
+// Stamps the event and hands it to the event callback, if any.
+//*****************************************************************************
+void WinMTRNet::EmitEvent(wmtr_event *event)
+{
+	if (eventCallback == NULL)
+		return;
+
+	event->time = WinMTRStats::Now();
+
+	InterlockedIncrement(&events);
+	eventCallback(event, eventContext);
 }
 
 int WinMTRNet::GetAddr(int at)
@@ -437,6 +1242,189 @@ int	WinMTRNet::GetJInta(int at)
 	return ret;
 }
 
+int WinMTRNet::GetP95(int at)
+{
+	WaitForSingleObject(ghMutex, INFINITE);
+	int ret = GetP95Unsafe(at);
+	ReleaseMutex(ghMutex);
+	return ret;
+}
+
+int WinMTRNet::GetMtu(int at)
+{
+	WaitForSingleObject(ghMutex, INFINITE);
+	int ret = GetMtuUnsafe(at);
+	ReleaseMutex(ghMutex);
+	return ret;
+}
+
+__int32 WinMTRNet::GetMtuReporter(int at)
+{
+	WaitForSingleObject(ghMutex, INFINITE);
+	__int32 ret = pmtu[at].reporter;
+	ReleaseMutex(ghMutex);
+	return ret;
+}
+
+float WinMTRNet::GetCapacity(int at)
+{
+	WaitForSingleObject(ghMutex, INFINITE);
+	float ret = GetCapacityUnsafe(at);
+	ReleaseMutex(ghMutex);
+	return ret;
+}
+
+// the loss interval is the Wilson score interval for the sample size the
+// trains are worth: losses within a train are not independent, so the
+// binomial variance is scaled up to the variance between the trains (a
+// design effect of at least 1). The RTT interval is the normal one of
+// the mean of the train means.
+void WinMTRNet::GetTrain(int at, s_trainstats *ts)
+{
+	s_train t;
+
+	EnterCriticalSection(&laneLock[at]);
+	t = train[at];
+	LeaveCriticalSection(&laneLock[at]);
+
+	for (int i = 0; i < TRAIN_SLOTS; i++)
+		FoldTrain(&t, &t.slot[i]);
+
+	memset(ts, 0, sizeof(*ts));
+	ts->trains = t.trains;
+	ts->sent = (int)t.sent;
+	ts->lost = (int)t.lost;
+	ts->worst = (float)(t.worst * 100);
+	if (t.trains == 0)
+		return;
+
+	double z = confidenceZ;
+	double p = t.lost / t.sent;
+	double n = t.sent;
+	if (t.trains >= 2 && p > 0 && p < 1) {
+		double m = t.trains;
+		double between = (t.lost2 - 2 * p * t.sentLost + p * p * t.sent2) / (m * (m - 1));
+		double deff = between * m * m / (n * p * (1 - p));
+		if (deff > 1)
+			n /= deff;
+	}
+	double low, high;
+	WinMTRStats::Wilson(p, n, z, &low, &high);
+	ts->loss = (float)(p * 100);
+	ts->lossLow = (float)(low * 100);
+	ts->lossHigh = (float)(high * 100);
+
+	if (t.rttTrains > 0) {
+		double mean = t.rttSum / t.rttTrains;
+		double err = 0;
+		if (t.rttTrains >= 2) {
+			double var = (t.rttSum2 - t.rttTrains * mean * mean) / (t.rttTrains - 1);
+			err = z * sqrt(var > 0 ? var / t.rttTrains : 0);
+		}
+		ts->rtt = (float)mean;
+		ts->rttLow = (float)(mean - err);
+		ts->rttHigh = (float)(mean + err);
+	}
+}
+
+int WinMTRNet::GetRto(int at)
+{
+	WaitForSingleObject(ghMutex, INFINITE);
+	int ret = GetRtoUnsafe(at);
+	ReleaseMutex(ghMutex);
+	return ret;
+}
+
+int WinMTRNet::GetLate(int at)
+{
+	WaitForSingleObject(ghMutex, INFINITE);
+	int ret = GetLateUnsafe(at);
+	ReleaseMutex(ghMutex);
+	return ret;
+}
+
+int WinMTRNet::GetDuplicates(int at)
+{
+	WaitForSingleObject(ghMutex, INFINITE);
+	int ret = GetDuplicatesUnsafe(at);
+	ReleaseMutex(ghMutex);
+	return ret;
+}
+
+int WinMTRNet::GetReordered(int at)
+{
+	WaitForSingleObject(ghMutex, INFINITE);
+	int ret = GetReorderedUnsafe(at);
+	ReleaseMutex(ghMutex);
+	return ret;
+}
+
+float WinMTRNet::GetForwardLoss(int at)
+{
+	WaitForSingleObject(ghMutex, INFINITE);
+	float ret = GetForwardLossUnsafe(at);
+	ReleaseMutex(ghMutex);
+	return ret;
+}
+
+float WinMTRNet::GetPolicedLoss(int at)
+{
+	WaitForSingleObject(ghMutex, INFINITE);
+	float ret = GetPolicedLossUnsafe(at);
+	ReleaseMutex(ghMutex);
+	return ret;
+}
+
+bool WinMTRNet::GetPoliced(int at)
+{
+	WaitForSingleObject(ghMutex, INFINITE);
+	bool ret = police[at].policed;
+	ReleaseMutex(ghMutex);
+	return ret;
+}
+
+// --police, the probe interval of the hop is the interval * 2^backoff
+int WinMTRNet::GetBackoff(int at)
+{
+	EnterCriticalSection(&laneLock[at]);
+	int ret = police[at].level;
+	LeaveCriticalSection(&laneLock[at]);
+	return ret;
+}
+
+// --tos, the statistics of the class probed by the lane
+void WinMTRNet::GetTos(int at, int lane, s_tosstats *ts)
+{
+	s_tosclass c;
+
+	EnterCriticalSection(&laneLock[at]);
+	c = tosclass[at][lane];
+	LeaveCriticalSection(&laneLock[at]);
+
+	memset(ts, 0, sizeof(*ts));
+	ts->tos = wmtrparams->tos[lane];
+	ts->sent = c.xmit;
+	ts->returned = c.returned;
+	if (c.xmit > 0)
+		ts->loss = 100.0f - 100.0f * c.returned / c.xmit;
+	if (c.returned == 0)
+		return;
+	ts->avg = c.avg;
+	ts->stdev = (c.returned > 1) ? sqrt(c.var / (c.returned - 1.0f)) : 0;
+	ts->best = c.best;
+	ts->p95 = WinMTRStats::Percentile(c.hist, c.returned, c.worst, 95);
+}
+
+// --lockstep, hops is set to the number of hops analysed
+int WinMTRNet::GetLockstep(s_lockhop *hop, int *hops, int *targetLost)
+{
+	*hops = GetMax();
+	*targetLost = 0;
+	if (matrix == NULL)
+		return 0;
+	return matrix->Analyze(*hops - 1, confidenceZ, hop, targetLost);
+}
+
 int WinMTRNet::GetMax()
 {
 	WaitForSingleObject(ghMutex, INFINITE);
@@ -445,6 +1433,63 @@ int WinMTRNet::GetMax()
 	return ret;
 }
 
+// --precision, the hops up to the target that reached it
+int WinMTRNet::GetConverged()
+{
+	int max = GetMax();
+	int n = 0;
+
+	for (int at = 0; at < max; at++)
+		if (HopConverged(at))
+			n++;
+	return n;
+}
+
+int WinMTRNet::GetProbesSent()
+{
+	return probesSent;
+}
+
+void WinMTRNet::GetMetrics(WinMTRMetrics *m)
+{
+	WaitForSingleObject(ghMutex, INFINITE);
+	m->Merge(metrics);
+	ReleaseMutex(ghMutex);
+}
+
+int WinMTRNet::GetResponders(int at)
+{
+	WaitForSingleObject(ghMutex, INFINITE);
+	int ret = hopset[at].count;
+	ReleaseMutex(ghMutex);
+	return ret;
+}
+
+int WinMTRNet::GetFlowResponder(int at, int flow)
+{
+	return flowResponder[at][flow];
+}
+
+int WinMTRNet::GetMultipathProbes(int k)
+{
+	return mdaProbes[k];
+}
+
+WinMTRSeries *WinMTRNet::GetSeries()
+{
+	return series;
+}
+
+bool WinMTRNet::GetResponder(int at, int i, s_responder *r)
+{
+	WaitForSingleObject(ghMutex, INFINITE);
+	bool ret = (i >= 0 && i < hopset[at].count);
+	if (ret)
+		*r = hopset[at].responder[i];
+	ReleaseMutex(ghMutex);
+	return ret;
+}
+
 int WinMTRNet::GetAddrUnsafe(int at)
 {
 	return ntohl(host[at].addr);
@@ -542,6 +1587,76 @@ int	WinMTRNet::GetJIntaUnsafe(int at)
 	return host[at].jinta;
 }
 
+int WinMTRNet::GetP95Unsafe(int at)
+{
+	return WinMTRStats::Percentile(host[at].hist, host[at].returned, host[at].worst, 95);
+}
+
+// Mbit/s of the link into the hop, from the growth of the slope since
+// the previous hop that answered, 0 if unknown
+float WinMTRNet::GetCapacityUnsafe(int at)
+{
+	double slope, prev = 0;
+
+	if (!CapacitySlope(at, &slope))
+		return 0;
+	for (int i = at - 1; i >= 0; i--)
+		if (CapacitySlope(i, &prev))
+			break;
+	if (slope - prev <= 0)
+		return 0;
+	return (float)(8 / (slope - prev));
+}
+
+int WinMTRNet::GetRtoUnsafe(int at)
+{
+	return rto[at].rto;
+}
+
+int WinMTRNet::GetLateUnsafe(int at)
+{
+	return order[at].late;
+}
+
+int WinMTRNet::GetDuplicatesUnsafe(int at)
+{
+	return order[at].duplicate;
+}
+
+int WinMTRNet::GetReorderedUnsafe(int at)
+{
+	return order[at].reordered;
+}
+
+// the part of the loss the hop passes on, what the later hops that answered
+// lose as well
+float WinMTRNet::GetForwardLossUnsafe(int at)
+{
+	float loss = GetPercentUnsafe(at);
+	int max = GetMaxUnsafe();
+
+	for (int i = at + 1; i < max; i++)
+		if (host[i].returned > 0 && GetPercentUnsafe(i) < loss)
+			loss = GetPercentUnsafe(i);
+	return loss;
+}
+
+// --police, the rest of the loss of a policed hop
+float WinMTRNet::GetPolicedLossUnsafe(int at)
+{
+	if (!police[at].policed)
+		return 0;
+	return GetPercentUnsafe(at) - GetForwardLossUnsafe(at);
+}
+
+int WinMTRNet::GetMtuUnsafe(int at)
+{
+	int lo, hi;
+
+	MtuBounds(at, &lo, &hi);
+	return lo;
+}
+
 int WinMTRNet::GetMaxUnsafe()
 {
 	int max = MAX_HOPS;
@@ -562,17 +1677,28 @@ int WinMTRNet::GetMaxUnsafe()
 	return max;
 }
 
+//*****************************************************************************
+// WinMTRNet::SetAddr
+//
+// Under ghMutex.
+//*****************************************************************************
 void WinMTRNet::SetAddr(int at, __int32 addr)
 {
 	if(host[at].addr == 0 && addr != 0) {
-		TRACE_MSG("Start DnsResolverThread for new address " << addr << ". Old addr value was " << host[at].addr);
+		TRACE_INFO(TRACE_NEW_ADDR, at + 1, ntohl(addr), ntohl(host[at].addr));
 		host[at].addr = addr;
 		if(wmtrparams->useDNS)
 		{
 			dns_resolver_thread *dnt = new dns_resolver_thread;
 			dnt->index = at;
 			dnt->winmtr = this;
-			_beginthread(DnsResolverThread, 0, dnt);
+			if (resolvers++ == 0)
+				ResetEvent(hResolved);
+			if (_beginthread(DnsResolverThread, 0, dnt) == -1L) {
+				if (--resolvers == 0)
+					SetEvent(hResolved);
+				delete dnt;
+			}
 		}
 	}
 }
@@ -584,8 +1710,8 @@ void WinMTRNet::SetName(int at, char *n)
 
 void DnsResolverThread(void *p)
 {
-	TRACE_MSG("DNS resolver thread started.");
 	dns_resolver_thread *dnt = (dns_resolver_thread*)p;
+	TRACE_DEBUG(TRACE_RESOLVER_START, dnt->index + 1, 0, 0);
 	WinMTRNet* wn = dnt->winmtr;
 
 	struct hostent *phent ;
@@ -595,17 +1721,24 @@ void DnsResolverThread(void *p)
 	sprintf (buf, "%d.%d.%d.%d", (addr >> 24) & 0xff, (addr >> 16) & 0xff, (addr >> 8) & 0xff, addr & 0xff);
 
 	int haddr = htonl(addr);
+	LONGLONG start = WinMTRMetrics::Now();
 	phent = gethostbyaddr( (const char*)&haddr, sizeof(int), AF_INET);
+	LONGLONG end = WinMTRMetrics::Now();
 
 	WaitForSingleObject(wn->ghMutex, INFINITE);
+	wn->metrics.Add(METRIC_RESOLVER, start, end);
 	if(phent) {
 		wn->SetName(dnt->index, phent->h_name);
 	} else {
 		wn->SetName(dnt->index, buf);
 	}
+	TRACE_DEBUG(TRACE_RESOLVER_STOP, dnt->index + 1, 0, 0);
+	// wn may be gone as soon as the mutex is released
+	if (--wn->resolvers == 0)
+		SetEvent(wn->hResolved);
 	ReleaseMutex(wn->ghMutex);
-	
-	delete p;
-	TRACE_MSG("DNS resolver thread stopped.");
+
+	TRACE_THREAD_EXIT();
+	delete dnt;
 	_endthread();
 }
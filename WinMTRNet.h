@@ -17,15 +17,15 @@
 #define WINMTRNET_H_
 
 
-class WinMTRParams;
-
-typedef ip_option_information IPINFO, *PIPINFO, FAR *LPIPINFO;
+#include "WinMTRDetect.h"
+#include "WinMTRLib.h"
+#include "WinMTRMetrics.h"
 
-#ifdef _WIN64
-typedef icmp_echo_reply32 ICMPECHO, *PICMPECHO, FAR *LPICMPECHO;
-#else
-typedef icmp_echo_reply ICMPECHO, *PICMPECHO, FAR *LPICMPECHO;
-#endif
+class WinMTRParams;
+class WinMTREngine;
+class WinMTRSeries;
+class WinMTRMatrix;
+struct s_lockhop;
 
 struct s_nethost {
   __int32 addr;		// IP as a decimal, big endian
@@ -37,13 +37,126 @@ struct s_nethost {
   float avg;			// average
   float var;		    // variance
   float gmean;			// geometric mean
+  double logsum;		// sum of ln(rtt), gmean = exp(logsum / returned)
   int jitter;			// current jitter, defined as t1-t0
   float javg;			// avg jitter
   int jworst;			// max jitter
   int jinta;			// estimated variance,? rfc1889's "Interarrival Jitter"
+  unsigned int hist[STATS_BUCKETS];	// RTT histogram
   char name[255];
 };
 
+struct s_responder {
+	__int32 addr;		// network byte order
+	int returned;
+	int last;
+	int best;
+	int worst;
+	float avg;
+};
+
+// --pmtu: the state of the size search of one TTL, sizes are IP packet sizes
+struct s_pmtu {
+	int lo;				// largest size that reached the hop, 0 if none yet
+	int hi;				// smallest size that did not, PMTU_MAX + 1 if none yet
+	int tooBig;			// smallest size answered too big, bounds the later hops too
+	int inflight[PMTU_LANES];	// size probed by each lane, 0 if idle
+	int tries[PMTU_LANES];		// unanswered probes of that size
+	__int32 reporter;	// network byte order, the hop that said too big
+};
+
+// --capacity: the minimum RTT of every probe size of one TTL
+struct s_capacity {
+	int minRtt[CAPACITY_SIZES];	// us, 0 if none yet
+	int stable;			// rounds over all sizes without a new minimum
+	bool improved;		// a new minimum in the current round
+	bool echo;			// answered by the target, the reply is as big as the probe
+};
+
+// --train: the probes of one train to one TTL, the train is the cycle
+struct s_trainslot {
+	int cycle;			// 0 if unused
+	int sent;
+	int lost;
+	double rttSum;		// ms, of the replies
+};
+
+// --train: the trains of one TTL, folded into sums once they are complete
+struct s_train {
+	s_trainslot slot[TRAIN_SLOTS];
+	int trains;
+	double sent, lost;	// sums over the trains of n, l, n^2, l^2 and n * l
+	double sent2, lost2, sentLost;
+	double worst;		// highest loss ratio of a train
+	int rttTrains;		// trains with a reply
+	double rttSum, rttSum2;	// of the mean RTT of a train
+};
+
+// --train: the estimates of one TTL with their confidence intervals
+struct s_trainstats {
+	int trains;
+	int sent;
+	int lost;
+	float loss, lossLow, lossHigh;	// percent
+	float worst;					// percent
+	float rtt, rttLow, rttHigh;		// ms, mean of the train means
+};
+
+// --rto: the retransmission timeout estimator of one TTL, as in RFC 6298
+struct s_rto {
+	float srtt;			// ms, 0 before the first reply
+	float rttvar;		// ms
+	int rto;			// ms
+};
+
+// the replies of one TTL that did not come as expected
+struct s_order {
+	int late;			// after the probe was counted lost, within --late
+	int duplicate;		// more than one reply to a probe
+	int reordered;		// a reply to a probe older than one answered already
+};
+
+// --police: the probes of one TTL at each probe rate, to tell ICMP rate
+// limiting from loss on the path
+struct s_police {
+	int level;			// probed every interval * 2^level
+	int xmit[POLICE_LEVELS];
+	int lost[POLICE_LEVELS];
+	bool policed;		// the loss fell when the rate did
+	bool independent;	// it did not, the hop is probed at the interval again
+};
+
+// --tos: the probes of one TOS class to one TTL
+struct s_tosclass {
+	int xmit;
+	int returned;
+	int best;
+	int worst;
+	float avg;
+	float var;			// sum of squared differences from the mean
+	unsigned int hist[STATS_BUCKETS];
+};
+
+// --tos: the statistics of one TOS class at one TTL
+struct s_tosstats {
+	int tos;
+	int sent;
+	int returned;
+	float loss;			// percent
+	float avg;			// ms
+	float stdev;		// ms
+	int best;
+	int p95;
+};
+
+// the addresses that answered for one TTL, ECMP branches or route changes
+struct s_hopset {
+	int count;
+	int current;		// index of the latest responder, checked first
+	int others;			// replies from addresses beyond MAX_RESPONDERS
+	struct s_responder responder[MAX_RESPONDERS];
+};
+
 //*****************************************************************************
 // CLASS:  WinMTRNet
 //
@@ -51,22 +164,26 @@ struct s_nethost {
 //*****************************************************************************
 
 class WinMTRNet {
-	typedef HANDLE (WINAPI *LPFNICMPCREATEFILE)(VOID);
-	typedef BOOL  (WINAPI *LPFNICMPCLOSEHANDLE)(HANDLE);
-	typedef DWORD (WINAPI *LPFNICMPSENDECHO)(HANDLE, u_long, LPVOID, WORD, LPVOID, LPVOID, DWORD, DWORD);
-
-	friend void FinishThread(void *p);
-	friend void TraceThread(void *p);
+	friend class WinMTREngine;
+	friend class WinMTRStats;
+	friend class WinMTRCompact;
 	friend void DnsResolverThread(void *p);
 
 public:
 
-	WinMTRNet(WinMTRParams *p);
+	WinMTRNet(WinMTRParams *p, WinMTREngine *e);
 	~WinMTRNet();
 	void	DoTrace(int address, bool async);
 	void	ResetHops();
 	void	StopTrace();
 	bool	IsTracing();
+	bool	WaitTrace(DWORD ms);
+	void	SetProbeCallback(wmtr_probe_callback cb, void *context);
+	void	SetEventCallback(wmtr_event_callback cb, void *context);
+	int		GetEvents();
+
+	static int	ResolveAddr(const char *s);
+	static int	CapacitySize(int i);
 
 	int		GetAddr(int at);
 	int		GetName(int at, char *n);
@@ -84,7 +201,31 @@ public:
 	float	GetJAvg(int at);
 	int		GetJWorst(int at);
 	int		GetJInta(int at);
+	int		GetP95(int at);
+	int		GetMtu(int at);
+	__int32	GetMtuReporter(int at);
+	float	GetCapacity(int at);
+	void	GetTrain(int at, s_trainstats *t);
+	int		GetRto(int at);
+	int		GetLate(int at);
+	int		GetDuplicates(int at);
+	int		GetReordered(int at);
+	float	GetForwardLoss(int at);
+	float	GetPolicedLoss(int at);
+	bool	GetPoliced(int at);
+	int		GetBackoff(int at);
+	void	GetTos(int at, int lane, s_tosstats *t);
+	// --lockstep, hop has GetMax() entries, returns the cycles analyzed
+	int		GetLockstep(s_lockhop *hop, int *hops, int *targetLost);
 	int		GetMax();
+	int		GetConverged();
+	int		GetProbesSent();
+	void	GetMetrics(WinMTRMetrics *m);
+	int		GetResponders(int at);
+	bool	GetResponder(int at, int i, s_responder *r);
+	int		GetFlowResponder(int at, int flow);
+	int		GetMultipathProbes(int k);
+	WinMTRSeries	*GetSeries();	// NULL unless probes are recorded
 
 	// these getter versions are not thread safe, but significantly faster
 	int		GetAddrUnsafe(int at);
@@ -103,28 +244,96 @@ public:
 	float	GetJAvgUnsafe(int at);
 	int		GetJWorstUnsafe(int at);
 	int		GetJIntaUnsafe(int at);
+	int		GetP95Unsafe(int at);
+	int		GetMtuUnsafe(int at);
+	float	GetCapacityUnsafe(int at);
+	int		GetRtoUnsafe(int at);
+	int		GetLateUnsafe(int at);
+	int		GetDuplicatesUnsafe(int at);
+	int		GetReorderedUnsafe(int at);
+	float	GetForwardLossUnsafe(int at);
+	float	GetPolicedLossUnsafe(int at);
 	int		GetMaxUnsafe();
 
 private:
+	void	ProcessReply(int at, DWORD replies, PICMPECHO icmp_echo_reply, WinMTRMetrics *metrics);
+	void	NotifyProbe(int at, int cycle, DWORD replies, PICMPECHO icmp_echo_reply);
+	void	DetectChange(int at, DWORD replies, PICMPECHO icmp_echo_reply);
+	s_responder	*AddResponder(int at, __int32 addr, WinMTRMetrics *metrics);
+	bool	MultipathDone(int at);
+	bool	IsSettled();
+	bool	HopConverged(int at);
+	bool	AdaptiveDone(int at);
+	DWORD	AdaptiveInterval(DWORD interval);
+	void	MtuBounds(int at, int *lo, int *hi);
+	int		NextMtuProbe(int at, int lane);
+	void	ProcessMtu(int at, int lane, int size, DWORD replies, PICMPECHO icmp_echo_reply);
+	void	RecordCapacity(int at, int cycle, int rtt, DWORD replies, PICMPECHO icmp_echo_reply);
+	bool	CapacityDone(int at);
+	bool	CapacitySlope(int at, double *slope);
+	void	RecordTrain(int at, int cycle, DWORD replies, PICMPECHO icmp_echo_reply);
+	static void	FoldTrain(s_train *t, const s_trainslot *s);
+	DWORD	ProbeTimeout(int at);
+	void	UpdateRto(int at, DWORD replies, PICMPECHO icmp_echo_reply);
+	void	CreditLate(int at, int lane, int level, int cycle, PICMPECHO icmp_echo_reply, WinMTRMetrics *metrics);
+	void	RecordOrder(int at, int duplicates, bool reordered);
+	void	RecordPolice(int at, int level, DWORD replies, PICMPECHO icmp_echo_reply);
+	bool	ExcessLoss(int at, int level);
+	DWORD	PoliceInterval(int at, DWORD interval);
+	void	RecordTos(int at, int lane, DWORD replies, PICMPECHO icmp_echo_reply);
+	void	RecordFlow(int at, int flow, DWORD replies, PICMPECHO icmp_echo_reply);
+	void	RecordSample(int at, DWORD sentAt, DWORD replies, PICMPECHO icmp_echo_reply);
+	void	EmitEvent(wmtr_event *event);
 	void	SetAddr(int at, __int32 addr);
 	void	SetName(int at, char *n);
 
 private:
-	HANDLE				hThreads[MAX_HOPS];
+	WinMTREngine		*engine;
+	volatile LONG		activeTasks;
+	int					lanes;			// engine tasks per TTL
+	volatile LONG		probesSent;		// --precision, by all tasks
+	volatile LONG		converged[MAX_HOPS];	// --precision, 1 once the hop stopped converged
+	HANDLE				hDone;
 
 	WinMTRParams		*wmtrparams;
+	wmtr_probe_callback	probeCallback;
+	void				*probeContext;
+	wmtr_event_callback	eventCallback;
+	void				*eventContext;
+	volatile LONG		events;
 	__int32				last_remote_addr;
-	bool				tracing;
+	volatile bool		tracing;
+	volatile bool		settled;		// --fast, the remaining probes are skipped
 	bool				initialized;
-    HANDLE				hICMP;
-	LPFNICMPCREATEFILE	lpfnIcmpCreateFile;
-	LPFNICMPCLOSEHANDLE lpfnIcmpCloseHandle;
-	LPFNICMPSENDECHO	lpfnIcmpSendEcho;
-
-	HINSTANCE			hICMP_DLL;
 
+	// the statistics of a hop are only written by the engine worker that
+	// currently owns its task, ghMutex guards addresses and names
 	struct s_nethost	host[MAX_HOPS];
+	struct s_hopset		hopset[MAX_HOPS];	// written like host, grows under ghMutex
+
+	// multipath discovery: the responder index each flow id reached per hop,
+	// and the replies needed to rule out one more branch after seeing k
+	signed char			flowResponder[MAX_HOPS][MAX_FLOWS];
+	int					mdaProbes[MAX_RESPONDERS + 1];
+	double				confidenceZ;	// normal quantile of the confidence
+	WinMTRDetect		detect[MAX_HOPS];	// written like host
+	s_pmtu				pmtu[MAX_HOPS];		// shared by the lanes of a hop, under ghMutex
+	s_capacity			capacity[MAX_HOPS];	// written like host
+	s_train				train[MAX_HOPS];	// written like host
+	s_rto				rto[MAX_HOPS];		// written like host
+	s_order				order[MAX_HOPS];	// written like host
+	s_police			police[MAX_HOPS];	// written like host
+	s_tosclass			tosclass[MAX_HOPS][MAX_TOS];	// one per lane, written like host
+	// the worker completing a probe holds the lock of the hop while it
+	// writes like host, readers of the per hop state above take it too
+	CRITICAL_SECTION	laneLock[MAX_HOPS];
+	WinMTRSeries		*series;		// every probe with --record, NULL otherwise
+	WinMTRMatrix		*matrix;		// every probe with --lockstep, NULL otherwise
+	DWORD				startTick;
 	HANDLE				ghMutex;
+	int					resolvers;		// resolver threads still running, guarded by ghMutex
+	HANDLE				hResolved;		// set while resolvers is 0
+	WinMTRMetrics		metrics;		// resolver timings, guarded by ghMutex
 };
 
 #endif	// ifndef WINMTRNET_H_
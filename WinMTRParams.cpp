@@ -12,8 +12,20 @@
 //*****************************************************************************
 
 WinMTRParams::WinMTRParams()
-	: reportToFile(FALSE)
+	: reportToFile(FALSE), metrics(false), server(false), detect(false), detectStop(false),
+	  multipath(false), confidence((float)DEFAULT_CONFIDENCE), record(0), range(false),
+	  rangeFrom(0), rangeTo(0), snapshotSeconds(0), snapshotCycles(0), rotateKB(0),
+	  rotateSeconds(0), traceLevel(0), fast(false),
+	  pmtu(false), capacity(false), train(0), rate(0),
+	  adaptive(false), precisionLoss(0), precisionRtt(0),
+	  rto(false), late((float)DEFAULT_LATE), police(false), tosCount(0),
+	  lockstep(false)
 {
+	simfile[0] = 0;
+	statsfile[0] = 0;
+	merge[0] = 0;
+	traceFile[0] = 0;
+	memset(tos, 0, sizeof(tos));
 }
 
 //*****************************************************************************
@@ -52,6 +64,15 @@ void WinMTRParams::SetPingSize(int ps)
 	pingsize = ps;
 }
 
+//*****************************************************************************
+// WinMTRParams::SetLate
+//
+//*****************************************************************************
+void WinMTRParams::SetLate(float l)
+{
+	late = l;
+}
+
 //*****************************************************************************
 // WinMTRParams::SetTimeout
 //
@@ -106,3 +127,246 @@ void WinMTRParams::SetFilename(const char *f)
 	reportToFile = TRUE;
 	_snprintf(filename, SIZE_FILENAME, "%s", f);
 }
+
+//*****************************************************************************
+// WinMTRParams::SetWorkers
+//
+//*****************************************************************************
+void WinMTRParams::SetWorkers(int w)
+{
+	workers = w;
+}
+
+//*****************************************************************************
+// WinMTRParams::SetSimFile
+//
+//*****************************************************************************
+void WinMTRParams::SetSimFile(const char *f)
+{
+	_snprintf(simfile, SIZE_FILENAME, "%s", f);
+}
+
+//*****************************************************************************
+// WinMTRParams::SetMetrics
+//
+//*****************************************************************************
+void WinMTRParams::SetMetrics(bool m)
+{
+	metrics = m;
+}
+
+//*****************************************************************************
+// WinMTRParams::SetServer
+//
+//*****************************************************************************
+void WinMTRParams::SetServer(bool s)
+{
+	server = s;
+}
+
+//*****************************************************************************
+// WinMTRParams::SetDetect
+//
+//*****************************************************************************
+void WinMTRParams::SetDetect(bool d)
+{
+	detect = d;
+}
+
+//*****************************************************************************
+// WinMTRParams::SetDetectStop
+//
+//*****************************************************************************
+void WinMTRParams::SetDetectStop(bool d)
+{
+	detectStop = d;
+}
+
+//*****************************************************************************
+// WinMTRParams::SetMultipath
+//
+//*****************************************************************************
+void WinMTRParams::SetMultipath(bool m)
+{
+	multipath = m;
+}
+
+//*****************************************************************************
+// WinMTRParams::SetConfidence
+//
+//*****************************************************************************
+void WinMTRParams::SetConfidence(float c)
+{
+	confidence = c;
+}
+
+//*****************************************************************************
+// WinMTRParams::SetStatsFile
+//
+//*****************************************************************************
+void WinMTRParams::SetStatsFile(const char *f)
+{
+	_snprintf(statsfile, SIZE_FILENAME, "%s", f);
+}
+
+//*****************************************************************************
+// WinMTRParams::SetMerge
+//
+//*****************************************************************************
+void WinMTRParams::SetMerge(const char *pattern)
+{
+	_snprintf(merge, SIZE_FILENAME, "%s", pattern);
+}
+
+//*****************************************************************************
+// WinMTRParams::SetRecord
+//
+//*****************************************************************************
+void WinMTRParams::SetRecord(int kb)
+{
+	record = kb;
+}
+
+//*****************************************************************************
+// WinMTRParams::SetRange
+//
+//*****************************************************************************
+void WinMTRParams::SetRange(float from, float to)
+{
+	range = true;
+	rangeFrom = from;
+	rangeTo = to;
+}
+
+//*****************************************************************************
+// WinMTRParams::SetSnapshot
+//
+//*****************************************************************************
+void WinMTRParams::SetSnapshot(float seconds, int cycles)
+{
+	snapshotSeconds = seconds;
+	snapshotCycles = cycles;
+}
+
+//*****************************************************************************
+// WinMTRParams::SetRotate
+//
+//*****************************************************************************
+void WinMTRParams::SetRotate(int kb, int seconds)
+{
+	rotateKB = kb;
+	rotateSeconds = seconds;
+}
+
+//*****************************************************************************
+// WinMTRParams::SetTrace
+//
+//*****************************************************************************
+void WinMTRParams::SetTrace(int level)
+{
+	traceLevel = level;
+}
+
+//*****************************************************************************
+// WinMTRParams::SetTraceFile
+//
+//*****************************************************************************
+void WinMTRParams::SetTraceFile(const char *f)
+{
+	_snprintf(traceFile, SIZE_FILENAME, "%s", f);
+}
+
+//*****************************************************************************
+// WinMTRParams::SetFast
+//
+//*****************************************************************************
+void WinMTRParams::SetFast(bool f)
+{
+	fast = f;
+}
+
+//*****************************************************************************
+// WinMTRParams::SetPmtu
+//
+//*****************************************************************************
+void WinMTRParams::SetPmtu(bool p)
+{
+	pmtu = p;
+}
+
+//*****************************************************************************
+// WinMTRParams::SetCapacity
+//
+//*****************************************************************************
+void WinMTRParams::SetCapacity(bool c)
+{
+	capacity = c;
+}
+
+//*****************************************************************************
+// WinMTRParams::SetTrain
+//
+//*****************************************************************************
+void WinMTRParams::SetTrain(int k)
+{
+	train = k;
+}
+
+//*****************************************************************************
+// WinMTRParams::SetRate
+//
+//*****************************************************************************
+void WinMTRParams::SetRate(float pps)
+{
+	rate = pps;
+}
+
+//*****************************************************************************
+// WinMTRParams::SetPrecision
+//
+//*****************************************************************************
+void WinMTRParams::SetPrecision(float loss, float rtt)
+{
+	adaptive = true;
+	precisionLoss = loss;
+	precisionRtt = rtt;
+}
+
+//*****************************************************************************
+// WinMTRParams::SetRto
+//
+//*****************************************************************************
+void WinMTRParams::SetRto(bool r)
+{
+	rto = r;
+}
+
+//*****************************************************************************
+// WinMTRParams::SetPolice
+//
+//*****************************************************************************
+void WinMTRParams::SetPolice(bool p)
+{
+	police = p;
+}
+
+//*****************************************************************************
+// WinMTRParams::SetTos
+//
+// Values beyond MAX_TOS are dropped, count is kept for ValidateParams.
+//*****************************************************************************
+void WinMTRParams::SetTos(int count, const int *values)
+{
+	tosCount = count;
+	for (int i = 0; i < count && i < MAX_TOS; i++)
+		tos[i] = values[i];
+}
+
+//*****************************************************************************
+// WinMTRParams::SetLockstep
+//
+//*****************************************************************************
+void WinMTRParams::SetLockstep(bool l)
+{
+	lockstep = l;
+}
@@ -41,6 +41,40 @@ public:
 	char				fields[SIZE_FIELDS];
 	bool				reportToFile;
 	char				filename[SIZE_FILENAME];
+	int					workers;
+	char				simfile[SIZE_FILENAME];
+	bool				metrics;
+	bool				server;
+	bool				detect;
+	bool				detectStop;
+	bool				multipath;
+	float				confidence;		// percent
+	char				statsfile[SIZE_FILENAME];
+	char				merge[SIZE_FILENAME];	// pattern of statistics files
+	int					record;			// KB of recorded probes per hop, 0 for none
+	bool				range;
+	float				rangeFrom;		// seconds since the start
+	float				rangeTo;
+	float				snapshotSeconds;	// 0 for none
+	int					snapshotCycles;		// 0 for none
+	int					rotateKB;
+	int					rotateSeconds;
+	int					traceLevel;		// TRACE_LEVEL_*, none by default
+	char				traceFile[SIZE_FILENAME];	// stderr if empty
+	bool				fast;			// end once the statistics are settled
+	bool				pmtu;			// search the path MTU instead of cycles
+	bool				capacity;		// estimate link capacities, cycles is the budget
+	int					train;			// probes per TTL and cycle, 0 for plain probes
+	float				rate;			// probes per second of the engine, 0 for no limit
+	bool				adaptive;		// probe every hop until it converges
+	float				precisionLoss;	// percentage points, half width
+	float				precisionRtt;	// ms, half width, 0 for none
+	bool				rto;			// per hop timeouts, timeout is the ceiling
+	float				late;			// s after the timeout replies are still credited
+	bool				police;			// back off from hops that rate limit ICMP
+	int					tosCount;		// TOS classes probed side by side, 0 for TOS 0 only
+	int					tos[MAX_TOS];	// TOS byte of each class
+	bool				lockstep;		// every cycle probes all TTLs at once
 
 	WinMTRParams();
 
@@ -49,11 +83,38 @@ public:
 	void SetInterval(float i);
 	void SetPingSize(int ps);
 	void SetTimeout(float t);
+	void SetLate(float l);
 	void SetReport(bool b);
 	void SetUseDNS(bool udns);
 	void SetWide(bool w);
 	void SetFields(const char *f);
 	void SetFilename(const char *f);
+	void SetWorkers(int w);
+	void SetSimFile(const char *f);
+	void SetMetrics(bool m);
+	void SetServer(bool s);
+	void SetDetect(bool d);
+	void SetDetectStop(bool d);
+	void SetMultipath(bool m);
+	void SetConfidence(float c);
+	void SetStatsFile(const char *f);
+	void SetMerge(const char *pattern);
+	void SetRecord(int kb);
+	void SetRange(float from, float to);
+	void SetSnapshot(float seconds, int cycles);
+	void SetRotate(int kb, int seconds);
+	void SetTrace(int level);
+	void SetTraceFile(const char *f);
+	void SetFast(bool f);
+	void SetPmtu(bool p);
+	void SetCapacity(bool c);
+	void SetTrain(int k);
+	void SetRate(float pps);
+	void SetPrecision(float loss, float rtt);
+	void SetRto(bool r);
+	void SetPolice(bool p);
+	void SetTos(int count, const int *values);
+	void SetLockstep(bool l);
 };
 
 #endif	// ifndef WINMTRPARAMS_H_
\ No newline at end of file
@@ -0,0 +1,77 @@
+//*****************************************************************************
+// FILE:            WinMTRPool.cpp
+//
+//
+//*****************************************************************************
+
+#include "WinMTRPool.h"
+
+//*****************************************************************************
+// WinMTRPool::WinMTRPool
+//
+//*****************************************************************************
+WinMTRPool::WinMTRPool()
+{
+}
+
+//*****************************************************************************
+// WinMTRPool::~WinMTRPool
+//
+//*****************************************************************************
+WinMTRPool::~WinMTRPool()
+{
+	for (int c = 0; c < POOL_CLASSES; c++)
+		for (size_t i = 0; i < freelist[c].size(); i++)
+			delete [] freelist[c][i];
+}
+
+//*****************************************************************************
+// WinMTRPool::Class
+//
+// Smallest class holding size bytes, -1 if none does.
+//*****************************************************************************
+int WinMTRPool::Class(DWORD size)
+{
+	for (int c = 0; c < POOL_CLASSES; c++)
+		if (size <= ((DWORD)1 << (POOL_MIN_SHIFT + c)))
+			return c;
+	return -1;
+}
+
+//*****************************************************************************
+// WinMTRPool::Get
+//
+// Returns a buffer of at least size bytes, actual receives its real size.
+//*****************************************************************************
+char *WinMTRPool::Get(DWORD size, DWORD *actual)
+{
+	int c = Class(size);
+
+	if (c < 0) {
+		*actual = size;
+		return new char[size];
+	}
+
+	*actual = (DWORD)1 << (POOL_MIN_SHIFT + c);
+	if (freelist[c].empty())
+		return new char[*actual];
+
+	char *buf = freelist[c].back();
+	freelist[c].pop_back();
+	return buf;
+}
+
+//*****************************************************************************
+// WinMTRPool::Put
+//
+// size has to be the actual size returned by Get.
+//*****************************************************************************
+void WinMTRPool::Put(char *buf, DWORD size)
+{
+	int c = Class(size);
+
+	if (c < 0)
+		delete [] buf;
+	else
+		freelist[c].push_back(buf);
+}
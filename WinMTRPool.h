@@ -0,0 +1,49 @@
+//*****************************************************************************
+// FILE:            WinMTRPool.h
+//
+//
+// DESCRIPTION: The WinMTRPool class recycles reply buffers between probes.
+//
+//
+// NOTES: Buffers come in power-of-two size classes starting at 256 bytes.
+//        A pool belongs to one engine worker and is not thread safe, buffers
+//        are taken when a probe is sent and returned when it completes, so
+//        only probes in flight hold reply memory.
+//
+//*****************************************************************************
+
+#ifndef WINMTRPOOL_H_
+#define WINMTRPOOL_H_
+
+#include "WinMTRGlobal.h"
+#include <vector>
+
+#define POOL_MIN_SHIFT		8
+#define POOL_CLASSES		8		// 256 bytes .. 32 KB
+
+// room IcmpSendEcho2 needs for one reply to a request of n bytes: the echo
+// reply, the echoed data or the ICMP error payload, and the IO_STATUS_BLOCK
+#define REPLY_SIZE(n)		(sizeof(ICMPECHO) + (n) + 8 + 2 * sizeof(ULONG_PTR))
+
+//*****************************************************************************
+// CLASS:  WinMTRPool
+//
+//
+//*****************************************************************************
+
+class WinMTRPool {
+public:
+	WinMTRPool();
+	~WinMTRPool();
+
+	char	*Get(DWORD size, DWORD *actual);
+	void	Put(char *buf, DWORD size);
+
+private:
+	static int	Class(DWORD size);
+
+private:
+	std::vector<char*> freelist[POOL_CLASSES];
+};
+
+#endif	// ifndef WINMTRPOOL_H_
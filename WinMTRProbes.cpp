@@ -0,0 +1,82 @@
+//*****************************************************************************
+// FILE:            WinMTRProbes.cpp
+//
+//
+//*****************************************************************************
+
+#include "WinMTRProbes.h"
+#include "WinMTREngine.h"
+
+//*****************************************************************************
+// WinMTRProbes::WinMTRProbes
+//
+//*****************************************************************************
+WinMTRProbes::WinMTRProbes()
+	: slot(NULL), next(0)
+{
+}
+
+//*****************************************************************************
+// WinMTRProbes::~WinMTRProbes
+//
+//*****************************************************************************
+WinMTRProbes::~WinMTRProbes()
+{
+	delete [] slot;
+}
+
+//*****************************************************************************
+// WinMTRProbes::IsFull
+//
+//*****************************************************************************
+bool WinMTRProbes::IsFull()
+{
+	return slot != NULL && slot[next & (PROBE_SLOTS - 1)].busy;
+}
+
+//*****************************************************************************
+// WinMTRProbes::Insert
+//
+//*****************************************************************************
+probe_req *WinMTRProbes::Insert()
+{
+	if (slot == NULL) {
+		slot = new probe_req[PROBE_SLOTS];
+		for (int i = 0; i < PROBE_SLOTS; i++)
+			slot[i].busy = false;
+	}
+
+	probe_req *req = &slot[next & (PROBE_SLOTS - 1)];
+	if (req->busy)
+		return NULL;
+
+	next++;
+	req->busy = true;
+	req->expired = false;
+	return req;
+}
+
+//*****************************************************************************
+// WinMTRProbes::Remove
+//
+//*****************************************************************************
+void WinMTRProbes::Remove(probe_req *req)
+{
+	req->busy = false;
+}
+
+//*****************************************************************************
+// WinMTRProbes::Orphan
+//
+// Called once per finished task with requests still out, so the scan of
+// the whole table does not matter.
+//*****************************************************************************
+void WinMTRProbes::Orphan(probe_task *task)
+{
+	if (slot == NULL)
+		return;
+
+	for (int i = 0; i < PROBE_SLOTS; i++)
+		if (slot[i].busy && slot[i].task == task)
+			slot[i].task = NULL;
+}
@@ -0,0 +1,52 @@
+//*****************************************************************************
+// FILE:            WinMTRProbes.h
+//
+//
+// DESCRIPTION: The WinMTRProbes class is the table of the echo requests an
+//              engine worker has outstanding.
+//
+//
+// NOTES: A request stays in the table from its send until the backend
+//        completes it, which with a --late window may be well after the
+//        probe was counted lost, so a task can send its next probe while
+//        earlier ones are still out. The slots are taken in turn, so insert
+//        and removal are O(1). When the next slot is still taken the table
+//        is full and the worker holds its probes back. Like the pool it belongs to one worker and
+//        is not thread safe; the slots are allocated on first use.
+//
+//*****************************************************************************
+
+#ifndef WINMTRPROBES_H_
+#define WINMTRPROBES_H_
+
+#include "WinMTRGlobal.h"
+
+#define PROBE_SLOTS			4096	// requests outstanding per worker, a power of 2
+
+struct probe_req;
+struct probe_task;
+
+//*****************************************************************************
+// CLASS:  WinMTRProbes
+//
+//
+//*****************************************************************************
+
+class WinMTRProbes {
+public:
+	WinMTRProbes();
+	~WinMTRProbes();
+
+	bool		IsFull();
+	// the next slot, NULL if the table is full
+	probe_req	*Insert();
+	void		Remove(probe_req *req);
+	// the completions of the outstanding requests of task are only cleaned up
+	void		Orphan(probe_task *task);
+
+private:
+	probe_req	*slot;
+	DWORD		next;
+};
+
+#endif	// ifndef WINMTRPROBES_H_
@@ -0,0 +1,308 @@
+//*****************************************************************************
+// FILE:            WinMTRSeries.cpp
+//
+//
+//*****************************************************************************
+
+#include "WinMTRSeries.h"
+
+static inline unsigned int ZigZag(int v)
+{
+	return ((unsigned int)v << 1) ^ (unsigned int)(v >> 31);
+}
+
+static inline int UnZigZag(unsigned int u)
+{
+	return (int)(u >> 1) ^ -(int)(u & 1);
+}
+
+//*****************************************************************************
+// WinMTRSeries::WinMTRSeries
+//
+//*****************************************************************************
+WinMTRSeries::WinMTRSeries(int limit)
+	: blocks(limit < 2 ? 2 : limit)
+{
+	for (int at = 0; at < MAX_HOPS; at++) {
+		InitializeCriticalSection(&hop[at].lock);
+		hop[at].block = NULL;
+		hop[at].head = 0;
+		hop[at].used = 0;
+		hop[at].samples = 0;
+	}
+}
+
+//*****************************************************************************
+// WinMTRSeries::~WinMTRSeries
+//
+//*****************************************************************************
+WinMTRSeries::~WinMTRSeries()
+{
+	for (int at = 0; at < MAX_HOPS; at++) {
+		delete [] hop[at].block;
+		DeleteCriticalSection(&hop[at].lock);
+	}
+}
+
+//*****************************************************************************
+// WinMTRSeries::Append
+//
+// Called by the engine workers owning the tasks of hop 'at', in the order
+// the probes complete. With lanes or late replies that is not the order
+// they were sent, time deltas may be negative.
+//*****************************************************************************
+void WinMTRSeries::Append(int at, DWORD time, int rtt)
+{
+	s_hopseries *h = &hop[at];
+	s_seriesblock *b = NULL;
+
+	EnterCriticalSection(&h->lock);
+	if (h->block == NULL)
+		h->block = new s_seriesblock[blocks];
+	if (h->used)
+		b = &h->block[(h->head + h->used - 1) % blocks];
+
+	if (b == NULL || b->bits + SERIES_MAX_BITS > sizeof(b->data) * 8) {
+		if (h->used == blocks) {
+			h->head = (h->head + 1) % blocks;
+			h->used--;
+		}
+		b = &h->block[(h->head + h->used) % blocks];
+		h->used++;
+		b->first = b->low = b->high = time;
+		b->firstRtt = rtt;
+		b->count = 1;
+		b->bits = 0;
+		h->prevDelta = 0;
+	} else {
+		int delta = (int)(time - h->prevTime);
+		unsigned int z = ZigZag(delta - h->prevDelta);
+		if (z == 0) {
+			PutBits(b, 0, 1);
+		} else if (z < (1 << 7)) {
+			PutBits(b, 2, 2);
+			PutBits(b, z, 7);
+		} else if (z < (1 << 12)) {
+			PutBits(b, 6, 3);
+			PutBits(b, z, 12);
+		} else if (z < (1 << 20)) {
+			PutBits(b, 14, 4);
+			PutBits(b, z, 20);
+		} else {
+			PutBits(b, 15, 4);
+			PutBits(b, z, 32);
+		}
+
+		z = ZigZag(rtt - h->prevRtt);
+		if (z == 0) {
+			PutBits(b, 0, 1);
+		} else if (z < (1 << 6)) {
+			PutBits(b, 2, 2);
+			PutBits(b, z, 6);
+		} else if (z < (1 << 12)) {
+			PutBits(b, 6, 3);
+			PutBits(b, z, 12);
+		} else {
+			PutBits(b, 7, 3);
+			PutBits(b, z, 32);
+		}
+
+		b->count++;
+		if (time < b->low) b->low = time;
+		if (time > b->high) b->high = time;
+		h->prevDelta = delta;
+	}
+	h->prevTime = time;
+	h->prevRtt = rtt;
+	h->samples++;
+	LeaveCriticalSection(&h->lock);
+}
+
+//*****************************************************************************
+// WinMTRSeries::PutBits
+//
+// Appends the low n bits of value, most significant first.
+//*****************************************************************************
+void WinMTRSeries::PutBits(s_seriesblock *b, unsigned int value, int n)
+{
+	while (n > 0) {
+		int room = 8 - (b->bits & 7);
+		int take = (n < room) ? n : room;
+		unsigned int chunk = (value >> (n - take)) & ((1u << take) - 1);
+		unsigned char *p = &b->data[b->bits >> 3];
+
+		if ((b->bits & 7) == 0)
+			*p = 0;
+		*p |= (unsigned char)(chunk << (room - take));
+		b->bits += take;
+		n -= take;
+	}
+}
+
+//*****************************************************************************
+// WinMTRSeries::GetBits
+//
+//*****************************************************************************
+unsigned int WinMTRSeries::GetBits(const s_seriesblock *b, DWORD *pos, int n)
+{
+	unsigned int value = 0;
+
+	while (n > 0) {
+		int room = 8 - (*pos & 7);
+		int take = (n < room) ? n : room;
+		unsigned int byte = b->data[*pos >> 3];
+
+		value = (value << take) | ((byte >> (room - take)) & ((1u << take) - 1));
+		*pos += take;
+		n -= take;
+	}
+	return value;
+}
+
+//*****************************************************************************
+// WinMTRSeries::Decode
+//
+//*****************************************************************************
+void WinMTRSeries::Decode(const s_seriesblock *b, DWORD from, DWORD to,
+	std::vector<s_sample>& out)
+{
+	s_sample s;
+	DWORD pos = 0;
+	int delta = 0;
+
+	s.time = b->first;
+	s.rtt = b->firstRtt;
+	for (int i = 0; ; ) {
+		if (s.time >= from && s.time <= to)
+			out.push_back(s);
+		if (++i == b->count)
+			break;
+
+		int dod;
+		if (GetBits(b, &pos, 1) == 0)
+			dod = 0;
+		else if (GetBits(b, &pos, 1) == 0)
+			dod = UnZigZag(GetBits(b, &pos, 7));
+		else if (GetBits(b, &pos, 1) == 0)
+			dod = UnZigZag(GetBits(b, &pos, 12));
+		else if (GetBits(b, &pos, 1) == 0)
+			dod = UnZigZag(GetBits(b, &pos, 20));
+		else
+			dod = UnZigZag(GetBits(b, &pos, 32));
+		delta += dod;
+		s.time += delta;
+
+		if (GetBits(b, &pos, 1) == 0)
+			;
+		else if (GetBits(b, &pos, 1) == 0)
+			s.rtt += UnZigZag(GetBits(b, &pos, 6));
+		else if (GetBits(b, &pos, 1) == 0)
+			s.rtt += UnZigZag(GetBits(b, &pos, 12));
+		else
+			s.rtt += UnZigZag(GetBits(b, &pos, 32));
+	}
+}
+
+//*****************************************************************************
+// WinMTRSeries::Read
+//
+// Only the blocks overlapping [from, to] are decoded.
+//*****************************************************************************
+int WinMTRSeries::Read(int at, DWORD from, DWORD to, std::vector<s_sample>& out)
+{
+	s_hopseries *h = &hop[at];
+	size_t before = out.size();
+
+	EnterCriticalSection(&h->lock);
+	for (int i = 0; i < h->used; i++) {
+		const s_seriesblock *b = &h->block[(h->head + i) % blocks];
+		if (b->high < from || b->low > to)
+			continue;
+		Decode(b, from, to, out);
+	}
+	LeaveCriticalSection(&h->lock);
+	return (int)(out.size() - before);
+}
+
+//*****************************************************************************
+// WinMTRSeries::Summarize
+//
+// Replays the samples like WinMTRNet::ProcessReply. Responders are not
+// recorded per probe and are cleared.
+//*****************************************************************************
+void WinMTRSeries::Summarize(int at, DWORD from, DWORD to, s_hopstats *s)
+{
+	std::vector<s_sample> samples;
+
+	Read(at, from, to, samples);
+
+	s->xmit = s->returned = 0;
+	s->last = s->best = s->worst = 0;
+	s->mean = s->m2 = s->logsum = s->jsum = 0;
+	s->jitter = s->jworst = s->jinta = 0;
+	s->responders = s->others = 0;
+	memset(s->hist, 0, sizeof(s->hist));
+
+	for (size_t i = 0; i < samples.size(); i++) {
+		int rtt = samples[i].rtt;
+
+		s->xmit++;
+		if (rtt == SERIES_LOST)
+			continue;
+
+		s->jitter = (rtt > s->last) ? rtt - s->last : s->last - rtt;
+		s->last = rtt;
+		if (s->returned == 0) {
+			s->best = s->worst = rtt;
+			s->jitter = 0;
+		}
+		if (rtt < s->best) s->best = rtt;
+		if (rtt > s->worst) s->worst = rtt;
+		if (s->jitter > s->jworst) s->jworst = s->jitter;
+
+		s->returned++;
+		double d = rtt - s->mean;
+		s->mean += d / s->returned;
+		s->m2 += d * (rtt - s->mean);
+		s->jsum += s->jitter;
+		s->jinta += s->jitter - ((s->jinta + 8) >> 4);
+		s->logsum += log((double)rtt);
+		s->hist[WinMTRStats::Bucket(rtt)]++;
+	}
+}
+
+//*****************************************************************************
+// WinMTRSeries::GetBytes
+//
+// The encoded size of the samples kept, block headers included.
+//*****************************************************************************
+size_t WinMTRSeries::GetBytes()
+{
+	size_t bytes = 0;
+
+	for (int at = 0; at < MAX_HOPS; at++) {
+		s_hopseries *h = &hop[at];
+		EnterCriticalSection(&h->lock);
+		for (int i = 0; i < h->used; i++)
+			bytes += offsetof(s_seriesblock, data) + (h->block[(h->head + i) % blocks].bits + 7) / 8;
+		LeaveCriticalSection(&h->lock);
+	}
+	return bytes;
+}
+
+//*****************************************************************************
+// WinMTRSeries::GetSamples
+//
+// All samples appended, including those dropped with their blocks since.
+//*****************************************************************************
+__int64 WinMTRSeries::GetSamples()
+{
+	__int64 samples = 0;
+
+	for (int at = 0; at < MAX_HOPS; at++) {
+		EnterCriticalSection(&hop[at].lock);
+		samples += hop[at].samples;
+		LeaveCriticalSection(&hop[at].lock);
+	}
+	return samples;
+}
@@ -0,0 +1,93 @@
+//*****************************************************************************
+// FILE:            WinMTRSeries.h
+//
+//
+// DESCRIPTION: The WinMTRSeries class records every probe of a trace, its
+//              send time and RTT, compressed in fixed-size blocks per hop,
+//              so the statistics of any time range can be computed later.
+//
+//
+// NOTES: Like Gorilla (Pelkonen et al.), send times are stored as the
+//        difference of successive intervals with a prefix code, so probes
+//        sent on schedule take a single bit. RTTs are whole milliseconds
+//        and are stored as the zigzag encoded change from the previous
+//        probe with a prefix code of 1, 8, 15 or 35 bits. Each hop keeps at
+//        most a fixed number of blocks, once they are full the oldest block
+//        is dropped, so memory is bounded and the latest samples are kept.
+//        Probes are appended as they complete, which is not always the
+//        order they were sent, so each block keeps the earliest and latest
+//        send time it holds for range reads. The probe path appends under
+//        a per-hop lock that readers only take for the blocks they decode.
+//
+//*****************************************************************************
+
+#ifndef WINMTRSERIES_H_
+#define WINMTRSERIES_H_
+
+#include "WinMTRGlobal.h"
+#include "WinMTRStats.h"
+#include <stddef.h>
+#include <vector>
+
+#define SERIES_BLOCK_SIZE	512		// bytes per block, header included
+#define SERIES_MAX_BITS		71		// longest encoded sample
+#define SERIES_LOST			-1		// RTT of a probe without reply
+
+struct s_sample {
+	DWORD	time;		// ms since the trace started
+	int		rtt;		// ms, SERIES_LOST if lost
+};
+
+struct s_seriesblock {
+	DWORD	first;		// time of the first sample, where decoding starts
+	DWORD	low;		// earliest and latest time of the samples, they are
+	DWORD	high;		// appended as they complete, not as they were sent
+	int		firstRtt;
+	int		count;
+	DWORD	bits;		// used bits of data
+	unsigned char data[SERIES_BLOCK_SIZE - 6 * sizeof(DWORD)];
+};
+
+//*****************************************************************************
+// CLASS:  WinMTRSeries
+//
+//
+//*****************************************************************************
+
+class WinMTRSeries {
+public:
+	// limit is the number of blocks per hop
+	WinMTRSeries(int limit);
+	~WinMTRSeries();
+
+	void	Append(int at, DWORD time, int rtt);
+	// appends the samples sent in [from, to] to out, returns their number
+	int		Read(int at, DWORD from, DWORD to, std::vector<s_sample>& out);
+	// replaces the counters and RTT statistics of s by those of [from, to]
+	void	Summarize(int at, DWORD from, DWORD to, s_hopstats *s);
+	size_t	GetBytes();
+	__int64	GetSamples();
+
+private:
+	struct s_hopseries {
+		CRITICAL_SECTION	lock;
+		s_seriesblock		*block;		// ring of 'blocks' entries, allocated on first use
+		int					head;		// oldest block
+		int					used;
+		DWORD				prevTime;
+		int					prevDelta;
+		int					prevRtt;
+		__int64				samples;
+	};
+
+	static void		PutBits(s_seriesblock *b, unsigned int value, int n);
+	static unsigned int	GetBits(const s_seriesblock *b, DWORD *pos, int n);
+	static void		Decode(const s_seriesblock *b, DWORD from, DWORD to,
+						std::vector<s_sample>& out);
+
+private:
+	int				blocks;
+	s_hopseries		hop[MAX_HOPS];
+};
+
+#endif	// ifndef WINMTRSERIES_H_
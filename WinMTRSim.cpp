@@ -0,0 +1,448 @@
+//*****************************************************************************
+// FILE:            WinMTRSim.cpp
+//
+//
+//*****************************************************************************
+
+#include "WinMTRSim.h"
+#include <algorithm>
+
+//*****************************************************************************
+// WinMTRSimPath::WinMTRSimPath
+//
+//*****************************************************************************
+WinMTRSimPath::WinMTRSimPath()
+	: loaded(0)
+{
+	InitializeCriticalSection(&lock);
+}
+
+//*****************************************************************************
+// WinMTRSimPath::~WinMTRSimPath
+//
+//*****************************************************************************
+WinMTRSimPath::~WinMTRSimPath()
+{
+	DeleteCriticalSection(&lock);
+}
+
+//*****************************************************************************
+// WinMTRSimPath::Load
+//
+//
+//*****************************************************************************
+bool WinMTRSimPath::Load(const char *filename)
+{
+	FILE *file;
+	char line[512];
+	int lineno = 0;
+
+	file = fopen(filename, "r");
+	if (file == NULL) {
+		fprintf(stderr, "error: could not open simulated path '%s': %s\n",
+			filename, strerror(errno));
+		return false;
+	}
+
+	hops.clear();
+	first.clear();
+	while (fgets(line, sizeof(line), file)) {
+		char address[64];
+		int ttl;
+		s_simhop hop;
+
+		lineno++;
+		char *p = line;
+		while (*p == ' ' || *p == '\t') p++;
+		if (*p == '#' || *p == '\r' || *p == '\n' || *p == 0)
+			continue;
+
+		hop.jitter = 0;
+		hop.loss = 0;
+		hop.shiftStart = 0;
+		hop.shiftLength = 0;
+		hop.shiftRtt = 0;
+		hop.shiftLoss = 0;
+		hop.mtu = 0;
+		hop.rate = 0;
+		hop.dup = 0;
+		hop.police = 0;
+		hop.burst = 1;
+		hop.tos = -1;
+		hop.tosRtt = 0;
+		hop.tosLoss = 0;
+		hop.drop = 0;
+		hop.dropSlot = 50;
+		char *drop = strstr(p, "drop=");
+		if (drop) {
+			sscanf(drop + 5, "%f:%d", &hop.drop, &hop.dropSlot);
+			*drop = 0;
+		}
+		char *tos = strstr(p, "tos=");
+		if (tos) {
+			if (sscanf(tos + 4, "%i:%d:%f", &hop.tos, &hop.tosRtt, &hop.tosLoss) < 2)
+				hop.tos = -1;
+			*tos = 0;
+		}
+		char *police = strstr(p, "police=");
+		if (police) {
+			sscanf(police + 7, "%f:%d", &hop.police, &hop.burst);
+			*police = 0;
+		}
+		char *dup = strstr(p, "dup=");
+		if (dup) {
+			hop.dup = (float)atof(dup + 4);
+			*dup = 0;
+		}
+		char *rate = strstr(p, "rate=");
+		if (rate) {
+			hop.rate = atoi(rate + 5);
+			*rate = 0;
+		}
+		char *mtu = strstr(p, "mtu=");
+		if (mtu) {
+			hop.mtu = atoi(mtu + 4);
+			*mtu = 0;
+		}
+		char *shift = strstr(p, "shift=");
+		if (shift) {
+			*shift = 0;
+			shift += 6;
+		}
+		if (sscanf(p, "%d %63s %d %d %f", &ttl, address, &hop.rtt,
+				&hop.jitter, &hop.loss) < 3 || ttl < 1
+				|| (ttl != (int)first.size() && ttl != (int)first.size() + 1)
+				|| (shift && sscanf(shift, "%f:%f:%d:%f", &hop.shiftStart,
+				&hop.shiftLength, &hop.shiftRtt, &hop.shiftLoss) < 3)
+				|| (mtu && hop.mtu < PMTU_MIN) || (rate && hop.rate <= 0)
+				|| (dup && hop.dup <= 0)
+				|| (police && (hop.police <= 0 || hop.burst < 1))
+				|| (tos && (hop.tos < 0 || hop.tos > 255))
+				|| (drop && (hop.drop <= 0 || hop.dropSlot < 1))) {
+			fprintf(stderr, "error: %s:%d: expected '%d <address> <rtt> [jitter] [loss] [shift=S:D:RTT[:LOSS]] [mtu=BYTES] [rate=KBPS] [dup=PERCENT] [police=PPS[:BURST]] [tos=TOS:RTT[:LOSS]] [drop=PERCENT[:MS]]'\n",
+				filename, lineno, (int)first.size() + 1);
+			fclose(file);
+			return false;
+		}
+		if (ttl > (int)first.size())
+			first.push_back((int)hops.size());
+		hop.ttl = ttl;
+		hop.addr = inet_addr(address);
+		hops.push_back(hop);
+	}
+	fclose(file);
+	first.push_back((int)hops.size());
+	loaded = GetTickCount();
+	for (size_t i = 0; i < hops.size(); i++) {
+		hops[i].tokens = hops[i].burst;
+		hops[i].refilled = loaded;
+	}
+
+	if (hops.empty() || first.size() > MAX_HOPS + 1) {
+		fprintf(stderr, "error: simulated path '%s' must have 1 to %d hops\n",
+			filename, MAX_HOPS);
+		return false;
+	}
+	return true;
+}
+
+//*****************************************************************************
+// WinMTRSimPath::GetHops
+//
+//
+//*****************************************************************************
+int WinMTRSimPath::GetHops()
+{
+	return (int)first.size() - 1;
+}
+
+//*****************************************************************************
+// WinMTRSimPath::GetHop
+//
+// Probes that outlive the path are answered by the destination, pick in
+// [0, 1) selects the branch.
+//*****************************************************************************
+s_simhop *WinMTRSimPath::GetHop(int ttl, double pick)
+{
+	if (ttl > GetHops())
+		ttl = GetHops();
+	int n = first[ttl] - first[ttl - 1];
+	return &hops[first[ttl - 1] + (int)(pick * n)];
+}
+
+//*****************************************************************************
+// WinMTRSimPath::GetShift
+//
+// Sums the shifts active at 'now' on the hops up to ttl.
+//*****************************************************************************
+void WinMTRSimPath::GetShift(int ttl, DWORD now, int *rtt, float *loss)
+{
+	float t = (now - loaded) / 1000.0f;
+
+	*rtt = 0;
+	*loss = 0;
+	for (int i = 0; i < (int)hops.size() && hops[i].ttl <= ttl; i++) {
+		if (t >= hops[i].shiftStart && t < hops[i].shiftStart + hops[i].shiftLength) {
+			*rtt += hops[i].shiftRtt;
+			*loss += hops[i].shiftLoss;
+		}
+	}
+}
+
+//*****************************************************************************
+// WinMTRSimPath::GetClass
+//
+// Sums what the hops up to ttl add to probes with the TOS byte tos, only
+// the branch the probe takes at each TTL: that of its multipath flow, else
+// the one pick selects, as GetHop.
+//*****************************************************************************
+void WinMTRSimPath::GetClass(int ttl, int tos, int flow, double pick, int *rtt, float *loss)
+{
+	*rtt = 0;
+	*loss = 0;
+	if (ttl > GetHops())
+		ttl = GetHops();
+	for (int i = 1; i <= ttl; i++) {
+		s_simhop *hop = GetHop(i, (flow >= 0) ? WinMTRSim::FlowPick(flow, i) : pick);
+		if (hop->tos == tos) {
+			*rtt += hop->tosRtt;
+			*loss += hop->tosLoss;
+		}
+	}
+}
+
+//*****************************************************************************
+// WinMTRSimPath::IsDropped
+//
+// Whether a link up to ttl drops what passes it at 'now'. Whether a link
+// drops in a slot is a hash of the two, the same for all workers, first
+// branches only.
+//*****************************************************************************
+bool WinMTRSimPath::IsDropped(int ttl, DWORD now)
+{
+	if (ttl > GetHops())
+		ttl = GetHops();
+	for (int i = 1; i <= ttl; i++) {
+		s_simhop *hop = &hops[first[i - 1]];
+		if (hop->drop <= 0)
+			continue;
+		unsigned slot = (unsigned)((now - loaded) / hop->dropSlot);
+		if (WinMTRSim::FlowPick((int)slot, i) * 100.0 < hop->drop)
+			return true;
+	}
+	return false;
+}
+
+//*****************************************************************************
+// WinMTRSimPath::GetTooBig
+//
+// The TTL of the first link up to ttl that a packet of size bytes does not
+// fit, 0 if it fits all of them. Only the first branch of a TTL is looked at.
+//*****************************************************************************
+int WinMTRSimPath::GetTooBig(int ttl, int size)
+{
+	if (ttl > GetHops())
+		ttl = GetHops();
+	for (int i = 1; i <= ttl; i++) {
+		int mtu = hops[first[i - 1]].mtu;
+		if (mtu && size > mtu)
+			return i;
+	}
+	return 0;
+}
+
+//*****************************************************************************
+// WinMTRSimPath::GetSerialization
+//
+// Milliseconds to send size bytes over the links up to ttl, first branches
+// only.
+//*****************************************************************************
+double WinMTRSimPath::GetSerialization(int ttl, int size)
+{
+	double ms = 0;
+
+	if (ttl > GetHops())
+		ttl = GetHops();
+	for (int i = 1; i <= ttl; i++) {
+		int rate = hops[first[i - 1]].rate;
+		if (rate)
+			ms += size * 8.0 / rate;
+	}
+	return ms;
+}
+
+//*****************************************************************************
+// WinMTRSimPath::TakeToken
+//
+// Whether the policed hop may send a time exceeded reply at 'now'.
+//*****************************************************************************
+bool WinMTRSimPath::TakeToken(s_simhop *hop, DWORD now)
+{
+	bool ok = false;
+
+	EnterCriticalSection(&lock);
+	hop->tokens += (now - hop->refilled) * hop->police / 1000.0;
+	if (hop->tokens > hop->burst)
+		hop->tokens = hop->burst;
+	hop->refilled = now;
+	if (hop->tokens >= 1) {
+		hop->tokens -= 1;
+		ok = true;
+	}
+	LeaveCriticalSection(&lock);
+	return ok;
+}
+
+//*****************************************************************************
+// WinMTRSim::WinMTRSim
+//
+//
+//*****************************************************************************
+WinMTRSim::WinMTRSim(WinMTREngine *e, WinMTRSimPath *p, unsigned seed)
+	: engine(e), path(p), state(seed ? seed : 1)
+{
+	LARGE_INTEGER f;
+
+	QueryPerformanceFrequency(&f);
+	frequency = f.QuadPart;
+}
+
+//*****************************************************************************
+// WinMTRSim::Random
+//
+// xorshift32, uniform in [0, 1).
+//*****************************************************************************
+double WinMTRSim::Random()
+{
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state / 4294967296.0;
+}
+
+//*****************************************************************************
+// WinMTRSim::Later
+//
+//
+//*****************************************************************************
+bool WinMTRSim::Later(const pending &a, const pending &b)
+{
+	return a.due > b.due;
+}
+
+//*****************************************************************************
+// WinMTRSim::FlowPick
+//
+// The per-flow hashing of a load balancer at this TTL, uniform in [0, 1).
+//*****************************************************************************
+double WinMTRSim::FlowPick(int flow, int ttl)
+{
+	unsigned h = (unsigned)flow * 0x9e3779b1u + (unsigned)ttl * 0x85ebca77u;
+
+	// finalizer of MurmurHash3
+	h ^= h >> 16;
+	h *= 0x85ebca6bu;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35u;
+	h ^= h >> 16;
+	return h / 4294967296.0;
+}
+
+//*****************************************************************************
+// WinMTRSim::Send
+//
+// Decides the fate of the probe right away and queues its completion.
+//*****************************************************************************
+bool WinMTRSim::Send(probe_req *req)
+{
+	double pick = (req->flow >= 0) ? FlowPick(req->flow, req->ipinfo.Ttl) : Random();
+	s_simhop *hop = path->GetHop(req->ipinfo.Ttl, pick);
+	PICMPECHO reply = (PICMPECHO)req->repData;
+	pending p;
+
+	DWORD now = GetTickCount();
+	LARGE_INTEGER counter;
+	int shiftRtt, classRtt;
+	float shiftLoss, classLoss;
+	int tooBig = 0;
+	double ms;
+
+	path->GetShift(req->ipinfo.Ttl, now, &shiftRtt, &shiftLoss);
+	path->GetClass(req->ipinfo.Ttl, req->ipinfo.Tos, req->flow, pick, &classRtt, &classLoss);
+	shiftRtt += classRtt;
+	shiftLoss += classLoss;
+
+	p.req = req;
+	if (req->ipinfo.Flags & IPFLAG_DONT_FRAGMENT)
+		tooBig = path->GetTooBig(req->ipinfo.Ttl, req->reqSize + PMTU_HEADER);
+	if (tooBig) {
+		// answered by the hop in front of the link, at its RTT
+		memset(reply, 0, sizeof(ICMPECHO));
+		if (tooBig > 1) {
+			hop = path->GetHop(tooBig - 1, Random());
+			reply->Address = hop->addr;
+			reply->RoundTripTime = hop->rtt;
+		}
+		reply->Status = IP_PACKET_TOO_BIG;
+		req->replies = 1;
+		ms = reply->RoundTripTime;
+	} else if (Random() * 100.0 < hop->loss + shiftLoss || path->IsDropped(req->ipinfo.Ttl, now) ||
+			(hop->police > 0 && req->ipinfo.Ttl < path->GetHops() && !path->TakeToken(hop, now))) {
+		req->replies = 0;
+		ms = req->wait;
+	} else {
+		bool echo = (req->ipinfo.Ttl >= path->GetHops());
+		ms = hop->rtt + shiftRtt + (Random() * 2.0 - 1.0) * hop->jitter
+			+ path->GetSerialization(req->ipinfo.Ttl, req->reqSize + PMTU_HEADER) * (echo ? 2 : 1);
+		if (ms < 0) ms = 0;
+
+		memset(reply, 0, sizeof(ICMPECHO));
+		reply->Address = hop->addr;
+		reply->RoundTripTime = (ULONG)ms;
+		reply->Status = echo ? IP_SUCCESS : IP_TTL_EXPIRED_TRANSIT;
+		req->replies = 1;
+		// ICMP.DLL returns every reply that came in time
+		if (Random() * 100.0 < hop->dup)
+			req->replies = 2;
+		// and drops the ones after the wait
+		if (ms > req->wait) {
+			req->replies = 0;
+			ms = req->wait;
+		}
+	}
+	QueryPerformanceCounter(&counter);
+	p.due = counter.QuadPart + (LONGLONG)(ms * frequency / 1000);
+
+	queue.push_back(p);
+	std::push_heap(queue.begin(), queue.end(), Later);
+	return true;
+}
+
+//*****************************************************************************
+// WinMTRSim::Wait
+//
+//
+//*****************************************************************************
+void WinMTRSim::Wait(HANDLE hWake, DWORD ms)
+{
+	LARGE_INTEGER now;
+
+	QueryPerformanceCounter(&now);
+	if (!queue.empty()) {
+		// rounded down, the worker polls the last millisecond
+		LONGLONG left = queue.front().due - now.QuadPart;
+		if (left < 0) left = 0;
+		left = left * 1000 / frequency;
+		if (left < (LONGLONG)ms) ms = (DWORD)left;
+	}
+	if (ms > 0)
+		WaitForSingleObject(hWake, ms);
+
+	QueryPerformanceCounter(&now);
+	while (!queue.empty() && queue.front().due <= now.QuadPart) {
+		probe_req *req = queue.front().req;
+		std::pop_heap(queue.begin(), queue.end(), Later);
+		queue.pop_back();
+		engine->Complete(req);
+	}
+}
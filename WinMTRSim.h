@@ -0,0 +1,132 @@
+//*****************************************************************************
+// FILE:            WinMTRSim.h
+//
+//
+// DESCRIPTION: The WinMTRSim class is a simulated probe backend that answers
+//              echo requests from a path description file instead of the
+//              network.
+//
+//
+// NOTES: The path file lists one hop per line:
+//
+//            <ttl> <address> <rtt ms> [jitter ms] [loss %] [shift=S:D:RTT[:LOSS]] [mtu=BYTES]
+//                [rate=KBPS] [dup=PERCENT] [police=PPS[:BURST]] [tos=TOS:RTT[:LOSS]]
+//                [drop=PERCENT[:MS]]
+//
+//        Empty lines and lines starting with '#' are ignored. Probes with a
+//        TTL beyond the last hop are answered by the last hop as the
+//        destination, so the trace target should be the last hop address.
+//        A shift adds RTT ms and LOSS % to this hop and all hops behind it,
+//        from S to S + D seconds after the path was loaded. Several lines
+//        with the same TTL are load balanced branches, plain probes pick one
+//        at random, multipath probes by a hash of their flow id and TTL.
+//        An mtu is that of the link into the hop, probes bigger than it are
+//        answered too big by the hop before, or by the local stack for the
+//        first hop. A rate is that of the link into the hop in kbit/s, it
+//        adds the time to send the probe over every link up to the hop, and
+//        back again for the echo reply of the destination. A dup is the
+//        share of probes answered twice. A police is a token bucket on the
+//        time exceeded replies of the hop, PPS per second up to BURST (1 by
+//        default) at once, shared by all workers; the destination echo and
+//        the probes it forwards are not limited. A tos adds RTT ms and
+//        LOSS % to the probes with that TOS byte at this hop and all hops
+//        behind it, like a shift. A drop is a congested link into the hop
+//        that drops every probe passing it in PERCENT % of the MS (50 by
+//        default) long slots of time, so probes sent together to the hop
+//        and the hops behind it are lost together. Completions are due on
+//        the performance counter so sub-millisecond delays hold.
+//
+//*****************************************************************************
+
+#ifndef WINMTRSIM_H_
+#define WINMTRSIM_H_
+
+#include "WinMTRGlobal.h"
+#include "WinMTREngine.h"
+#include <vector>
+
+struct s_simhop {
+	int			ttl;
+	u_long		addr;			// network byte order
+	int			rtt;			// ms
+	int			jitter;			// ms
+	float		loss;			// percent
+	float		shiftStart;		// s
+	float		shiftLength;	// s
+	int			shiftRtt;		// ms
+	float		shiftLoss;		// percent
+	int			mtu;			// bytes, 0 for no limit
+	int			rate;			// kbit/s, 0 for no delay
+	float		dup;			// percent
+	float		police;			// time exceeded replies per s, 0 for no limit
+	int			burst;			// replies
+	double		tokens;			// guarded by the lock of the path
+	DWORD		refilled;		// GetTickCount() of the last refill
+	int			tos;			// -1 for none
+	int			tosRtt;			// ms
+	float		tosLoss;		// percent
+	float		drop;			// percent of the slots the link into the hop drops
+	int			dropSlot;		// ms
+};
+
+//*****************************************************************************
+// CLASS:  WinMTRSimPath
+//
+// The simulated path, shared read-only by the backends of all workers but
+// for the token buckets of policed hops.
+//*****************************************************************************
+
+class WinMTRSimPath {
+public:
+	WinMTRSimPath();
+	~WinMTRSimPath();
+
+	bool		Load(const char *filename);
+	int			GetHops();
+	s_simhop	*GetHop(int ttl, double pick);
+	void		GetShift(int ttl, DWORD now, int *rtt, float *loss);
+	void		GetClass(int ttl, int tos, int flow, double pick, int *rtt, float *loss);
+	bool		IsDropped(int ttl, DWORD now);
+	int			GetTooBig(int ttl, int size);
+	double		GetSerialization(int ttl, int size);
+	bool		TakeToken(s_simhop *hop, DWORD now);
+
+private:
+	std::vector<s_simhop> hops;		// all branches, in TTL order
+	std::vector<int> first;			// index of the first branch per TTL, plus the end
+	DWORD		loaded;
+	CRITICAL_SECTION	lock;		// guards the token buckets
+};
+
+//*****************************************************************************
+// CLASS:  WinMTRSim
+//
+//
+//*****************************************************************************
+
+class WinMTRSim : public WinMTRBackend {
+public:
+	WinMTRSim(WinMTREngine *e, WinMTRSimPath *p, unsigned seed);
+
+	bool	Send(probe_req *req);
+	void	Wait(HANDLE hWake, DWORD ms);
+	// uniform in [0, 1) for a flow id and TTL, the same on every worker
+	static double	FlowPick(int flow, int ttl);
+
+private:
+	struct pending {
+		LONGLONG	due;			// performance counter
+		probe_req	*req;
+	};
+	static bool	Later(const pending &a, const pending &b);
+	double	Random();
+
+private:
+	WinMTREngine		*engine;
+	WinMTRSimPath		*path;
+	unsigned			state;
+	std::vector<pending> queue;		// min-heap on due
+	LONGLONG			frequency;
+};
+
+#endif	// ifndef WINMTRSIM_H_
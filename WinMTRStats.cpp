@@ -0,0 +1,580 @@
+//*****************************************************************************
+// FILE:            WinMTRStats.cpp
+//
+//
+//*****************************************************************************
+
+#include "WinMTRStats.h"
+#include <algorithm>
+
+// bytes of the encoded header and hop record
+#define HEADER_BYTES	(8 + 4 * 5 + 4 + 8 * 2 + SIZE_TARGET)
+#define RESPONDER_BYTES	(4 * 6)
+#define HOP_BYTES		(4 * 6 + 8 * 4 + 4 * 5 + RESPONDER_BYTES * MAX_RESPONDERS + \
+						 4 * STATS_BUCKETS + 255)
+
+static void Put32(std::string &b, unsigned int v)
+{
+	for (int i = 0; i < 4; i++)
+		b += (char)(v >> (8 * i));
+}
+
+static void Put64(std::string &b, unsigned __int64 v)
+{
+	for (int i = 0; i < 8; i++)
+		b += (char)(v >> (8 * i));
+}
+
+static void PutDouble(std::string &b, double d)
+{
+	unsigned __int64 v;
+	memcpy(&v, &d, sizeof(v));
+	Put64(b, v);
+}
+
+static void PutFloat(std::string &b, float f)
+{
+	unsigned int v;
+	memcpy(&v, &f, sizeof(v));
+	Put32(b, v);
+}
+
+static unsigned int Get32(const unsigned char *&p)
+{
+	unsigned int v = p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+	p += 4;
+	return v;
+}
+
+static unsigned __int64 Get64(const unsigned char *&p)
+{
+	unsigned __int64 v = Get32(p);
+	return v | ((unsigned __int64)Get32(p) << 32);
+}
+
+static double GetDouble(const unsigned char *&p)
+{
+	unsigned __int64 v = Get64(p);
+	double d;
+	memcpy(&d, &v, sizeof(d));
+	return d;
+}
+
+static float GetFloat(const unsigned char *&p)
+{
+	unsigned int v = Get32(p);
+	float f;
+	memcpy(&f, &v, sizeof(f));
+	return f;
+}
+
+//*****************************************************************************
+// WinMTRStats::WinMTRStats
+//
+//*****************************************************************************
+WinMTRStats::WinMTRStats()
+{
+	Reset();
+}
+
+//*****************************************************************************
+// WinMTRStats::Reset
+//
+//*****************************************************************************
+void WinMTRStats::Reset()
+{
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, STATS_MAGIC, sizeof(header.magic));
+	header.version = STATS_VERSION;
+	memset(hop, 0, sizeof(hop));
+}
+
+//*****************************************************************************
+// WinMTRStats::Collect
+//
+//*****************************************************************************
+void WinMTRStats::Collect(WinMTRNet *net, const char *hostname,
+	unsigned __int64 start, unsigned __int64 end)
+{
+	Reset();
+	header.hops = net->GetMaxUnsafe();
+	header.runs = 1;
+	header.target = net->last_remote_addr;
+	header.start = start;
+	header.end = end;
+	_snprintf(header.hostname, SIZE_TARGET, "%s", hostname);
+	header.hostname[SIZE_TARGET - 1] = 0;
+
+	for (int at = 0; at < header.hops; at++) {
+		s_nethost *h = &net->host[at];
+		s_hopset *set = &net->hopset[at];
+		s_hopstats *s = &hop[at];
+
+		s->addr = h->addr;
+		s->xmit = h->xmit;
+		s->returned = h->returned;
+		s->last = h->last;
+		s->best = h->best;
+		s->worst = h->worst;
+		s->mean = h->avg;
+		s->m2 = h->var;
+		s->logsum = h->logsum;
+		s->jsum = (double)h->javg * h->returned;
+		s->jitter = h->jitter;
+		s->jworst = h->jworst;
+		s->jinta = h->jinta;
+		s->responders = set->count;
+		s->others = set->others;
+		memcpy(s->responder, set->responder, sizeof(s->responder));
+		memcpy(s->hist, h->hist, sizeof(s->hist));
+		memcpy(s->name, h->name, sizeof(s->name));
+	}
+}
+
+//*****************************************************************************
+// WinMTRStats::Merge
+//
+// Returns false if other is the record of a different target.
+//*****************************************************************************
+bool WinMTRStats::Merge(const WinMTRStats *other)
+{
+	if (other->header.runs == 0)
+		return true;
+	if (header.runs == 0) {
+		header = other->header;
+		memcpy(hop, other->hop, sizeof(hop));
+		return true;
+	}
+	if (_stricmp(header.hostname, other->header.hostname))
+		return false;
+
+	bool later = other->header.end > header.end;
+
+	for (int at = 0; at < other->header.hops; at++)
+		MergeHop(&hop[at], &other->hop[at], later);
+
+	if (other->header.hops > header.hops)
+		header.hops = other->header.hops;
+	header.runs += other->header.runs;
+	if (other->header.start < header.start)
+		header.start = other->header.start;
+	if (later) {
+		header.end = other->header.end;
+		header.target = other->header.target;
+	}
+	return true;
+}
+
+//*****************************************************************************
+// WinMTRStats::MergeHop
+//
+// later is true if b ended after a, its latest values replace those of a.
+//*****************************************************************************
+void WinMTRStats::MergeHop(s_hopstats *a, const s_hopstats *b, bool later)
+{
+	a->xmit += b->xmit;
+	if (a->addr == 0) {
+		a->addr = b->addr;
+		memcpy(a->name, b->name, sizeof(a->name));
+	}
+	if (b->returned == 0)
+		return;
+
+	bool empty = (a->returned == 0);
+	if (empty) {
+		a->best = b->best;
+		a->worst = b->worst;
+	}
+	if (b->best < a->best) a->best = b->best;
+	if (b->worst > a->worst) a->worst = b->worst;
+	if (b->jworst > a->jworst) a->jworst = b->jworst;
+
+	double n = (double)a->returned + b->returned;
+	double delta = b->mean - a->mean;
+	a->mean += delta * b->returned / n;
+	a->m2 += b->m2 + delta * delta * a->returned * b->returned / n;
+	a->logsum += b->logsum;
+	a->jsum += b->jsum;
+	a->returned += b->returned;
+
+	if (later || empty) {
+		a->last = b->last;
+		a->jitter = b->jitter;
+		a->jinta = b->jinta;
+	}
+
+	for (int i = 0; i < STATS_BUCKETS; i++)
+		a->hist[i] += b->hist[i];
+
+	a->others += b->others;
+	for (int i = 0; i < b->responders; i++)
+		MergeResponder(a, &b->responder[i], later);
+}
+
+//*****************************************************************************
+// WinMTRStats::MergeResponder
+//
+//*****************************************************************************
+void WinMTRStats::MergeResponder(s_hopstats *a, const s_responder *r, bool later)
+{
+	int i;
+
+	for (i = 0; i < a->responders; i++)
+		if (a->responder[i].addr == r->addr)
+			break;
+
+	if (i == a->responders) {
+		if (i == MAX_RESPONDERS) {
+			a->others += r->returned;
+			return;
+		}
+		a->responder[i] = *r;
+		a->responders++;
+		return;
+	}
+
+	s_responder *m = &a->responder[i];
+	if (r->returned == 0)
+		return;
+	if (m->returned == 0 || r->best < m->best) m->best = r->best;
+	if (m->returned == 0 || r->worst > m->worst) m->worst = r->worst;
+	m->avg += (r->avg - m->avg) * r->returned / (m->returned + r->returned);
+	m->returned += r->returned;
+	if (later)
+		m->last = r->last;
+}
+
+//*****************************************************************************
+// WinMTRStats::Read
+//
+//*****************************************************************************
+bool WinMTRStats::Read(const char *file)
+{
+	FILE *f = fopen(file, "rb");
+	unsigned char buf[HEADER_BYTES + HOP_BYTES * MAX_HOPS + 1];
+
+	Reset();
+	if (f == NULL) {
+		fprintf(stderr, "error: could not open '%s': %s\n", file, strerror(errno));
+		return false;
+	}
+	size_t n = fread(buf, 1, sizeof(buf), f);
+	fclose(f);
+
+	const unsigned char *p = buf + 8;
+	bool ok = n >= HEADER_BYTES && !memcmp(buf, STATS_MAGIC, sizeof(header.magic))
+		&& Get32(p) == STATS_ORDER
+		&& Get32(p) == STATS_VERSION
+		&& Get32(p) == HOP_BYTES;
+	if (ok) {
+		header.hops = (int)Get32(p);
+		ok = header.hops >= 0 && header.hops <= MAX_HOPS
+			&& n == HEADER_BYTES + (size_t)HOP_BYTES * header.hops;
+	}
+	if (!ok) {
+		fprintf(stderr, "error: '%s' is not a statistics file of this version\n", file);
+		Reset();
+		return false;
+	}
+
+	header.runs = (int)Get32(p);
+	memcpy(&header.target, p, 4);
+	p += 4;
+	header.start = Get64(p);
+	header.end = Get64(p);
+	memcpy(header.hostname, p, SIZE_TARGET);
+	p += SIZE_TARGET;
+	header.hostname[SIZE_TARGET - 1] = 0;
+
+	for (int at = 0; at < header.hops; at++) {
+		s_hopstats *s = &hop[at];
+
+		memcpy(&s->addr, p, 4);
+		p += 4;
+		s->xmit = (int)Get32(p);
+		s->returned = (int)Get32(p);
+		s->last = (int)Get32(p);
+		s->best = (int)Get32(p);
+		s->worst = (int)Get32(p);
+		s->mean = GetDouble(p);
+		s->m2 = GetDouble(p);
+		s->logsum = GetDouble(p);
+		s->jsum = GetDouble(p);
+		s->jitter = (int)Get32(p);
+		s->jworst = (int)Get32(p);
+		s->jinta = (int)Get32(p);
+		s->responders = (int)Get32(p);
+		s->others = (int)Get32(p);
+		for (int i = 0; i < MAX_RESPONDERS; i++) {
+			s_responder *r = &s->responder[i];
+
+			memcpy(&r->addr, p, 4);
+			p += 4;
+			r->returned = (int)Get32(p);
+			r->last = (int)Get32(p);
+			r->best = (int)Get32(p);
+			r->worst = (int)Get32(p);
+			r->avg = GetFloat(p);
+		}
+		for (int i = 0; i < STATS_BUCKETS; i++)
+			s->hist[i] = Get32(p);
+		memcpy(s->name, p, sizeof(s->name));
+		p += sizeof(s->name);
+
+		s->name[sizeof(s->name) - 1] = 0;
+		if (s->responders < 0 || s->responders > MAX_RESPONDERS)
+			s->responders = 0;
+	}
+	return true;
+}
+
+//*****************************************************************************
+// WinMTRStats::Write
+//
+//*****************************************************************************
+bool WinMTRStats::Write(const char *file)
+{
+	std::string b;
+
+	b.reserve(HEADER_BYTES + HOP_BYTES * header.hops);
+	b.append(header.magic, sizeof(header.magic));
+	Put32(b, STATS_ORDER);
+	Put32(b, STATS_VERSION);
+	Put32(b, HOP_BYTES);
+	Put32(b, header.hops);
+	Put32(b, header.runs);
+	b.append((const char *)&header.target, 4);
+	Put64(b, header.start);
+	Put64(b, header.end);
+	b.append(header.hostname, SIZE_TARGET);
+
+	for (int at = 0; at < header.hops; at++) {
+		const s_hopstats *s = &hop[at];
+
+		b.append((const char *)&s->addr, 4);
+		Put32(b, s->xmit);
+		Put32(b, s->returned);
+		Put32(b, s->last);
+		Put32(b, s->best);
+		Put32(b, s->worst);
+		PutDouble(b, s->mean);
+		PutDouble(b, s->m2);
+		PutDouble(b, s->logsum);
+		PutDouble(b, s->jsum);
+		Put32(b, s->jitter);
+		Put32(b, s->jworst);
+		Put32(b, s->jinta);
+		Put32(b, s->responders);
+		Put32(b, s->others);
+		for (int i = 0; i < MAX_RESPONDERS; i++) {
+			const s_responder *r = &s->responder[i];
+
+			b.append((const char *)&r->addr, 4);
+			Put32(b, r->returned);
+			Put32(b, r->last);
+			Put32(b, r->best);
+			Put32(b, r->worst);
+			PutFloat(b, r->avg);
+		}
+		for (int i = 0; i < STATS_BUCKETS; i++)
+			Put32(b, s->hist[i]);
+		b.append(s->name, sizeof(s->name));
+	}
+
+	FILE *f = fopen(file, "wb");
+
+	if (f == NULL) {
+		fprintf(stderr, "error: could not write statistics to '%s': %s\n", file, strerror(errno));
+		return false;
+	}
+
+	bool ok = fwrite(b.data(), 1, b.size(), f) == b.size();
+	if (fclose(f) != 0)
+		ok = false;
+
+	if (!ok)
+		fprintf(stderr, "error: could not write statistics to '%s': %s\n", file, strerror(errno));
+	return ok;
+}
+
+//*****************************************************************************
+// WinMTRStats::Apply
+//
+//*****************************************************************************
+void WinMTRStats::Apply(WinMTRNet *net)
+{
+	net->ResetHops();
+	net->last_remote_addr = header.target;
+
+	for (int at = 0; at < header.hops; at++) {
+		s_nethost *h = &net->host[at];
+		s_hopset *set = &net->hopset[at];
+		s_hopstats *s = &hop[at];
+
+		h->addr = s->addr;
+		h->xmit = s->xmit;
+		h->returned = s->returned;
+		h->last = s->last;
+		h->best = s->best;
+		h->worst = s->worst;
+		h->avg = (float)s->mean;
+		h->var = (float)s->m2;
+		h->logsum = s->logsum;
+		h->gmean = s->returned ? (float)exp(s->logsum / s->returned) : 0;
+		h->jitter = s->jitter;
+		h->javg = s->returned ? (float)(s->jsum / s->returned) : 0;
+		h->jworst = s->jworst;
+		h->jinta = s->jinta;
+		memcpy(h->hist, s->hist, sizeof(h->hist));
+		memcpy(h->name, s->name, sizeof(h->name));
+
+		set->count = s->responders;
+		set->others = s->others;
+		memcpy(set->responder, s->responder, sizeof(set->responder));
+	}
+}
+
+//*****************************************************************************
+// WinMTRStats::Now
+//
+// Milliseconds since 1970-01-01 UTC.
+//*****************************************************************************
+unsigned __int64 WinMTRStats::Now()
+{
+	FILETIME ft;
+	ULARGE_INTEGER t;
+
+	// FILETIME counts 100 ns intervals since 1601-01-01
+	GetSystemTimeAsFileTime(&ft);
+	t.LowPart = ft.dwLowDateTime;
+	t.HighPart = ft.dwHighDateTime;
+	return t.QuadPart / 10000 - 11644473600000ULL;
+}
+
+//*****************************************************************************
+// WinMTRStats::Bucket
+//
+// RTTs below 8 ms get a bucket each, larger ones four per power of two.
+//*****************************************************************************
+int WinMTRStats::Bucket(int rtt)
+{
+	int e = 3;
+
+	if (rtt < 8)
+		return (rtt < 0) ? 0 : rtt;
+	while ((rtt >> e) > 1)
+		e++;
+
+	int b = 8 + (e - 3) * 4 + ((rtt >> (e - 2)) & 3);
+	return (b < STATS_BUCKETS) ? b : STATS_BUCKETS - 1;
+}
+
+//*****************************************************************************
+// WinMTRStats::BucketHigh
+//
+// The largest RTT counted in 'bucket'.
+//*****************************************************************************
+int WinMTRStats::BucketHigh(int bucket)
+{
+	if (bucket < 8)
+		return bucket;
+
+	int e = 3 + (bucket - 8) / 4;
+	return ((5 + (bucket - 8) % 4) << (e - 2)) - 1;
+}
+
+//*****************************************************************************
+// WinMTRStats::Percentile
+//
+// The upper bound of the bucket holding the p-th percentile, at most worst.
+//*****************************************************************************
+int WinMTRStats::Percentile(const unsigned int *hist, int returned, int worst, int p)
+{
+	int rank = (returned * p + 99) / 100;
+	int seen = 0;
+
+	if (returned == 0)
+		return 0;
+	for (int b = 0; b < STATS_BUCKETS; b++) {
+		seen += hist[b];
+		if (seen >= rank) {
+			int high = BucketHigh(b);
+			return (high < worst) ? high : worst;
+		}
+	}
+	return worst;
+}
+
+//*****************************************************************************
+// WinMTRStats::TheilSen
+//
+// The median of the slopes between all pairs of points with different x,
+// a line fit that ignores up to 29% of outliers. Only the first
+// CAPACITY_SIZES points are used, so the slopes fit on the stack.
+//*****************************************************************************
+double WinMTRStats::TheilSen(const double *x, const double *y, int n)
+{
+	double slope[CAPACITY_SIZES * (CAPACITY_SIZES - 1) / 2];
+	int k = 0;
+
+	for (int i = 0; i < n && i < CAPACITY_SIZES; i++)
+		for (int j = i + 1; j < n && j < CAPACITY_SIZES; j++)
+			if (x[j] != x[i])
+				slope[k++] = (y[j] - y[i]) / (x[j] - x[i]);
+	if (k == 0)
+		return 0;
+
+	std::sort(slope, slope + k);
+	return (k % 2) ? slope[k / 2] : (slope[k / 2 - 1] + slope[k / 2]) / 2;
+}
+
+//*****************************************************************************
+// WinMTRStats::NormalQuantile
+//
+// The standard normal quantile of p in (0, 1) by the rational
+// approximation 26.2.23 of Abramowitz and Stegun, error below 4.5e-4.
+//*****************************************************************************
+double WinMTRStats::NormalQuantile(double p)
+{
+	double q = (p < 0.5) ? p : 1 - p;
+	double t = sqrt(-2 * log(q));
+	double x = t - (2.515517 + 0.802853 * t + 0.010328 * t * t) /
+		(1 + 1.432788 * t + 0.189269 * t * t + 0.001308 * t * t * t);
+
+	return (p < 0.5) ? -x : x;
+}
+
+//*****************************************************************************
+// WinMTRStats::Wilson
+//
+// The Wilson score interval of a ratio p seen in n trials, which unlike
+// the normal interval stays inside [0, 1] and is not empty at p = 0.
+//*****************************************************************************
+void WinMTRStats::Wilson(double p, double n, double z, double *low, double *high)
+{
+	double d = 1 + z * z / n;
+	double center = (p + z * z / (2 * n)) / d;
+	double half = z * sqrt(p * (1 - p) / n + z * z / (4 * n * n)) / d;
+
+	*low = (center - half > 0) ? center - half : 0;
+	*high = (center + half < 1) ? center + half : 1;
+}
+
+//*****************************************************************************
+// WinMTRStats::ProportionZ
+//
+// The pooled two-proportion z statistic of x1 in n1 trials against x2 in
+// n2, positive when the first ratio is the larger one. 0 when both are 0
+// or 1, there is nothing to tell apart then.
+//*****************************************************************************
+double WinMTRStats::ProportionZ(double x1, double n1, double x2, double n2)
+{
+	if (n1 <= 0 || n2 <= 0)
+		return 0;
+
+	double p = (x1 + x2) / (n1 + n2);
+	double var = p * (1 - p) * (1 / n1 + 1 / n2);
+	if (var <= 0)
+		return 0;
+	return (x1 / n1 - x2 / n2) / sqrt(var);
+}
@@ -0,0 +1,107 @@
+//*****************************************************************************
+// FILE:            WinMTRStats.h
+//
+//
+// DESCRIPTION: The WinMTRStats class holds the per-hop statistics of one or
+//              more traces to the same target in a form that can be written
+//              to a file and merged with others.
+//
+//
+// NOTES: Each hop keeps counts, the Welford moments of the RTT, the sum of
+//        the RTT logarithms and a histogram, so merging N records (Chan et
+//        al. for the moments) gives the report of a single run over all
+//        their probes. Only the jitter of the first reply of each run, and
+//        the values defined by the latest reply (last RTT, current and
+//        interarrival jitter), differ from such a run; those are taken from
+//        the record that ended last.
+//
+//        The file is the header followed by 'hops' hop records. Every field
+//        is written on its own as a little-endian integer of fixed width
+//        (doubles and floats by their IEEE 754 bits, addresses and strings
+//        as bytes), so the format does not depend on structure layout or
+//        byte order of the writer. Readers check magic, byte order mark,
+//        version and hop record size.
+//
+//*****************************************************************************
+
+#ifndef WINMTRSTATS_H_
+#define WINMTRSTATS_H_
+
+#include "WinMTRGlobal.h"
+#include "WinMTRNet.h"
+
+#define STATS_MAGIC		"WMTRSTAT"
+#define STATS_VERSION	2
+#define STATS_ORDER		0x01020304	// reads back swapped on a byte order mismatch
+#define SIZE_TARGET		256
+
+struct s_statsheader {
+	char magic[8];
+	int version;
+	int hops;
+	int runs;				// traces merged into this record
+	__int32 target;			// network byte order
+	unsigned __int64 start;	// ms since 1970, earliest run
+	unsigned __int64 end;	// ms since 1970, latest run
+	char hostname[SIZE_TARGET];
+};
+
+struct s_hopstats {
+	__int32 addr;
+	int xmit;
+	int returned;
+	int last;
+	int best;
+	int worst;
+	double mean;
+	double m2;				// sum of squared differences from the mean
+	double logsum;			// sum of ln(rtt)
+	double jsum;			// sum of the jitter
+	int jitter;
+	int jworst;
+	int jinta;
+	int responders;
+	int others;
+	struct s_responder responder[MAX_RESPONDERS];
+	unsigned int hist[STATS_BUCKETS];
+	char name[255];
+};
+
+//*****************************************************************************
+// CLASS:  WinMTRStats
+//
+//
+//*****************************************************************************
+
+class WinMTRStats {
+public:
+	WinMTRStats();
+
+	void	Reset();
+	// the trace of net has to be finished
+	void	Collect(WinMTRNet *net, const char *hostname,
+				unsigned __int64 start, unsigned __int64 end);
+	bool	Merge(const WinMTRStats *other);
+	bool	Read(const char *file);
+	bool	Write(const char *file);
+	// loads the statistics into net for the report, net must not trace
+	void	Apply(WinMTRNet *net);
+
+	static unsigned __int64	Now();
+	static int	Bucket(int rtt);
+	static int	BucketHigh(int bucket);
+	static int	Percentile(const unsigned int *hist, int returned, int worst, int p);
+	static double	TheilSen(const double *x, const double *y, int n);
+	static double	NormalQuantile(double p);
+	static void		Wilson(double p, double n, double z, double *low, double *high);
+	static double	ProportionZ(double x1, double n1, double x2, double n2);
+
+	s_statsheader	header;
+	s_hopstats		hop[MAX_HOPS];
+
+private:
+	void	MergeHop(s_hopstats *a, const s_hopstats *b, bool later);
+	void	MergeResponder(s_hopstats *a, const s_responder *r, bool later);
+};
+
+#endif	// ifndef WINMTRSTATS_H_
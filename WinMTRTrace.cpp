@@ -0,0 +1,277 @@
+//*****************************************************************************
+// FILE:            WinMTRTrace.cpp
+//
+//
+//*****************************************************************************
+
+#include "WinMTRTrace.h"
+#include <algorithm>
+
+volatile int WinMTRTrace::runLevel = TRACE_LEVEL_NONE;
+DWORD WinMTRTrace::tlsIndex = TLS_OUT_OF_INDEXES;
+CRITICAL_SECTION WinMTRTrace::lock;
+std::vector<s_trace_ring*> WinMTRTrace::rings;
+HANDLE WinMTRTrace::hThread = NULL;
+HANDLE WinMTRTrace::hStop = NULL;
+FILE *WinMTRTrace::out = NULL;
+
+static LONGLONG traceStart;
+static LONGLONG traceFrequency;
+
+static const char *levelNames[] = { "", "ERROR", "INFO", "DEBUG" };
+
+static const char *eventFormats[TRACE_EVENT_COUNT] = {
+	"worker %d started",
+	"worker %d stopped",
+	"TTL %d cycle %d send failed, error %d",
+	"TTL %d reply status %d, %d replies",
+	"TTL %d new address %s, was %s",
+	"TTL %d resolver started",
+	"TTL %d resolver stopped"
+};
+
+struct trace_line {
+	s_trace_event	event;
+	bool operator<(const trace_line& o) const { return event.time < o.event.time; }
+};
+
+//*****************************************************************************
+// WinMTRTrace::Start
+//
+//*****************************************************************************
+bool WinMTRTrace::Start(int level, const char *file)
+{
+	LARGE_INTEGER now, f;
+
+	if (level <= TRACE_LEVEL_NONE)
+		return true;
+
+	out = stderr;
+	if (file && file[0]) {
+		out = fopen(file, "w");
+		if (out == NULL) {
+			fprintf(stderr, "error: could not open trace file '%s': %s\n", file, strerror(errno));
+			return false;
+		}
+	}
+
+	QueryPerformanceFrequency(&f);
+	QueryPerformanceCounter(&now);
+	traceFrequency = f.QuadPart;
+	traceStart = now.QuadPart;
+
+	InitializeCriticalSection(&lock);
+	tlsIndex = TlsAlloc();
+	hStop = CreateEvent(NULL, TRUE, FALSE, NULL);
+	hThread = (HANDLE)_beginthreadex(NULL, 0, DrainThread, NULL, 0, NULL);
+	runLevel = level;
+	return true;
+}
+
+//*****************************************************************************
+// WinMTRTrace::Stop
+//
+// Threads that call TRACE_THREAD_EXIT afterwards find no TLS index and
+// return.
+//*****************************************************************************
+void WinMTRTrace::Stop()
+{
+	if (hThread == NULL)
+		return;
+
+	runLevel = TRACE_LEVEL_NONE;
+	SetEvent(hStop);
+	WaitForSingleObject(hThread, INFINITE);
+	CloseHandle(hThread);
+	CloseHandle(hStop);
+	hThread = NULL;
+
+	if (out != stderr)
+		fclose(out);
+	out = NULL;
+
+	TlsFree(tlsIndex);
+	tlsIndex = TLS_OUT_OF_INDEXES;
+	for (size_t i = 0; i < rings.size(); i++) {
+		if (rings[i]->thread)
+			CloseHandle(rings[i]->thread);
+		delete rings[i];
+	}
+	rings.clear();
+	DeleteCriticalSection(&lock);
+}
+
+//*****************************************************************************
+// WinMTRTrace::Record
+//
+// Only the owner of a ring moves its head, only the drain thread its tail.
+//*****************************************************************************
+void WinMTRTrace::Record(int level, int id, int a, int b, int c)
+{
+	s_trace_ring *r = GetRing();
+	LARGE_INTEGER now;
+	LONG h;
+
+	if (r == NULL)
+		return;
+
+	h = r->head;
+	if (h - r->tail >= TRACE_RING_SIZE) {
+		r->dropped++;
+		return;
+	}
+
+	s_trace_event *e = &r->event[h & (TRACE_RING_SIZE - 1)];
+	QueryPerformanceCounter(&now);
+	e->time = now.QuadPart;
+	e->thread = r->owner;
+	e->id = (unsigned short)id;
+	e->level = (unsigned short)level;
+	e->arg[0] = a;
+	e->arg[1] = b;
+	e->arg[2] = c;
+
+	// x86 keeps stores in order, the event is complete before head moves
+	_ReadWriteBarrier();
+	r->head = h + 1;
+}
+
+//*****************************************************************************
+// WinMTRTrace::GetRing
+//
+// The ring of the calling thread on its first event: a free ring, the ring
+// of a thread that exited without giving it back, or a new one. Events an
+// exited thread left in its ring are still drained.
+//*****************************************************************************
+s_trace_ring *WinMTRTrace::GetRing()
+{
+	s_trace_ring *r = (s_trace_ring*)TlsGetValue(tlsIndex);
+
+	if (r != NULL || tlsIndex == TLS_OUT_OF_INDEXES)
+		return r;
+
+	EnterCriticalSection(&lock);
+	for (size_t i = 0; i < rings.size() && r == NULL; i++) {
+		s_trace_ring *q = rings[i];
+		if (q->owner != 0 && q->thread && WaitForSingleObject(q->thread, 0) == WAIT_OBJECT_0) {
+			CloseHandle(q->thread);
+			q->thread = NULL;
+			q->owner = 0;
+		}
+		if (q->owner == 0)
+			r = q;
+	}
+	if (r == NULL) {
+		r = new s_trace_ring;
+		r->head = r->tail = 0;
+		r->dropped = r->reported = 0;
+		rings.push_back(r);
+	}
+	r->owner = (LONG)GetCurrentThreadId();
+	if (!DuplicateHandle(GetCurrentProcess(), GetCurrentThread(), GetCurrentProcess(),
+			&r->thread, SYNCHRONIZE, FALSE, 0))
+		r->thread = NULL;
+	LeaveCriticalSection(&lock);
+
+	TlsSetValue(tlsIndex, r);
+	return r;
+}
+
+//*****************************************************************************
+// WinMTRTrace::ThreadExit
+//
+// Gives the ring of the calling thread back, its events are still drained.
+//*****************************************************************************
+void WinMTRTrace::ThreadExit()
+{
+	if (tlsIndex == TLS_OUT_OF_INDEXES)
+		return;
+
+	s_trace_ring *r = (s_trace_ring*)TlsGetValue(tlsIndex);
+	if (r == NULL)
+		return;
+
+	TlsSetValue(tlsIndex, NULL);
+	EnterCriticalSection(&lock);
+	if (r->thread)
+		CloseHandle(r->thread);
+	r->thread = NULL;
+	r->owner = 0;
+	LeaveCriticalSection(&lock);
+}
+
+//*****************************************************************************
+// WinMTRTrace::DrainThread
+//
+//*****************************************************************************
+unsigned __stdcall WinMTRTrace::DrainThread(void *p)
+{
+	while (WaitForSingleObject(hStop, TRACE_DRAIN_WAIT) == WAIT_TIMEOUT)
+		Drain();
+	Drain();
+	return 0;
+}
+
+//*****************************************************************************
+// WinMTRTrace::Drain
+//
+// Events of all rings are written in time order within one drain.
+//*****************************************************************************
+void WinMTRTrace::Drain()
+{
+	std::vector<s_trace_ring*> all;
+	std::vector<trace_line> batch;
+	LONG dropped = 0;
+
+	EnterCriticalSection(&lock);
+	all = rings;
+	LeaveCriticalSection(&lock);
+
+	for (size_t i = 0; i < all.size(); i++) {
+		s_trace_ring *r = all[i];
+		LONG t = r->tail;
+		LONG h = r->head;
+
+		_ReadWriteBarrier();
+		for (; t != h; t++) {
+			trace_line l;
+			l.event = r->event[t & (TRACE_RING_SIZE - 1)];
+			batch.push_back(l);
+		}
+		_ReadWriteBarrier();
+		r->tail = t;
+
+		LONG d = r->dropped;
+		dropped += d - r->reported;
+		r->reported = d;
+	}
+
+	std::stable_sort(batch.begin(), batch.end());
+	for (size_t i = 0; i < batch.size(); i++)
+		Format(out, &batch[i].event);
+	if (dropped > 0)
+		fprintf(out, "trace: %d events dropped, ring full\n", (int)dropped);
+	if (!batch.empty() || dropped > 0)
+		fflush(out);
+}
+
+//*****************************************************************************
+// WinMTRTrace::Format
+//
+//*****************************************************************************
+void WinMTRTrace::Format(FILE *file, const s_trace_event *e)
+{
+	char a[16], b[16];
+	double ms = (double)(e->time - traceStart) * 1000.0 / traceFrequency;
+
+	fprintf(file, "%12.3f %5lu %-5s ", ms, (unsigned long)e->thread, levelNames[e->level]);
+	if (e->id == TRACE_NEW_ADDR) {
+		int x = e->arg[1], y = e->arg[2];
+		sprintf(a, "%d.%d.%d.%d", (x >> 24) & 0xff, (x >> 16) & 0xff, (x >> 8) & 0xff, x & 0xff);
+		sprintf(b, "%d.%d.%d.%d", (y >> 24) & 0xff, (y >> 16) & 0xff, (y >> 8) & 0xff, y & 0xff);
+		fprintf(file, eventFormats[e->id], e->arg[0], a, b);
+	} else {
+		fprintf(file, eventFormats[e->id], e->arg[0], e->arg[1], e->arg[2]);
+	}
+	fputc('\n', file);
+}
@@ -0,0 +1,135 @@
+//*****************************************************************************
+// FILE:            WinMTRTrace.h
+//
+//
+// DESCRIPTION: The WinMTRTrace class records binary trace events of the
+//              probe engine and the resolver threads and writes them as
+//              text to stderr or a file from a background thread.
+//
+//
+// NOTES: Levels above WMTR_TRACE_LEVEL are compiled out, their TRACE_*
+//        macros expand to nothing. Compiled in levels are filtered at run
+//        time with one compare. Every thread writes into its own ring of
+//        events that only the drain thread reads, so recording takes no
+//        lock and no allocation; when a ring is full new events are counted
+//        and dropped. Rings are taken on the first event of a thread and
+//        given back by TRACE_THREAD_EXIT for reuse by later threads. The
+//        ring of a thread that exited without it is taken back once a new
+//        thread needs a ring, so such threads cannot leak rings.
+//
+//*****************************************************************************
+
+#ifndef WINMTRTRACE_H_
+#define WINMTRTRACE_H_
+
+#include "WinMTRGlobal.h"
+#include <vector>
+
+#define TRACE_LEVEL_NONE	0
+#define TRACE_LEVEL_ERROR	1
+#define TRACE_LEVEL_INFO	2
+#define TRACE_LEVEL_DEBUG	3		// per probe events
+
+#ifndef WMTR_TRACE_LEVEL
+#ifdef _DEBUG
+#define WMTR_TRACE_LEVEL	TRACE_LEVEL_DEBUG
+#else
+#define WMTR_TRACE_LEVEL	TRACE_LEVEL_INFO
+#endif
+#endif
+
+#define TRACE_RING_SIZE		4096	// events per thread, a power of 2
+#define TRACE_DRAIN_WAIT	50		// ms between drains
+
+enum {
+	TRACE_WORKER_START = 0,		// worker
+	TRACE_WORKER_STOP,			// worker
+	TRACE_SEND_FAILED,			// ttl, cycle, error
+	TRACE_REPLY,				// ttl, status, replies
+	TRACE_NEW_ADDR,				// ttl, addr, previous addr
+	TRACE_RESOLVER_START,		// ttl
+	TRACE_RESOLVER_STOP,		// ttl
+	TRACE_EVENT_COUNT
+};
+
+struct s_trace_event {
+	LONGLONG		time;		// performance counter ticks
+	DWORD			thread;
+	unsigned short	id;
+	unsigned short	level;
+	int				arg[3];
+};
+
+struct s_trace_ring {
+	volatile LONG	owner;		// thread id, 0 if free
+	HANDLE			thread;		// of the owner, signaled once it has exited
+	volatile LONG	head;		// written by the owner
+	volatile LONG	tail;		// written by the drain thread
+	volatile LONG	dropped;	// written by the owner
+	LONG			reported;	// dropped events already reported by the drain thread
+	s_trace_event	event[TRACE_RING_SIZE];
+};
+
+#if WMTR_TRACE_LEVEL >= TRACE_LEVEL_ERROR
+#define TRACE_ERROR(id, a, b, c)	WinMTRTrace::Log(TRACE_LEVEL_ERROR, id, a, b, c)
+#else
+#define TRACE_ERROR(id, a, b, c)	((void)0)
+#endif
+
+#if WMTR_TRACE_LEVEL >= TRACE_LEVEL_INFO
+#define TRACE_INFO(id, a, b, c)		WinMTRTrace::Log(TRACE_LEVEL_INFO, id, a, b, c)
+#else
+#define TRACE_INFO(id, a, b, c)		((void)0)
+#endif
+
+#if WMTR_TRACE_LEVEL >= TRACE_LEVEL_DEBUG
+#define TRACE_DEBUG(id, a, b, c)	WinMTRTrace::Log(TRACE_LEVEL_DEBUG, id, a, b, c)
+#else
+#define TRACE_DEBUG(id, a, b, c)	((void)0)
+#endif
+
+#if WMTR_TRACE_LEVEL > TRACE_LEVEL_NONE
+#define TRACE_THREAD_EXIT()			WinMTRTrace::ThreadExit()
+#else
+#define TRACE_THREAD_EXIT()			((void)0)
+#endif
+
+//*****************************************************************************
+// CLASS:  WinMTRTrace
+//
+//
+//*****************************************************************************
+
+class WinMTRTrace {
+public:
+	// file NULL for stderr, returns false if it cannot be opened
+	static bool		Start(int level, const char *file);
+	// drains what is left, closes the file and frees the rings, threads
+	// that record must have stopped
+	static void		Stop();
+
+	static inline void Log(int level, int id, int a, int b, int c)
+	{
+		if (level <= runLevel)
+			Record(level, id, a, b, c);
+	}
+	static void		ThreadExit();
+
+private:
+	static void		Record(int level, int id, int a, int b, int c);
+	static s_trace_ring	*GetRing();
+	static unsigned __stdcall DrainThread(void *p);
+	static void		Drain();
+	static void		Format(FILE *file, const s_trace_event *e);
+
+private:
+	static volatile int		runLevel;		// TRACE_LEVEL_NONE until started
+	static DWORD			tlsIndex;
+	static CRITICAL_SECTION	lock;			// guards rings
+	static std::vector<s_trace_ring*> rings;
+	static HANDLE			hThread;
+	static HANDLE			hStop;
+	static FILE				*out;
+};
+
+#endif	// ifndef WINMTRTRACE_H_
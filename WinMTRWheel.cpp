@@ -0,0 +1,269 @@
+//*****************************************************************************
+// FILE:            WinMTRWheel.cpp
+//
+//
+//*****************************************************************************
+
+#include "WinMTRWheel.h"
+#include <intrin.h>
+
+#define WHEEL_MASK			(WHEEL_SLOTS - 1)
+#define WHEEL_BIT(i)		((unsigned __int64)1 << (i))
+#define WHEEL_OVERDUE		(WHEEL_LEVELS * WHEEL_SLOTS)	// where of the overdue list
+
+//*****************************************************************************
+// WinMTRWheel::WinMTRWheel
+//
+//*****************************************************************************
+WinMTRWheel::WinMTRWheel()
+{
+	Reset(0);
+}
+
+//*****************************************************************************
+// WinMTRWheel::Reset
+//
+// Timers still armed are forgotten, not unlinked.
+//*****************************************************************************
+void WinMTRWheel::Reset(DWORD now)
+{
+	for (int l = 0; l < WHEEL_LEVELS; l++) {
+		for (int i = 0; i < WHEEL_SLOTS; i++)
+			slot[l][i].next = slot[l][i].prev = &slot[l][i];
+		used[l] = 0;
+	}
+	overdue.next = overdue.prev = &overdue;
+	current = now;
+	count = 0;
+}
+
+//*****************************************************************************
+// WinMTRWheel::LowestBit
+//
+// _BitScanForward64 is only there for x64.
+//*****************************************************************************
+int WinMTRWheel::LowestBit(unsigned __int64 mask)
+{
+	unsigned long i;
+
+	if (_BitScanForward(&i, (unsigned long)mask))
+		return (int)i;
+	_BitScanForward(&i, (unsigned long)(mask >> 32));
+	return (int)i + 32;
+}
+
+//*****************************************************************************
+// WinMTRWheel::Place
+//
+// Level l takes the timers due within WHEEL_SLOTS slots of its own, a slot
+// at level l is cascaded when the wheel turns into it, so a timer lands in
+// the slot of its due time.
+//*****************************************************************************
+void WinMTRWheel::Place(wheel_timer *t)
+{
+	LONG delta = (LONG)(t->due - current);
+	DWORD due = t->due;
+	int l = 0;
+
+	if (delta < 0) {
+		delta = 0;
+		due = current;
+	}
+	while (l < WHEEL_LEVELS - 1 && (DWORD)delta >= ((DWORD)1 << (WHEEL_BITS * (l + 1))))
+		l++;
+	// beyond the wheel, waits in the last slot of the top level and is
+	// placed again when that is cascaded
+	if ((DWORD)delta >= ((DWORD)1 << (WHEEL_BITS * WHEEL_LEVELS)))
+		due = current + ((DWORD)1 << (WHEEL_BITS * WHEEL_LEVELS)) - 1;
+
+	int i = (due >> (WHEEL_BITS * l)) & WHEEL_MASK;
+	wheel_timer *head = &slot[l][i];
+	t->where = l * WHEEL_SLOTS + i;
+	t->next = head;
+	t->prev = head->prev;
+	head->prev->next = t;
+	head->prev = t;
+	used[l] |= WHEEL_BIT(i);
+}
+
+//*****************************************************************************
+// WinMTRWheel::Add
+//
+// The wheel is already past the slot of a time before current, Place would
+// put the timer into the slot of current, which is only taken out once
+// GetTickCount() moves on.
+//*****************************************************************************
+void WinMTRWheel::Add(wheel_timer *t, DWORD due)
+{
+	t->due = due;
+	if ((LONG)(due - current) < 0) {
+		t->where = WHEEL_OVERDUE;
+		t->next = &overdue;
+		t->prev = overdue.prev;
+		overdue.prev->next = t;
+		overdue.prev = t;
+	} else {
+		Place(t);
+	}
+	count++;
+}
+
+//*****************************************************************************
+// WinMTRWheel::Cancel
+//
+//*****************************************************************************
+void WinMTRWheel::Cancel(wheel_timer *t)
+{
+	if (t->prev == NULL)
+		return;
+
+	t->prev->next = t->next;
+	t->next->prev = t->prev;
+	if (t->where != WHEEL_OVERDUE) {
+		wheel_timer *head = &slot[t->where / WHEEL_SLOTS][t->where % WHEEL_SLOTS];
+		if (head->next == head)
+			used[t->where / WHEEL_SLOTS] &= ~WHEEL_BIT(t->where % WHEEL_SLOTS);
+	}
+	t->prev = t->next = NULL;
+	count--;
+}
+
+//*****************************************************************************
+// WinMTRWheel::IsArmed
+//
+// Timers start out with prev NULL.
+//*****************************************************************************
+bool WinMTRWheel::IsArmed(const wheel_timer *t)
+{
+	return t->prev != NULL;
+}
+
+//*****************************************************************************
+// WinMTRWheel::Cascade
+//
+// The wheel just turned into a new level 1 slot, and maybe into new slots
+// further up, those are placed again from the top down.
+//*****************************************************************************
+void WinMTRWheel::Cascade()
+{
+	int top = 1;
+
+	while (top < WHEEL_LEVELS - 1 && ((current >> (WHEEL_BITS * top)) & WHEEL_MASK) == 0)
+		top++;
+
+	for (int l = top; l >= 1; l--) {
+		int i = (current >> (WHEEL_BITS * l)) & WHEEL_MASK;
+		wheel_timer *head = &slot[l][i];
+		wheel_timer *t = head->next;
+
+		head->next = head->prev = head;
+		used[l] &= ~WHEEL_BIT(i);
+		while (t != head) {
+			wheel_timer *next = t->next;
+			Place(t);
+			t = next;
+		}
+	}
+}
+
+//*****************************************************************************
+// WinMTRWheel::Advance
+//
+// Takes out the overdue timers, then turns the wheel up to now, jumping
+// over empty level 0 slots.
+//*****************************************************************************
+wheel_timer *WinMTRWheel::Advance(DWORD now)
+{
+	wheel_timer *expired = NULL;
+
+	for (wheel_timer *t = overdue.next; t != &overdue; ) {
+		wheel_timer *next = t->next;
+		t->prev = NULL;
+		t->next = expired;
+		expired = t;
+		count--;
+		t = next;
+	}
+	overdue.next = overdue.prev = &overdue;
+
+	while ((LONG)(now - current) >= 0) {
+		int i = current & WHEEL_MASK;
+		unsigned __int64 ahead = used[0] >> i;
+		DWORD step;
+
+		if (ahead & 1) {
+			wheel_timer *head = &slot[0][i];
+			wheel_timer *t = head->next;
+			while (t != head) {
+				wheel_timer *next = t->next;
+				t->prev = NULL;
+				t->next = expired;
+				expired = t;
+				count--;
+				t = next;
+			}
+			head->next = head->prev = head;
+			used[0] &= ~WHEEL_BIT(i);
+			step = 1;
+		} else {
+			// to the next timer of this turn or into the next turn
+			step = ahead ? LowestBit(ahead) : WHEEL_SLOTS - i;
+			if (step > now - current + 1)
+				step = now - current + 1;
+		}
+		current += step;
+		if ((current & WHEEL_MASK) == 0)
+			Cascade();
+	}
+	return expired;
+}
+
+//*****************************************************************************
+// WinMTRWheel::NextDue
+//
+// The earliest level 0 timer, or the earliest cascade of a higher level,
+// whichever comes first.
+//*****************************************************************************
+DWORD WinMTRWheel::NextDue(DWORD now, DWORD limit)
+{
+	DWORD due = now + limit;
+
+	if (count == 0)
+		return limit;
+	if (overdue.next != &overdue)
+		return 0;
+
+	for (int l = 0; l < WHEEL_LEVELS; l++) {
+		if (used[l] == 0)
+			continue;
+
+		int shift = WHEEL_BITS * l;
+		int i = (current >> shift) & WHEEL_MASK;
+		// rotate so bit k is the slot k turns ahead
+		unsigned __int64 ahead = i ? (used[l] >> i) | (used[l] << (WHEEL_SLOTS - i)) : used[l];
+		DWORD at;
+
+		if (l == 0) {
+			at = current + LowestBit(ahead);
+		} else {
+			// the slot the wheel is in was cascaded, its timers are a turn ahead
+			ahead &= ~(unsigned __int64)1;
+			DWORD k = ahead ? LowestBit(ahead) : WHEEL_SLOTS;
+			at = ((current >> shift) + k) << shift;
+		}
+		if ((LONG)(at - due) < 0)
+			due = at;
+	}
+
+	LONG left = (LONG)(due - now);
+	return (left > 0) ? (DWORD)left : 0;
+}
+
+//*****************************************************************************
+// WinMTRWheel::GetCount
+//
+//*****************************************************************************
+int WinMTRWheel::GetCount()
+{
+	return count;
+}
@@ -0,0 +1,79 @@
+//*****************************************************************************
+// FILE:            WinMTRWheel.h
+//
+//
+// DESCRIPTION: The WinMTRWheel class is a hierarchical timing wheel, it
+//              holds the send times and timeouts of the probe tasks of one
+//              engine worker.
+//
+//
+// NOTES: As in Varghese and Lauck, timers hang in doubly linked lists, one
+//        per slot, so adding and cancelling a timer is O(1). Level 0 has a
+//        slot per millisecond for the next WHEEL_SLOTS ms, every level above
+//        covers WHEEL_SLOTS times the span of the one below, and when the
+//        wheel turns into a new slot of a higher level that slot is
+//        cascaded down. Each timer is cascaded at most once per level, so
+//        expiry is amortized O(1). A bitmap per level skips empty slots,
+//        both when the wheel turns and to find the next time it has to.
+//        A timer added when its time has passed goes to a separate list
+//        the next Advance takes out first, whatever the time then; in a
+//        slot it would wait for the next tick of GetTickCount(), up to
+//        15.6 ms. Times are GetTickCount() based and wrap like it. Like the pool it
+//        is not thread safe, the worker lock guards it.
+//
+//*****************************************************************************
+
+#ifndef WINMTRWHEEL_H_
+#define WINMTRWHEEL_H_
+
+#include "WinMTRGlobal.h"
+
+#define WHEEL_BITS			6
+#define WHEEL_SLOTS			(1 << WHEEL_BITS)	// per level, the bits of a __int64
+#define WHEEL_LEVELS		4					// 1 ms up to 4.6 hours, later timers wait at the top
+
+struct wheel_timer {
+	wheel_timer		*next;
+	wheel_timer		*prev;			// NULL while not armed
+	DWORD			due;			// GetTickCount() based
+	int				where;			// level * WHEEL_SLOTS + slot, or overdue
+	void			*data;
+};
+
+//*****************************************************************************
+// CLASS:  WinMTRWheel
+//
+//
+//*****************************************************************************
+
+class WinMTRWheel {
+public:
+	WinMTRWheel();
+
+	// empties the wheel and sets its time
+	void		Reset(DWORD now);
+	// a due time already passed expires on the next Advance, even at the
+	// same time
+	void		Add(wheel_timer *t, DWORD due);
+	void		Cancel(wheel_timer *t);
+	static bool	IsArmed(const wheel_timer *t);
+	// takes out the timers due by now, as a list linked by next
+	wheel_timer	*Advance(DWORD now);
+	// ms from now until the wheel has to be advanced, at most limit
+	DWORD		NextDue(DWORD now, DWORD limit);
+	int			GetCount();
+
+private:
+	void		Place(wheel_timer *t);
+	void		Cascade();
+	static int	LowestBit(unsigned __int64 mask);
+
+private:
+	wheel_timer			slot[WHEEL_LEVELS][WHEEL_SLOTS];	// list heads
+	unsigned __int64	used[WHEEL_LEVELS];					// bit per non-empty slot
+	wheel_timer			overdue;	// list head, added when already due
+	DWORD				current;	// timers due before it have been taken out
+	int					count;
+};
+
+#endif	// ifndef WINMTRWHEEL_H_
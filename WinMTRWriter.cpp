@@ -0,0 +1,178 @@
+//*****************************************************************************
+// FILE:            WinMTRWriter.cpp
+//
+//
+//*****************************************************************************
+
+#include "WinMTRWriter.h"
+
+//*****************************************************************************
+// WinMTRWriter::WinMTRWriter
+//
+//*****************************************************************************
+WinMTRWriter::WinMTRWriter(const char *p, int rotateKB, int rotateSeconds)
+	: rotateBytes((DWORD)rotateKB * 1024), rotateMs((DWORD)rotateSeconds * 1000),
+	  hasPending(false), stopping(false), written(0), dropped(0), worstWrite(0),
+	  size(0), rotated(GetTickCount()), failed(false)
+{
+	_snprintf(path, SIZE_FILENAME, "%s", p);
+	path[SIZE_FILENAME - 1] = 0;
+
+	InitializeCriticalSection(&lock);
+	hWake = CreateEvent(NULL, FALSE, FALSE, NULL);
+	hThread = (HANDLE)_beginthreadex(NULL, 0, WriterThread, this, 0, NULL);
+}
+
+//*****************************************************************************
+// WinMTRWriter::~WinMTRWriter
+//
+//*****************************************************************************
+WinMTRWriter::~WinMTRWriter()
+{
+	EnterCriticalSection(&lock);
+	stopping = true;
+	LeaveCriticalSection(&lock);
+	SetEvent(hWake);
+
+	WaitForSingleObject(hThread, INFINITE);
+	CloseHandle(hThread);
+	CloseHandle(hWake);
+	DeleteCriticalSection(&lock);
+}
+
+//*****************************************************************************
+// WinMTRWriter::Submit
+//
+//*****************************************************************************
+void WinMTRWriter::Submit(std::string& snapshot)
+{
+	EnterCriticalSection(&lock);
+	if (hasPending)
+		dropped++;
+	pending.swap(snapshot);
+	hasPending = true;
+	LeaveCriticalSection(&lock);
+	SetEvent(hWake);
+}
+
+//*****************************************************************************
+// WinMTRWriter::WriterThread
+//
+//*****************************************************************************
+unsigned __stdcall WinMTRWriter::WriterThread(void *p)
+{
+	WinMTRWriter *w = (WinMTRWriter*)p;
+
+	for (;;) {
+		EnterCriticalSection(&w->lock);
+		bool take = w->hasPending;
+		bool stop = w->stopping;
+		if (take) {
+			w->writing.swap(w->pending);
+			w->hasPending = false;
+		}
+		LeaveCriticalSection(&w->lock);
+
+		if (take)
+			w->Write(w->writing);
+		else if (stop)
+			break;
+		else
+			WaitForSingleObject(w->hWake, INFINITE);
+	}
+	return 0;
+}
+
+//*****************************************************************************
+// WinMTRWriter::Write
+//
+// Errors are reported once, later snapshots are still tried.
+//*****************************************************************************
+void WinMTRWriter::Write(const std::string& snapshot)
+{
+	char tmp[SIZE_FILENAME + 8];
+	DWORD start = GetTickCount();
+
+	_snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+	FILE *file = fopen(tmp, "w");
+	bool ok = file != NULL
+		&& fwrite(snapshot.data(), 1, snapshot.size(), file) == snapshot.size();
+	if (file && fclose(file) != 0)
+		ok = false;
+	if (!ok) {
+		if (!failed)
+			fprintf(stderr, "error: could not write snapshot to '%s': %s\n",
+				tmp, strerror(errno));
+		failed = true;
+		return;
+	}
+
+	if (written > 0 &&
+		((rotateBytes && size >= rotateBytes) ||
+		 (rotateMs && start - rotated >= rotateMs))) {
+		Rotate();
+		size = 0;
+		rotated = start;
+	}
+
+	if (!MoveFileEx(tmp, path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+		if (!failed)
+			fprintf(stderr, "error: could not replace '%s'\n", path);
+		failed = true;
+		return;
+	}
+	size += (DWORD)snapshot.size();
+	written++;
+
+	LONG ms = (LONG)(GetTickCount() - start);
+	if (ms > worstWrite)
+		worstWrite = ms;
+}
+
+//*****************************************************************************
+// WinMTRWriter::Rotate
+//
+//*****************************************************************************
+void WinMTRWriter::Rotate()
+{
+	char from[SIZE_FILENAME + 8], to[SIZE_FILENAME + 8];
+
+	for (int i = SNAPSHOT_KEEP - 1; i >= 1; i--) {
+		_snprintf(from, sizeof(from), "%s.%d", path, i);
+		_snprintf(to, sizeof(to), "%s.%d", path, i + 1);
+		MoveFileEx(from, to, MOVEFILE_REPLACE_EXISTING);
+	}
+	// copied, FILE stays in place until the next snapshot is renamed over it
+	_snprintf(to, sizeof(to), "%s.1", path);
+	if (!CopyFile(path, to, FALSE) && !failed) {
+		fprintf(stderr, "error: could not rotate '%s'\n", path);
+		failed = true;
+	}
+}
+
+//*****************************************************************************
+// WinMTRWriter::GetWritten
+//
+//*****************************************************************************
+int WinMTRWriter::GetWritten()
+{
+	return written;
+}
+
+//*****************************************************************************
+// WinMTRWriter::GetDropped
+//
+//*****************************************************************************
+int WinMTRWriter::GetDropped()
+{
+	return dropped;
+}
+
+//*****************************************************************************
+// WinMTRWriter::GetWorstWrite
+//
+//*****************************************************************************
+DWORD WinMTRWriter::GetWorstWrite()
+{
+	return worstWrite;
+}
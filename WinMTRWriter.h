@@ -0,0 +1,76 @@
+//*****************************************************************************
+// FILE:            WinMTRWriter.h
+//
+//
+// DESCRIPTION: The WinMTRWriter class writes report snapshots to a file on
+//              its own thread and keeps earlier ones by size or age.
+//
+//
+// NOTES: Submit hands over the snapshot by swapping strings and never
+//        waits for the disk. Only the latest snapshot waits to be written,
+//        if the writer falls behind the older one is replaced and counted
+//        as dropped, so a slow disk costs snapshots, not probe timing.
+//        Each snapshot is written to FILE.tmp and renamed over FILE with
+//        MoveFileEx, so FILE always holds one complete snapshot, the
+//        latest. On rotation FILE is copied to FILE.1 first, after FILE.1
+//        was renamed to FILE.2 and so on up to SNAPSHOT_KEEP.
+//
+//*****************************************************************************
+
+#ifndef WINMTRWRITER_H_
+#define WINMTRWRITER_H_
+
+#include "WinMTRGlobal.h"
+#include "WinMTRParams.h"
+#include <string>
+
+#define SNAPSHOT_KEEP		5		// rotated files kept besides the current one
+#define SNAPSHOT_POLL		100		// ms between snapshot checks in report mode
+
+//*****************************************************************************
+// CLASS:  WinMTRWriter
+//
+//
+//*****************************************************************************
+
+class WinMTRWriter {
+public:
+	// rotateKB (snapshots written) and rotateSeconds of 0 never rotate
+	WinMTRWriter(const char *path, int rotateKB, int rotateSeconds);
+	// writes the pending snapshot before returning
+	~WinMTRWriter();
+
+	// takes the contents of snapshot, which is left with the previous buffer
+	void	Submit(std::string& snapshot);
+	int		GetWritten();
+	int		GetDropped();
+	DWORD	GetWorstWrite();	// ms
+
+private:
+	static unsigned __stdcall WriterThread(void *p);
+	void	Write(const std::string& snapshot);
+	void	Rotate();
+
+private:
+	char				path[SIZE_FILENAME];
+	DWORD				rotateBytes;
+	DWORD				rotateMs;
+
+	CRITICAL_SECTION	lock;
+	HANDLE				hWake;
+	HANDLE				hThread;
+	std::string			pending;		// guarded by lock
+	bool				hasPending;		// guarded by lock
+	bool				stopping;		// guarded by lock
+	volatile LONG		written;
+	volatile LONG		dropped;
+	volatile LONG		worstWrite;
+
+	// writer thread only
+	std::string			writing;
+	DWORD				size;			// bytes written since the last rotation
+	DWORD				rotated;		// GetTickCount() of the last rotation
+	bool				failed;			// an error was reported already
+};
+
+#endif	// ifndef WINMTRWRITER_H_
@@ -0,0 +1,99 @@
+//*****************************************************************************
+// FILE:            CompactBench.cpp
+//
+//
+// DESCRIPTION: Measures the memory of the finished job results of server
+//              mode: traces a simulated 30 hop path once, keeps TARGETS
+//              WinMTRCompact records of it and prints their size by
+//              GetBytes and by the growth of the working set, next to the
+//              size of a WinMTRNet, which is what keeping the full trace
+//              state would take.
+//
+//
+// NOTES: Not part of the solution. Build the Release WinMTRLib first, then
+//        from this directory:
+//
+//          cl /nologo /O2 /EHsc /MT /I.. CompactBench.cpp
+//             ..\Release_x32\WinMTRLib.lib
+//
+//        Usage: CompactBench [TARGETS] (default MAX_RESULTS, the most the
+//        server keeps). The path file compactbench.txt is written to the
+//        current directory. Every record shares the same addresses, so the
+//        intern table stays at 30 entries; a sweep over different routes
+//        adds about 16 bytes plus the name per distinct address.
+//
+//*****************************************************************************
+
+#include "WinMTRCmd.h"
+#include <psapi.h>
+
+#pragma comment(lib, "psapi.lib")
+
+#define HOPS	30
+#define PATH	"compactbench.txt"
+
+static size_t WorkingSet()
+{
+	PROCESS_MEMORY_COUNTERS pmc;
+
+	pmc.cb = sizeof(pmc);
+	GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc));
+	return pmc.WorkingSetSize;
+}
+
+int main(int argc, char *argv[])
+{
+	WinMTRParams params;
+	WinMTRIntern intern;
+	std::vector<WinMTRCompact*> results;
+	int targets = (argc > 1) ? atoi(argv[1]) : MAX_RESULTS;
+
+	FILE *f = fopen(PATH, "w");
+	if (f == NULL)
+		return 1;
+	for (int ttl = 1; ttl < HOPS; ttl++)
+		fprintf(f, "%d 10.%d.0.1 %d 2 5\n", ttl, ttl, ttl * 3);
+	fprintf(f, "%d 192.0.2.1 %d 2 0\n", HOPS, HOPS * 3);
+	fclose(f);
+
+	params.SetCycles(20);
+	params.SetInterval(0);
+	params.SetTimeout(1);
+	params.SetUseDNS(false);
+	params.SetSimFile(PATH);
+
+	WinMTREngine *engine = new WinMTREngine(0, PATH);
+	if (!engine->IsInitialized())
+		return 1;
+	WinMTRNet *net = new WinMTRNet(&params, engine);
+	net->DoTrace(inet_addr("192.0.2.1"), false);
+
+	size_t before = WorkingSet();
+	size_t bytes = 0;
+	int wide = 0;
+
+	results.reserve(targets);
+	for (int i = 0; i < targets; i++) {
+		WinMTRCompact *result = new WinMTRCompact(&intern);
+		result->Store(net);
+		bytes += result->GetBytes();
+		wide += result->IsWide();
+		results.push_back(result);
+	}
+	size_t after = WorkingSet();
+
+	printf("%d targets of %d hops, %d wide\n", targets, net->GetMaxUnsafe(), wide);
+	printf("GetBytes:    %.0f bytes per target, %.1f MB\n",
+		(double)bytes / targets, bytes / 1048576.0);
+	printf("working set: %.0f bytes per target, %.1f MB (with the pointer array)\n",
+		(double)(after - before) / targets, (after - before) / 1048576.0);
+	printf("intern:      %d addresses in %.0f bytes\n", intern.GetCount(),
+		(double)intern.GetBytes());
+	printf("WinMTRNet:   %.0f bytes per target\n", (double)sizeof(WinMTRNet));
+
+	for (size_t i = 0; i < results.size(); i++)
+		delete results[i];
+	delete net;
+	delete engine;
+	return 0;
+}
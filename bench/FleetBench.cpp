@@ -0,0 +1,152 @@
+//*****************************************************************************
+// FILE:            FleetBench.cpp
+//
+//
+// DESCRIPTION: Times the kernels of WinMTRFleet on synthetic hop records
+//              against plain scalar loops, checks that both give the same
+//              loss bit for bit, and times a whole fleet summary.
+//
+//
+// NOTES: Not part of the solution. Build the Release WinMTRLib first, then
+//        from this directory (32-bit, the library is built with
+//        /arch:SSE2, drop it for x64 where SSE2 is the default):
+//
+//          cl /nologo /O2 /EHsc /MT /arch:SSE2 /I.. FleetBench.cpp
+//             ..\Release_x32\WinMTRLib.lib
+//
+//        Usage: FleetBench [HOPS] (default 1000000, 25 per target). Each
+//        timing is the best of RUNS runs. VS2010 does not vectorize loops
+//        by itself, so the scalar loops here stay scalar.
+//
+//*****************************************************************************
+
+#include "WinMTRFleet.h"
+#include <algorithm>
+#include <functional>
+
+// what WinMTRFleet.cpp picks when built with the same /arch
+#if defined(__AVX2__)
+#define KERNELS		"AVX2"
+#elif defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define KERNELS		"SSE2"
+#else
+#define KERNELS		"scalar"
+#endif
+
+#define RUNS		10
+#define PER_TARGET	25
+#define TOP			10
+
+static LARGE_INTEGER freq;
+
+static double Ms(LARGE_INTEGER a, LARGE_INTEGER b)
+{
+	return (double)(b.QuadPart - a.QuadPart) * 1000 / freq.QuadPart;
+}
+
+static void ScalarLoss(const int *x, const int *r, float *loss, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+		loss[i] = x[i] ? 100.0f - (100.0f * r[i] / x[i]) : 0.0f;
+}
+
+static void ScalarTop(const float *v, size_t n, int k, std::vector<int>& index)
+{
+	std::vector<std::pair<float, int> > all(n);
+
+	for (size_t i = 0; i < n; i++)
+		all[i] = std::make_pair(v[i], (int)i);
+	std::partial_sort(all.begin(), all.begin() + k, all.end(),
+		std::greater<std::pair<float, int> >());
+	index.clear();
+	for (int i = 0; i < k; i++)
+		index.push_back(all[i].second);
+}
+
+int main(int argc, char *argv[])
+{
+	size_t n = (argc > 1) ? (size_t)atoi(argv[1]) : 1000000;
+	std::vector<int> xmit(n), returned(n), index, check;
+	std::vector<float> loss(n), scalar(n);
+	LARGE_INTEGER t0, t1;
+	double best;
+
+	if (n < TOP)
+		return 1;
+	QueryPerformanceFrequency(&freq);
+	srand(1);
+	for (size_t i = 0; i < n; i++) {
+		xmit[i] = 10 + rand() % 100;
+		returned[i] = (rand() % 4) ? xmit[i] : rand() % (xmit[i] + 1);
+	}
+
+	printf("%.0f hops, %s kernels\n", (double)n, KERNELS);
+
+	best = 1e9;
+	for (int run = 0; run < RUNS; run++) {
+		QueryPerformanceCounter(&t0);
+		ScalarLoss(&xmit[0], &returned[0], &scalar[0], n);
+		QueryPerformanceCounter(&t1);
+		best = std::min(best, Ms(t0, t1));
+	}
+	printf("loss   scalar  %7.2f ms\n", best);
+
+	best = 1e9;
+	for (int run = 0; run < RUNS; run++) {
+		QueryPerformanceCounter(&t0);
+		WinMTRFleet::ComputeLoss(&xmit[0], &returned[0], &loss[0], n);
+		QueryPerformanceCounter(&t1);
+		best = std::min(best, Ms(t0, t1));
+	}
+	printf("loss   fleet   %7.2f ms, %s\n", best,
+		memcmp(&loss[0], &scalar[0], n * sizeof(float)) ? "DIFFERS" : "bit for bit equal");
+
+	best = 1e9;
+	for (int run = 0; run < RUNS; run++) {
+		QueryPerformanceCounter(&t0);
+		ScalarTop(&loss[0], n, TOP, check);
+		QueryPerformanceCounter(&t1);
+		best = std::min(best, Ms(t0, t1));
+	}
+	printf("top %d scalar  %7.2f ms\n", TOP, best);
+
+	best = 1e9;
+	for (int run = 0; run < RUNS; run++) {
+		QueryPerformanceCounter(&t0);
+		WinMTRFleet::TopK(&loss[0], n, TOP, index);
+		QueryPerformanceCounter(&t1);
+		best = std::min(best, Ms(t0, t1));
+	}
+	bool same = true;
+	for (int i = 0; i < TOP; i++)
+		if (loss[index[i]] != loss[check[i]])
+			same = false;
+	printf("top %d fleet   %7.2f ms, %s\n", TOP, best, same ? "same values" : "DIFFERS");
+
+	// the whole summary, as '<id> *' renders it
+	WinMTRFleet fleet;
+	WinMTRIntern intern;
+	s_widehop hop[PER_TARGET];
+	std::string report;
+
+	memset(hop, 0, sizeof(hop));
+	QueryPerformanceCounter(&t0);
+	for (size_t i = 0; i < n; i += PER_TARGET) {
+		int hops = (int)std::min((size_t)PER_TARGET, n - i);
+		for (int at = 0; at < hops; at++) {
+			hop[at].addr = htonl(0x0a000000 + (rand() % 5000) * 256 + at);
+			hop[at].xmit = xmit[i + at];
+			hop[at].returned = returned[i + at];
+			hop[at].avg = (float)(at * 3 + rand() % 10);
+		}
+		fleet.Add(htonl(0xc0000200 + (int)(i / PER_TARGET)), hop, hops);
+	}
+	QueryPerformanceCounter(&t1);
+	printf("add    fleet   %7.2f ms\n", Ms(t0, t1));
+
+	QueryPerformanceCounter(&t0);
+	fleet.Render(report, &intern, TOP);
+	QueryPerformanceCounter(&t1);
+	printf("render fleet   %7.2f ms\n", Ms(t0, t1));
+	return 0;
+}
@@ -0,0 +1,117 @@
+//*****************************************************************************
+// FILE:            MetricsBench.cpp
+//
+//
+// DESCRIPTION: Measures what --metrics costs: the time of one measuring
+//              point (two Now() and an Add()) with collection off and on,
+//              then the wall time of TARGETS simulated traces of a 30 hop
+//              path with 0 ms hops and no interval, where the probe path
+//              itself is all there is to time, off against on.
+//
+//
+// NOTES: Not part of the solution. Build the Release WinMTRLib first, then
+//        from this directory:
+//
+//          cl /nologo /O2 /EHsc /MT /I.. MetricsBench.cpp
+//             ..\Release_x32\WinMTRLib.lib
+//
+//        Usage: MetricsBench [TARGETS] [CYCLES] (default 100 targets of 20
+//        cycles). The path file metricsbench.txt is written to the current
+//        directory. Every time is the best of RUNS runs, the runs of off
+//        and on alternate so both see the same machine.
+//
+//*****************************************************************************
+
+#include "WinMTRCmd.h"
+#include <algorithm>
+
+#define RUNS		5
+#define HOPS		30
+#define POINTS		10000000
+#define PATH		"metricsbench.txt"
+
+static LARGE_INTEGER freq;
+
+static double Ms(LARGE_INTEGER a, LARGE_INTEGER b)
+{
+	return (double)(b.QuadPart - a.QuadPart) * 1000 / freq.QuadPart;
+}
+
+// a measuring point as the engine has them, ns per point
+static double Point(bool enabled)
+{
+	WinMTRMetrics metrics;
+	LARGE_INTEGER t0, t1;
+
+	WinMTRMetrics::Enable(enabled);
+	QueryPerformanceCounter(&t0);
+	for (int i = 0; i < POINTS; i++) {
+		LONGLONG start = WinMTRMetrics::Now();
+		metrics.Add(METRIC_REPLY, start, WinMTRMetrics::Now());
+	}
+	QueryPerformanceCounter(&t1);
+	return Ms(t0, t1) * 1e6 / POINTS;
+}
+
+// TARGETS traces at once, ms until all are done
+static double Trace(bool enabled, int targets, int cycles)
+{
+	std::vector<WinMTRParams*> params(targets);
+	std::vector<WinMTRNet*> nets(targets);
+	LARGE_INTEGER t0, t1;
+
+	WinMTRMetrics::Enable(enabled);
+	WinMTREngine *engine = new WinMTREngine(0, PATH);
+	if (!engine->IsInitialized())
+		exit(1);
+
+	QueryPerformanceCounter(&t0);
+	for (int i = 0; i < targets; i++) {
+		params[i] = new WinMTRParams();
+		params[i]->SetCycles(cycles);
+		params[i]->SetInterval(0);
+		params[i]->SetTimeout(1);
+		params[i]->SetUseDNS(false);
+		params[i]->SetSimFile(PATH);
+		nets[i] = new WinMTRNet(params[i], engine);
+		nets[i]->DoTrace(inet_addr("192.0.2.1"), true);
+	}
+	for (int i = 0; i < targets; i++)
+		while (nets[i]->IsTracing())
+			Sleep(1);
+	QueryPerformanceCounter(&t1);
+
+	for (int i = 0; i < targets; i++) {
+		delete nets[i];
+		delete params[i];
+	}
+	delete engine;
+	return Ms(t0, t1);
+}
+
+int main(int argc, char *argv[])
+{
+	int targets = (argc > 1) ? atoi(argv[1]) : 100;
+	int cycles = (argc > 2) ? atoi(argv[2]) : 20;
+	double point[2] = { 1e9, 1e9 }, trace[2] = { 1e9, 1e9 };
+
+	QueryPerformanceFrequency(&freq);
+	FILE *f = fopen(PATH, "w");
+	if (f == NULL)
+		return 1;
+	for (int ttl = 1; ttl < HOPS; ttl++)
+		fprintf(f, "%d 10.%d.0.1 0 0 0\n", ttl, ttl);
+	fprintf(f, "%d 192.0.2.1 0 0 0\n", HOPS);
+	fclose(f);
+
+	for (int run = 0; run < RUNS; run++)
+		for (int on = 0; on < 2; on++) {
+			point[on] = std::min(point[on], Point(on != 0));
+			trace[on] = std::min(trace[on], Trace(on != 0, targets, cycles));
+		}
+
+	printf("measuring point  off %6.1f ns, on %6.1f ns\n", point[0], point[1]);
+	printf("%d targets of %d hops, %d cycles: off %8.1f ms, on %8.1f ms (%+.1f%%)\n",
+		targets, HOPS, cycles, trace[0], trace[1], (trace[1] / trace[0] - 1) * 100);
+	return 0;
+}
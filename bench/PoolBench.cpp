@@ -0,0 +1,136 @@
+//*****************************************************************************
+// FILE:            PoolBench.cpp
+//
+//
+// DESCRIPTION: Measures the probe memory of many concurrent traces: runs
+//              TARGETS traces of a simulated 30 hop path at once through one
+//              engine and prints the growth of the peak working set per
+//              target and per task, next to the structure sizes. Then times
+//              WinMTRPool Get and Put of reply buffers against new and
+//              delete.
+//
+//
+// NOTES: Not part of the solution. Build the Release WinMTRLib first, then
+//        from this directory:
+//
+//          cl /nologo /O2 /EHsc /MT /I.. PoolBench.cpp
+//             ..\Release_x32\WinMTRLib.lib
+//
+//        Usage: PoolBench [TARGETS] [SIZE] (default 1000 targets, 64 byte
+//        probes). The path file poolbench.txt is written to the current
+//        directory. Every target keeps MAX_HOPS tasks until its trace has
+//        found the path, the peak is taken with all of them running.
+//
+//*****************************************************************************
+
+#include "WinMTRCmd.h"
+#include <psapi.h>
+
+#pragma comment(lib, "psapi.lib")
+
+#define HOPS		30
+#define CYCLES		3
+#define PATH		"poolbench.txt"
+#define BUFFERS		64			// in flight at once in the timing loop
+#define ROUNDS		100000
+
+static LARGE_INTEGER freq;
+
+static double Ns(LARGE_INTEGER a, LARGE_INTEGER b, int n)
+{
+	return (double)(b.QuadPart - a.QuadPart) * 1e9 / freq.QuadPart / n;
+}
+
+static void Memory(PROCESS_MEMORY_COUNTERS *pmc)
+{
+	pmc->cb = sizeof(*pmc);
+	GetProcessMemoryInfo(GetCurrentProcess(), pmc, sizeof(*pmc));
+}
+
+int main(int argc, char *argv[])
+{
+	int targets = (argc > 1) ? atoi(argv[1]) : 1000;
+	int size = (argc > 2) ? atoi(argv[2]) : DEFAULT_PING_SIZE;
+	std::vector<WinMTRParams*> params(targets);
+	std::vector<WinMTRNet*> nets(targets);
+	PROCESS_MEMORY_COUNTERS before, after;
+	LARGE_INTEGER t0, t1;
+
+	QueryPerformanceFrequency(&freq);
+	FILE *f = fopen(PATH, "w");
+	if (f == NULL)
+		return 1;
+	for (int ttl = 1; ttl < HOPS; ttl++)
+		fprintf(f, "%d 10.%d.0.1 %d 2 5\n", ttl, ttl, ttl * 3);
+	fprintf(f, "%d 192.0.2.1 %d 2 0\n", HOPS, HOPS * 3);
+	fclose(f);
+
+	WinMTREngine *engine = new WinMTREngine(0, PATH);
+	if (!engine->IsInitialized())
+		return 1;
+
+	Memory(&before);
+	QueryPerformanceCounter(&t0);
+	for (int i = 0; i < targets; i++) {
+		params[i] = new WinMTRParams();
+		params[i]->SetCycles(CYCLES);
+		params[i]->SetInterval(1);
+		params[i]->SetTimeout(1);
+		params[i]->SetPingSize(size);
+		params[i]->SetUseDNS(false);
+		params[i]->SetSimFile(PATH);
+		nets[i] = new WinMTRNet(params[i], engine);
+		nets[i]->DoTrace(inet_addr("192.0.2.1"), true);
+	}
+	for (int i = 0; i < targets; i++)
+		while (nets[i]->IsTracing())
+			Sleep(50);
+	QueryPerformanceCounter(&t1);
+	Memory(&after);
+
+	size_t grown = after.PeakWorkingSetSize - before.WorkingSetSize;
+	printf("%d targets of %d hops, %d cycles of %d byte probes in %.1f s\n",
+		targets, HOPS, CYCLES, size, Ns(t0, t1, 1) / 1e9);
+	printf("peak working set: +%.1f MB, %.0f bytes per target (WinMTRNet %.0f)\n",
+		grown / 1048576.0, (double)grown / targets, (double)sizeof(WinMTRNet));
+	// the size class the pool rounds the reply buffer up to
+	unsigned long reply = (unsigned long)REPLY_SIZE(size), rounded = 1UL << POOL_MIN_SHIFT;
+	while (rounded < reply)
+		rounded <<= 1;
+	printf("per task: probe_task %.0f bytes, probe_req %.0f bytes in the table,\n"
+		"          reply buffer %lu bytes (%lu with its class) while in flight\n",
+		(double)sizeof(probe_task), (double)sizeof(probe_req), reply, rounded);
+
+	for (int i = 0; i < targets; i++) {
+		delete nets[i];
+		delete params[i];
+	}
+	delete engine;
+
+	// reply buffers as a worker takes and returns them, BUFFERS in flight
+	WinMTRPool pool;
+	char *buf[BUFFERS];
+	DWORD actual[BUFFERS];
+	DWORD bytes = (DWORD)REPLY_SIZE(size);
+
+	QueryPerformanceCounter(&t0);
+	for (int r = 0; r < ROUNDS; r++) {
+		for (int i = 0; i < BUFFERS; i++)
+			buf[i] = pool.Get(bytes, &actual[i]);
+		for (int i = 0; i < BUFFERS; i++)
+			pool.Put(buf[i], actual[i]);
+	}
+	QueryPerformanceCounter(&t1);
+	printf("pool Get+Put   %6.1f ns\n", Ns(t0, t1, ROUNDS * BUFFERS));
+
+	QueryPerformanceCounter(&t0);
+	for (int r = 0; r < ROUNDS; r++) {
+		for (int i = 0; i < BUFFERS; i++)
+			buf[i] = new char[bytes];
+		for (int i = 0; i < BUFFERS; i++)
+			delete [] buf[i];
+	}
+	QueryPerformanceCounter(&t1);
+	printf("new+delete     %6.1f ns\n", Ns(t0, t1, ROUNDS * BUFFERS));
+	return 0;
+}
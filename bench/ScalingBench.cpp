@@ -0,0 +1,138 @@
+//*****************************************************************************
+// FILE:            ScalingBench.cpp
+//
+//
+// DESCRIPTION: Measures how the engine scales with its workers: for 1 to
+//              WORKERS workers (--workers) runs TARGETS traces of a
+//              simulated 30 hop path with 0 ms hops and no interval at once
+//              and prints the probes per second and the time a probe round
+//              of one TTL takes, from one completion to the next, which is
+//              all engine and no network.
+//
+//
+// NOTES: Not part of the solution. Build the Release WinMTRLib first, then
+//        from this directory:
+//
+//          cl /nologo /O2 /EHsc /MT /I.. ScalingBench.cpp
+//             ..\Release_x32\WinMTRLib.lib
+//
+//        Usage: ScalingBench [WORKERS] [TARGETS] [CYCLES] (default one per
+//        processor, 200 targets, 20 cycles). The path file scalingbench.txt
+//        is written to the current directory. Every line is the best of
+//        RUNS runs by throughput.
+//
+//*****************************************************************************
+
+#include "WinMTRCmd.h"
+#include <algorithm>
+
+#define RUNS		3
+#define HOPS		30
+#define PATH		"scalingbench.txt"
+
+struct bench_target {
+	int			cycles;
+	LONGLONG	*done;		// QPC of each completion, by TTL and cycle
+};
+
+static LARGE_INTEGER freq;
+
+static void OnProbe(const wmtr_probe_result *result, void *context)
+{
+	bench_target *t = (bench_target*)context;
+	LARGE_INTEGER now;
+
+	if (result->ttl > HOPS || result->cycle < 1 || result->cycle > t->cycles)
+		return;
+	QueryPerformanceCounter(&now);
+	t->done[(result->ttl - 1) * t->cycles + result->cycle - 1] = now.QuadPart;
+}
+
+// one run, probes per second and the rounds in ms into rounds
+static double Run(int workers, int targets, int cycles, std::vector<double>& rounds)
+{
+	std::vector<WinMTRParams*> params(targets);
+	std::vector<WinMTRNet*> nets(targets);
+	std::vector<bench_target> target(targets);
+	std::vector<LONGLONG> done((size_t)targets * HOPS * cycles, 0);
+	LARGE_INTEGER t0, t1;
+
+	WinMTREngine *engine = new WinMTREngine(workers, PATH);
+	if (!engine->IsInitialized())
+		exit(1);
+
+	QueryPerformanceCounter(&t0);
+	for (int i = 0; i < targets; i++) {
+		target[i].cycles = cycles;
+		target[i].done = &done[(size_t)i * HOPS * cycles];
+		params[i] = new WinMTRParams();
+		params[i]->SetCycles(cycles);
+		params[i]->SetInterval(0);
+		params[i]->SetTimeout(1);
+		params[i]->SetUseDNS(false);
+		params[i]->SetSimFile(PATH);
+		nets[i] = new WinMTRNet(params[i], engine);
+		nets[i]->SetProbeCallback(OnProbe, &target[i]);
+		nets[i]->DoTrace(inet_addr("192.0.2.1"), true);
+	}
+	for (int i = 0; i < targets; i++)
+		while (nets[i]->IsTracing())
+			Sleep(1);
+	QueryPerformanceCounter(&t1);
+
+	for (int i = 0; i < targets; i++) {
+		delete nets[i];
+		delete params[i];
+	}
+	delete engine;
+
+	rounds.clear();
+	for (size_t task = 0; task < (size_t)targets * HOPS; task++)
+		for (int c = 1; c < cycles; c++) {
+			LONGLONG a = done[task * cycles + c - 1], b = done[task * cycles + c];
+			if (a && b)
+				rounds.push_back((double)(b - a) * 1000 / freq.QuadPart);
+		}
+	double seconds = (double)(t1.QuadPart - t0.QuadPart) / freq.QuadPart;
+	return (double)targets * HOPS * cycles / seconds;
+}
+
+int main(int argc, char *argv[])
+{
+	SYSTEM_INFO si;
+	GetSystemInfo(&si);
+	int maxWorkers = (argc > 1) ? atoi(argv[1]) : (int)si.dwNumberOfProcessors;
+	int targets = (argc > 2) ? atoi(argv[2]) : 200;
+	int cycles = (argc > 3) ? atoi(argv[3]) : 20;
+	std::vector<double> rounds, best;
+
+	QueryPerformanceFrequency(&freq);
+	FILE *f = fopen(PATH, "w");
+	if (f == NULL)
+		return 1;
+	for (int ttl = 1; ttl < HOPS; ttl++)
+		fprintf(f, "%d 10.%d.0.1 0 0 0\n", ttl, ttl);
+	fprintf(f, "%d 192.0.2.1 0 0 0\n", HOPS);
+	fclose(f);
+
+	printf("%d targets of %d hops, %d cycles, best of %d runs\n", targets, HOPS, cycles, RUNS);
+	double base = 0;
+	for (int workers = 1; workers <= maxWorkers; workers++) {
+		double rate = 0;
+		for (int run = 0; run < RUNS; run++) {
+			double r = Run(workers, targets, cycles, rounds);
+			if (r > rate) {
+				rate = r;
+				best.swap(rounds);
+			}
+		}
+		if (workers == 1)
+			base = rate;
+		std::sort(best.begin(), best.end());
+		if (best.empty())
+			best.push_back(0);
+		printf("%2d workers %10.0f probes/s (x%.2f), round p50 %7.2f ms, p99 %7.2f ms\n",
+			workers, rate, rate / base, best[best.size() / 2], best[best.size() * 99 / 100]);
+	}
+	return 0;
+}
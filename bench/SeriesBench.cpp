@@ -0,0 +1,114 @@
+//*****************************************************************************
+// FILE:            SeriesBench.cpp
+//
+//
+// DESCRIPTION: Measures WinMTRSeries: bits per probe, append and read
+//              times, for probes sent on a 1 s schedule, on time and with
+//              up to 3 ms of send lag, with RTT noise, 5% loss and some
+//              replies completing out of send order. Checks that every
+//              sample reads back.
+//
+//
+// NOTES: Not part of the solution. Build the Release WinMTRLib first, then
+//        from this directory:
+//
+//          cl /nologo /O2 /EHsc /MT /I.. SeriesBench.cpp
+//             ..\Release_x32\WinMTRLib.lib
+//
+//        Usage: SeriesBench [PROBES] (default 86400, a day at -i 1, per hop
+//        for 30 hops). The blocks are sized so nothing is dropped.
+//
+//*****************************************************************************
+
+#include "WinMTRSeries.h"
+#include <algorithm>
+
+#define HOPS	30
+
+static LARGE_INTEGER freq;
+
+static double Ms(LARGE_INTEGER a, LARGE_INTEGER b)
+{
+	return (double)(b.QuadPart - a.QuadPart) * 1000 / freq.QuadPart;
+}
+
+static bool Earlier(const s_sample& a, const s_sample& b)
+{
+	return a.time < b.time || (a.time == b.time && a.rtt < b.rtt);
+}
+
+static bool Equal(const s_sample& a, const s_sample& b)
+{
+	return a.time == b.time && a.rtt == b.rtt;
+}
+
+// lag is the largest send lag in ms plus one
+static void Run(int probes, int lag)
+{
+	std::vector<s_sample> sent(probes), order, back;
+	LARGE_INTEGER t0, t1;
+	double append = 0, read = 0;
+	bool same = true;
+
+	srand(1);
+	// 24 bits per probe is plenty
+	WinMTRSeries *series = new WinMTRSeries(probes * 3 / SERIES_BLOCK_SIZE + 2);
+
+	for (int at = 0; at < HOPS; at++) {
+		int base = 1 + at * 3;
+		for (int i = 0; i < probes; i++) {
+			sent[i].time = i * 1000 + rand() % lag;
+			sent[i].rtt = (rand() % 20 == 0) ? SERIES_LOST : base + rand() % 5;
+		}
+		// every 50th reply completes after the next probe was sent
+		order = sent;
+		for (int i = 0; i + 1 < probes; i += 50)
+			std::swap(order[i], order[i + 1]);
+
+		QueryPerformanceCounter(&t0);
+		for (int i = 0; i < probes; i++)
+			series->Append(at, order[i].time, order[i].rtt);
+		QueryPerformanceCounter(&t1);
+		append += Ms(t0, t1);
+
+		back.clear();
+		QueryPerformanceCounter(&t0);
+		series->Read(at, 0, 0xffffffff, back);
+		QueryPerformanceCounter(&t1);
+		read += Ms(t0, t1);
+
+		std::sort(back.begin(), back.end(), Earlier);
+		std::sort(order.begin(), order.end(), Earlier);
+		if (back.size() != order.size()
+			|| !std::equal(back.begin(), back.end(), order.begin(), Equal))
+			same = false;
+	}
+
+	double samples = (double)series->GetSamples();
+	printf("send lag 0..%d ms: %.0f probes, %.0f bytes, %.2f bits per probe, %s\n",
+		lag - 1, samples, (double)series->GetBytes(), 8.0 * series->GetBytes() / samples,
+		same ? "all read back" : "READ BACK DIFFERS");
+	printf("  append %.1f ns per probe, read %.1f ns per probe\n",
+		append * 1e6 / samples, read * 1e6 / samples);
+
+	// a one hour range out of the middle decodes only its blocks
+	std::vector<s_sample> range;
+	DWORD from = (DWORD)probes / 2 * 1000;
+	QueryPerformanceCounter(&t0);
+	for (int at = 0; at < HOPS; at++)
+		series->Read(at, from, from + 3600 * 1000, range);
+	QueryPerformanceCounter(&t1);
+	printf("  range of 3600 s: %d probes in %.2f ms\n", (int)range.size(), Ms(t0, t1));
+
+	delete series;
+}
+
+int main(int argc, char *argv[])
+{
+	int probes = (argc > 1) ? atoi(argv[1]) : 86400;
+
+	QueryPerformanceFrequency(&freq);
+	Run(probes, 1);
+	Run(probes, 4);
+	return 0;
+}
@@ -0,0 +1,124 @@
+//*****************************************************************************
+// FILE:            StartupBench.cpp
+//
+//
+// DESCRIPTION: Measures the startup latency of a short one-shot report the
+//              way WinMTRCmd::Run does it: gethostname with its own
+//              WSAStartup, the engine setup (WSAStartup, ICMP.DLL), the time
+//              to the first reply and the time until the trace is done, for
+//              -c CYCLES at the default interval and timeout and for --fast.
+//
+//
+// NOTES: Not part of the solution. Build the Release WinMTRLib first, then
+//        from this directory:
+//
+//          cl /nologo /O2 /EHsc /MT /I.. StartupBench.cpp
+//             ..\Release_x32\WinMTRLib.lib
+//
+//        Usage: StartupBench [CYCLES] [TARGET] (default 3 cycles against a
+//        simulated 10 hop path with 1 ms hops, written to startupbench.txt
+//        in the current directory). With a numeric TARGET the real network
+//        is probed instead. Every time is the best of RUNS runs and counts
+//        from before the engine is created.
+//
+//*****************************************************************************
+
+#include "WinMTRCmd.h"
+#include <algorithm>
+
+#define RUNS	3
+#define HOPS	10
+#define PATH	"startupbench.txt"
+
+static LARGE_INTEGER freq;
+static LARGE_INTEGER start, first;
+static volatile LONG replies;
+
+static double Ms(LARGE_INTEGER a, LARGE_INTEGER b)
+{
+	return (double)(b.QuadPart - a.QuadPart) * 1000 / freq.QuadPart;
+}
+
+static void OnProbe(const wmtr_probe_result *result, void *context)
+{
+	if (result->status == IP_SUCCESS || result->status == IP_TTL_EXPIRED_TRANSIT)
+		if (InterlockedIncrement(&replies) == 1)
+			QueryPerformanceCounter(&first);
+}
+
+static void Run(const char *name, int cycles, bool fast, int addr, const char *simfile)
+{
+	double setup = 1e9, host = 1e9, reply = 1e9, done = 1e9;
+	char hostname[256];
+	WSADATA wsaData;
+	LARGE_INTEGER t0, t1;
+
+	for (int run = 0; run < RUNS; run++) {
+		WinMTRParams params;
+
+		// as ParseCommandLineParams leaves them
+		params.SetCycles(cycles);
+		params.SetInterval(fast ? (float)FAST_INTERVAL : (float)DEFAULT_INTERVAL);
+		params.SetTimeout(fast ? (float)FAST_TIMEOUT : (float)DEFAULT_TIMEOUT);
+		params.SetWorkers(fast ? FAST_WORKERS : DEFAULT_WORKERS);
+		params.SetFast(fast);
+		params.SetUseDNS(false);
+		params.SetSimFile(simfile);
+
+		replies = 0;
+		QueryPerformanceCounter(&start);
+		// as Run does it, Winsock is not started before the engine
+		if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+			exit(1);
+		if (gethostname(hostname, sizeof(hostname)) != 0)
+			exit(1);
+		WSACleanup();
+		QueryPerformanceCounter(&t0);
+		host = std::min(host, Ms(start, t0));
+
+		WinMTREngine *engine = new WinMTREngine(params.workers, params.simfile);
+		if (!engine->IsInitialized())
+			exit(1);
+		QueryPerformanceCounter(&t1);
+		setup = std::min(setup, Ms(t0, t1));
+
+		WinMTRNet *net = new WinMTRNet(&params, engine);
+		net->SetProbeCallback(OnProbe, NULL);
+		net->DoTrace(addr, false);
+		QueryPerformanceCounter(&t1);
+		done = std::min(done, Ms(start, t1));
+		if (replies)
+			reply = std::min(reply, Ms(start, first));
+
+		delete net;
+		delete engine;
+	}
+	printf("%-8s gethostname %6.2f ms, engine %6.2f ms, first reply %7.2f ms, done %8.1f ms\n",
+		name, host, setup, reply, done);
+}
+
+int main(int argc, char *argv[])
+{
+	int cycles = (argc > 1) ? atoi(argv[1]) : 3;
+	const char *simfile = PATH;
+	int addr = inet_addr("192.0.2.1");
+
+	QueryPerformanceFrequency(&freq);
+	if (argc > 2) {
+		addr = inet_addr(argv[2]);
+		simfile = "";
+	} else {
+		FILE *f = fopen(PATH, "w");
+		if (f == NULL)
+			return 1;
+		for (int ttl = 1; ttl < HOPS; ttl++)
+			fprintf(f, "%d 10.%d.0.1 1 0 0\n", ttl, ttl);
+		fprintf(f, "%d 192.0.2.1 1 0 0\n", HOPS);
+		fclose(f);
+	}
+
+	printf("%d cycles, best of %d runs\n", cycles, RUNS);
+	Run("default", cycles, false, addr, simfile);
+	Run("--fast", cycles, true, addr, simfile);
+	return 0;
+}
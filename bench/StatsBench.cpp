@@ -0,0 +1,105 @@
+//*****************************************************************************
+// FILE:            StatsBench.cpp
+//
+//
+// DESCRIPTION: Times --merge: writes FILES statistics files of a 20 hop trace
+//              into DIR, then reads and merges them the way
+//              WinMTRCmd::RunMerge does and prints the time per pass.
+//
+//
+// NOTES: Not part of the solution. Build the Release WinMTRLib first, then
+//        from this directory:
+//
+//          cl /nologo /O2 /EHsc /MT /I.. StatsBench.cpp
+//             ..\Release_x32\WinMTRLib.lib
+//
+//        Usage: StatsBench DIR [FILES] (default 2000 files). DIR has to
+//        exist, the files are left in it as statbench*.wms. The first pass
+//        reads from the disk, later ones from the file cache.
+//
+//*****************************************************************************
+
+#include "WinMTRStats.h"
+
+#define HOPS	20
+#define PASSES	5
+
+static double Ms(LARGE_INTEGER a, LARGE_INTEGER b, LARGE_INTEGER freq)
+{
+	return (double)(b.QuadPart - a.QuadPart) * 1000 / freq.QuadPart;
+}
+
+int main(int argc, char *argv[])
+{
+	LARGE_INTEGER freq, t0, t1;
+	WinMTRStats *total = new WinMTRStats;
+	WinMTRStats *part = new WinMTRStats;
+	char path[MAX_PATH];
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: StatsBench DIR [FILES]\n");
+		return 1;
+	}
+	int files = (argc > 2) ? atoi(argv[2]) : 2000;
+	QueryPerformanceFrequency(&freq);
+	srand(1);
+
+	part->header.runs = 1;
+	part->header.hops = HOPS;
+	_snprintf(part->header.hostname, SIZE_TARGET, "bench.example");
+	for (int i = 0; i < files; i++) {
+		part->header.start = 1000000 * (unsigned __int64)i;
+		part->header.end = part->header.start + 60000;
+		for (int at = 0; at < HOPS; at++) {
+			s_hopstats *s = &part->hop[at];
+			int base = 1 + at * 3;
+
+			s->addr = htonl(0x0a000001 + at);
+			s->xmit = 60;
+			s->returned = 50 + rand() % 11;
+			s->best = base;
+			s->worst = base + 20;
+			s->last = base + rand() % 20;
+			s->mean = base + 5 + rand() % 5;
+			s->m2 = 30.0 * s->returned;
+			s->logsum = s->returned * log(s->mean);
+			s->jsum = 2.0 * s->returned;
+			s->responders = 1;
+			s->responder[0].addr = s->addr;
+			s->responder[0].returned = s->returned;
+			s->responder[0].avg = (float)s->mean;
+			for (int r = 0; r < s->returned; r++)
+				s->hist[WinMTRStats::Bucket(base + rand() % 20)]++;
+		}
+		_snprintf(path, MAX_PATH, "%s\\statbench%05d.wms", argv[1], i);
+		if (!part->Write(path))
+			return 1;
+		for (int at = 0; at < HOPS; at++)
+			memset(part->hop[at].hist, 0, sizeof(part->hop[at].hist));
+	}
+
+	_snprintf(path, MAX_PATH, "%s\\statbench*.wms", argv[1]);
+	for (int pass = 0; pass < PASSES; pass++) {
+		WIN32_FIND_DATA fd;
+		int merged = 0;
+
+		QueryPerformanceCounter(&t0);
+		total->Reset();
+		HANDLE hFind = FindFirstFile(path, &fd);
+		if (hFind != INVALID_HANDLE_VALUE) {
+			do {
+				std::string file = std::string(argv[1]) + "\\" + fd.cFileName;
+				if (part->Read(file.c_str()) && total->Merge(part))
+					merged++;
+			} while (FindNextFile(hFind, &fd));
+			FindClose(hFind);
+		}
+		QueryPerformanceCounter(&t1);
+		printf("pass %d: %d files, %d runs merged in %.1f ms\n",
+			pass + 1, merged, total->header.runs, Ms(t0, t1, freq));
+	}
+
+	delete part;
+	delete total;
+	return 0;
+}
@@ -0,0 +1,117 @@
+//*****************************************************************************
+// FILE:            TraceBench.cpp
+//
+//
+// DESCRIPTION: Measures what tracing costs on the reply path: the RTT
+//              statistics of WinMTRNet::ProcessReply with its TRACE_DEBUG,
+//              per reply, with the level compiled out, compiled in but
+//              filtered at run time (--trace info) and recording
+//              (--trace debug).
+//
+//
+// NOTES: Not part of the solution. Build the Release WinMTRLib first, then
+//        from this directory:
+//
+//          cl /nologo /O2 /EHsc /MT /I.. TraceBench.cpp
+//             ..\Release_x32\WinMTRLib.lib
+//
+//        Usage: TraceBench [BATCHES] (default 20). The library compiles
+//        the debug level out of release builds, so the reply path is
+//        copied here with TRACE_DEBUG compiled in; compiled out is the
+//        same loop without it, which is what the macro expands to. Replies
+//        go in batches of half a ring with a pause for the drain thread in
+//        between, so recording always finds room in its ring. The events
+//        are written to tracebench.log in the current directory. Every
+//        time is the best of RUNS runs.
+//
+//*****************************************************************************
+
+#undef WMTR_TRACE_LEVEL
+#define WMTR_TRACE_LEVEL	TRACE_LEVEL_DEBUG
+
+#include "WinMTRCmd.h"
+#include "WinMTRTrace.h"
+#include <math.h>
+
+#define RUNS		3
+#define BATCH		(TRACE_RING_SIZE / 2)
+#define LOG			"tracebench.log"
+
+static LARGE_INTEGER freq;
+
+// the RTT statistics of ProcessReply, for a reply of rtt ms
+static inline void Statistics(s_nethost *h, int rtt)
+{
+	float oldavg;
+
+	h->xmit++;
+	h->jitter = rtt - h->last;
+	if (h->jitter < 0) h->jitter = -h->jitter;
+	h->last = rtt;
+	if (rtt < h->best) h->best = rtt;
+	if (rtt > h->worst) h->worst = rtt;
+	h->returned++;
+	oldavg = h->avg;
+	h->avg += (float)(rtt - oldavg) / h->returned;
+	h->var += (rtt - oldavg) * (rtt - h->avg);
+	h->logsum += log((double)rtt);
+}
+
+static void ReplyPlain(s_nethost *h, int at, int rtt)
+{
+	Statistics(h, rtt);
+}
+
+static void ReplyTraced(s_nethost *h, int at, int rtt)
+{
+	TRACE_DEBUG(TRACE_REPLY, at + 1, IP_SUCCESS, 1);
+	Statistics(h, rtt);
+}
+
+// ns per reply over batches of BATCH replies, the pauses not counted
+static double Time(void (*reply)(s_nethost*, int, int), int batches)
+{
+	double best = 1e9;
+
+	for (int run = 0; run < RUNS; run++) {
+		s_nethost host;
+		LONGLONG total = 0;
+		LARGE_INTEGER t0, t1;
+
+		memset(&host, 0, sizeof(host));
+		host.best = 0x7fffffff;
+		for (int b = 0; b < batches; b++) {
+			QueryPerformanceCounter(&t0);
+			for (int i = 0; i < BATCH; i++)
+				reply(&host, i & 31, 1 + (i & 63));
+			QueryPerformanceCounter(&t1);
+			total += t1.QuadPart - t0.QuadPart;
+			Sleep(TRACE_DRAIN_WAIT * 2);
+		}
+		double ns = (double)total * 1e9 / freq.QuadPart / ((double)batches * BATCH);
+		if (ns < best)
+			best = ns;
+	}
+	return best;
+}
+
+int main(int argc, char *argv[])
+{
+	int batches = (argc > 1) ? atoi(argv[1]) : 20;
+
+	QueryPerformanceFrequency(&freq);
+	printf("%d replies per run, best of %d runs\n", batches * BATCH, RUNS);
+	printf("compiled out       %6.1f ns per reply\n", Time(ReplyPlain, batches));
+
+	if (!WinMTRTrace::Start(TRACE_LEVEL_INFO, LOG))
+		return 1;
+	printf("filtered (info)    %6.1f ns per reply\n", Time(ReplyTraced, batches));
+	WinMTRTrace::Stop();
+
+	if (!WinMTRTrace::Start(TRACE_LEVEL_DEBUG, LOG))
+		return 1;
+	printf("recording (debug)  %6.1f ns per reply\n", Time(ReplyTraced, batches));
+	TRACE_THREAD_EXIT();
+	WinMTRTrace::Stop();
+	return 0;
+}
@@ -0,0 +1,140 @@
+//*****************************************************************************
+// FILE:            WheelBench.cpp
+//
+//
+// DESCRIPTION: Measures WinMTRWheel: the time per Add, Cancel and expiry
+//              with TIMERS timers spread over 10 s, then how late timers
+//              come out of a worker-like loop on the real GetTickCount(),
+//              for timers added already due (the next probe of a task whose
+//              interval has passed) and for timers 1 to 50 ms ahead.
+//
+//
+// NOTES: Not part of the solution. Build the Release WinMTRLib first, then
+//        from this directory:
+//
+//          cl /nologo /O2 /EHsc /MT /I.. WheelBench.cpp
+//             ..\Release_x32\WinMTRLib.lib
+//
+//        Usage: WheelBench [TIMERS] [SECONDS] (default 100000 timers and a
+//        2 s loop). Lateness is QPC time from the due time to the expiry;
+//        a timer ahead can be up to one GetTickCount() tick (15.6 ms
+//        unless timeBeginPeriod was called) late, one already due should
+//        come out on the next pass of the loop.
+//
+//*****************************************************************************
+
+#include "WinMTRWheel.h"
+#include <vector>
+#include <algorithm>
+
+#define LOOP_TIMERS		64
+#define SPAN			10000	// ms the timers of the first part spread over
+
+static LARGE_INTEGER freq;
+
+static double Ns(LARGE_INTEGER a, LARGE_INTEGER b, int n)
+{
+	return (double)(b.QuadPart - a.QuadPart) * 1e9 / freq.QuadPart / n;
+}
+
+static void Throughput(int n)
+{
+	WinMTRWheel wheel;
+	std::vector<wheel_timer> timer(n);
+	LARGE_INTEGER t0, t1;
+	DWORD now = GetTickCount();
+	int expired = 0;
+
+	srand(1);
+	wheel.Reset(now);
+	QueryPerformanceCounter(&t0);
+	for (int i = 0; i < n; i++)
+		wheel.Add(&timer[i], now + ((rand() & 0x7fff) << 15 | (rand() & 0x7fff)) % SPAN);
+	QueryPerformanceCounter(&t1);
+	printf("add      %6.1f ns\n", Ns(t0, t1, n));
+
+	QueryPerformanceCounter(&t0);
+	for (int i = 0; i < n; i += 2)
+		wheel.Cancel(&timer[i]);
+	QueryPerformanceCounter(&t1);
+	printf("cancel   %6.1f ns\n", Ns(t0, t1, (n + 1) / 2));
+	for (int i = 0; i < n; i += 2)
+		wheel.Add(&timer[i], now + ((rand() & 0x7fff) << 15 | (rand() & 0x7fff)) % SPAN);
+
+	// a ms at a time, as often as a busy worker would
+	QueryPerformanceCounter(&t0);
+	for (DWORD at = now; at != now + SPAN; at++)
+		for (wheel_timer *t = wheel.Advance(at); t; t = t->next)
+			expired++;
+	QueryPerformanceCounter(&t1);
+	printf("expire   %6.1f ns per timer, %d expired, %d left\n",
+		Ns(t0, t1, expired), expired, wheel.GetCount());
+}
+
+static void Lateness(int seconds)
+{
+	static const DWORD delays[] = { 0, 1, 2, 5, 10, 20, 50 };
+	const int kinds = sizeof(delays) / sizeof(delays[0]);
+	WinMTRWheel wheel;
+	wheel_timer timer[LOOP_TIMERS];
+	LONGLONG due[LOOP_TIMERS];
+	int kind[LOOP_TIMERS];
+	std::vector<double> late[2];
+	LARGE_INTEGER counter;
+	HANDLE hWake = CreateEvent(NULL, FALSE, FALSE, NULL);
+
+	DWORD now = GetTickCount();
+	DWORD end = now + seconds * 1000;
+	wheel.Reset(now);
+	QueryPerformanceCounter(&counter);
+	for (int i = 0; i < LOOP_TIMERS; i++) {
+		timer[i].data = (void*)(size_t)i;
+		kind[i] = i % kinds;
+		due[i] = counter.QuadPart + delays[kind[i]] * freq.QuadPart / 1000;
+		wheel.Add(&timer[i], now + delays[kind[i]]);
+	}
+
+	while ((LONG)(end - now) > 0) {
+		wheel_timer *next;
+		for (wheel_timer *t = wheel.Advance(now); t; t = next) {
+			int i = (int)(size_t)t->data;
+			next = t->next;
+			QueryPerformanceCounter(&counter);
+			late[delays[kind[i]] > 0].push_back(
+				(double)(counter.QuadPart - due[i]) * 1000 / freq.QuadPart);
+			// the next one of this timer, of the next kind
+			kind[i] = (kind[i] + 1) % kinds;
+			due[i] = counter.QuadPart + delays[kind[i]] * freq.QuadPart / 1000;
+			wheel.Add(&timer[i], now + delays[kind[i]]);
+		}
+		WaitForSingleObject(hWake, wheel.NextDue(now, 100));
+		now = GetTickCount();
+	}
+	CloseHandle(hWake);
+
+	for (int k = 0; k < 2; k++) {
+		std::vector<double>& v = late[k];
+		if (v.empty())
+			continue;
+		std::sort(v.begin(), v.end());
+		double sum = 0;
+		for (size_t i = 0; i < v.size(); i++)
+			sum += v[i];
+		printf("%-12s %7d timers, late %6.2f ms average, %6.2f ms p99, %6.2f ms worst\n",
+			k ? "1 to 50 ms" : "already due", (int)v.size(), sum / v.size(),
+			v[v.size() * 99 / 100], v.back());
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	int n = (argc > 1) ? atoi(argv[1]) : 100000;
+	int seconds = (argc > 2) ? atoi(argv[2]) : 2;
+
+	QueryPerformanceFrequency(&freq);
+	printf("%d timers over %d ms\n", n, SPAN);
+	Throughput(n);
+	printf("worker loop for %d s, %d timers\n", seconds, LOOP_TIMERS);
+	Lateness(seconds);
+	return 0;
+}
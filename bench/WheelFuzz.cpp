@@ -0,0 +1,160 @@
+//*****************************************************************************
+// FILE:            WheelFuzz.cpp
+//
+//
+// DESCRIPTION: Checks WinMTRWheel against a plain list of timers: random
+//              adds (also of times already passed), cancels and advances
+//              over the wrap of GetTickCount(). Every timer has to come out
+//              of the first Advance at or after its due time and not
+//              before, NextDue must never point past the earliest timer
+//              and the counts have to agree.
+//
+//
+// NOTES: Not part of the solution. Build the Release WinMTRLib first, then
+//        from this directory:
+//
+//          cl /nologo /O2 /EHsc /MT /I.. WheelFuzz.cpp
+//             ..\Release_x32\WinMTRLib.lib
+//
+//        Usage: WheelFuzz [STEPS] [SEED] (default 200000 steps, seed 1).
+//        Stops at the first mismatch with the step and the timer; a seed
+//        that fails fails again.
+//
+//*****************************************************************************
+
+#include "WinMTRWheel.h"
+#include <vector>
+
+#define TIMERS		1000
+#define MAX_DELAY	(1 << 25)		// beyond the top level too
+
+static unsigned int seed;
+
+static unsigned int Random()
+{
+	// a fixed generator, rand() differs between runtimes
+	seed = seed * 1103515245 + 12345;
+	return (seed >> 8) & 0xffffff;
+}
+
+static unsigned int Random(unsigned int n)
+{
+	return (unsigned int)(((unsigned __int64)Random() << 24 | Random()) % n);
+}
+
+// a delay: mostly short like probe times, some far out, some passed
+static LONG Delay()
+{
+	switch (Random(8)) {
+	case 0:
+		return -(LONG)Random(100);
+	case 1:
+		return 0;
+	case 2:
+		return (LONG)Random(MAX_DELAY);
+	case 3:
+		return (LONG)Random(300000);
+	default:
+		return (LONG)Random(2000);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	int steps = (argc > 1) ? atoi(argv[1]) : 200000;
+	WinMTRWheel wheel;
+	std::vector<wheel_timer> timer(TIMERS);
+	std::vector<bool> armed(TIMERS, false);
+	std::vector<DWORD> due(TIMERS);
+	int count = 0, expired = 0;
+
+	seed = (argc > 2) ? (unsigned int)atoi(argv[2]) : 1;
+	// starts ten minutes before GetTickCount() wraps
+	DWORD now = 0xffffffff - 600000;
+	wheel.Reset(now);
+	for (int i = 0; i < TIMERS; i++) {
+		timer[i].prev = timer[i].next = NULL;
+		timer[i].data = (void*)(size_t)i;
+	}
+
+	for (int step = 0; step < steps; step++) {
+		int i = Random(TIMERS);
+		unsigned int op = Random(10);
+
+		if (op < 4) {
+			if (armed[i]) {
+				wheel.Cancel(&timer[i]);
+				count--;
+			}
+			due[i] = now + Delay();
+			wheel.Add(&timer[i], due[i]);
+			armed[i] = true;
+			count++;
+		} else if (op < 5) {
+			if (armed[i]) {
+				wheel.Cancel(&timer[i]);
+				armed[i] = false;
+				count--;
+			}
+			if (WinMTRWheel::IsArmed(&timer[i])) {
+				printf("step %d: timer %d still armed after Cancel\n", step, i);
+				return 1;
+			}
+		} else {
+			// the earliest timer, NextDue has to wake up for it
+			LONG earliest = 0x7fffffff;
+			for (int j = 0; j < TIMERS; j++)
+				if (armed[j] && (LONG)(due[j] - now) < earliest)
+					earliest = (LONG)(due[j] - now);
+			DWORD next = wheel.NextDue(now, 0x7fffffff);
+			if (earliest != 0x7fffffff && (LONG)next > (earliest > 0 ? earliest : 0)) {
+				printf("step %d: NextDue %lu, the earliest timer is due in %ld\n",
+					step, next, earliest);
+				return 1;
+			}
+
+			// like GetTickCount(), mostly a tick of 15-16 ms
+			switch (Random(4)) {
+			case 0:
+				break;
+			case 1:
+				now += Random(3);
+				break;
+			case 2:
+				now += next < 100000 ? next : 100000;
+				break;
+			default:
+				now += 15 + Random(2);
+			}
+
+			for (wheel_timer *t = wheel.Advance(now); t; t = t->next) {
+				int j = (int)(size_t)t->data;
+				if (!armed[j]) {
+					printf("step %d: timer %d expired twice or after Cancel\n", step, j);
+					return 1;
+				}
+				if ((LONG)(due[j] - now) > 0) {
+					printf("step %d: timer %d expired %ld ms early\n", step, j,
+						(LONG)(due[j] - now));
+					return 1;
+				}
+				armed[j] = false;
+				count--;
+				expired++;
+			}
+			for (int j = 0; j < TIMERS; j++)
+				if (armed[j] && (LONG)(due[j] - now) <= 0) {
+					printf("step %d: timer %d due %ld ms ago did not expire\n", step, j,
+						(LONG)(now - due[j]));
+					return 1;
+				}
+		}
+		if (wheel.GetCount() != count) {
+			printf("step %d: wheel count %d, expected %d\n", step, wheel.GetCount(), count);
+			return 1;
+		}
+	}
+	printf("%d steps, %d expired, %d armed at the end, time %lu: ok\n",
+		steps, expired, count, now);
+	return 0;
+}
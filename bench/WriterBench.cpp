@@ -0,0 +1,120 @@
+//*****************************************************************************
+// FILE:            WriterBench.cpp
+//
+//
+// DESCRIPTION: Checks that a slow snapshot writer costs snapshots, not
+//              time on the submitting thread: submits COUNT snapshots of
+//              KB kilobytes every PERIOD ms, times each Submit and has a
+//              second thread read FILE all the time, counting reads that
+//              do not hold exactly one complete snapshot.
+//
+//
+// NOTES: Not part of the solution. Build the Release WinMTRLib first, then
+//        from this directory:
+//
+//          cl /nologo /O2 /EHsc /MT /I.. WriterBench.cpp
+//             ..\Release_x32\WinMTRLib.lib
+//
+//        Usage: WriterBench FILE [COUNT] [PERIOD] [KB] (default 100
+//        snapshots of 64 KB every 20 ms). To have the writer fall behind,
+//        raise KB or put FILE on a slow share; the worst write time then
+//        exceeds PERIOD and snapshots are dropped, while the Submit times
+//        stay in microseconds.
+//
+//*****************************************************************************
+
+#include "WinMTRWriter.h"
+
+static LARGE_INTEGER freq;
+static volatile LONG stopReader;
+static LONG reads, incomplete;
+
+static double Us(LARGE_INTEGER a, LARGE_INTEGER b)
+{
+	return (double)(b.QuadPart - a.QuadPart) * 1000000 / freq.QuadPart;
+}
+
+// a snapshot is 'BEGIN n', filler lines and 'END n'
+static unsigned __stdcall ReaderThread(void *p)
+{
+	const char *path = (const char*)p;
+	std::string text;
+	char buf[65536];
+
+	while (!stopReader) {
+		FILE *f = fopen(path, "r");
+		if (f == NULL) {
+			Sleep(1);
+			continue;
+		}
+		text.clear();
+		size_t n;
+		while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+			text.append(buf, n);
+		fclose(f);
+
+		int begin = -1, end = -2;
+		size_t last = text.rfind("END ");
+		sscanf(text.c_str(), "BEGIN %d", &begin);
+		if (last != std::string::npos)
+			sscanf(text.c_str() + last, "END %d", &end);
+		reads++;
+		if (begin != end || text.find("BEGIN ", 1) != std::string::npos)
+			incomplete++;
+		Sleep(1);
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	LARGE_INTEGER t0, t1;
+	std::string snapshot;
+	char line[128];
+	double total = 0, worst = 0;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: WriterBench FILE [COUNT] [PERIOD] [KB]\n");
+		return 1;
+	}
+	int count = (argc > 2) ? atoi(argv[2]) : 100;
+	int period = (argc > 3) ? atoi(argv[3]) : 20;
+	int kb = (argc > 4) ? atoi(argv[4]) : 64;
+	QueryPerformanceFrequency(&freq);
+
+	WinMTRWriter *writer = new WinMTRWriter(argv[1], 0, 0);
+	HANDLE hReader = (HANDLE)_beginthreadex(NULL, 0, ReaderThread, argv[1], 0, NULL);
+
+	for (int i = 0; i < count; i++) {
+		// rendered into the buffer the writer handed back, like Snapshot
+		_snprintf(line, sizeof(line), "BEGIN %d\n", i);
+		snapshot = line;
+		while (snapshot.size() < (size_t)kb * 1024)
+			snapshot += "  1.|-- 192.168.1.1                 0.0%   30     1    1.0    1    1    0.0\n";
+		_snprintf(line, sizeof(line), "END %d\n", i);
+		snapshot += line;
+
+		QueryPerformanceCounter(&t0);
+		writer->Submit(snapshot);
+		QueryPerformanceCounter(&t1);
+		double us = Us(t0, t1);
+		total += us;
+		if (us > worst)
+			worst = us;
+		Sleep(period);
+	}
+	// no more submits, the pending one is written by the destructor
+	int dropped = writer->GetDropped();
+	DWORD worstWrite = writer->GetWorstWrite();
+	delete writer;
+	stopReader = 1;
+	WaitForSingleObject(hReader, INFINITE);
+	CloseHandle(hReader);
+
+	printf("%d snapshots of %d KB every %d ms\n", count, kb, period);
+	printf("writer: %d written, %d dropped, %lu ms worst write before the last\n",
+		count - dropped, dropped, worstWrite);
+	printf("submit: %.1f us average, %.1f us worst\n", total / count, worst);
+	printf("reads:  %d, %d not one complete snapshot\n", (int)reads, (int)incomplete);
+	return 0;
+}